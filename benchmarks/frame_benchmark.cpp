@@ -0,0 +1,213 @@
+// Renders frames of a grid of objects headless, into the images of an LhllOffscreenTarget, and reports
+// percentiles of the frame, CPU and GPU times. Runs on any Vulkan device, to run it on lavapipe point
+// the loader at its driver, e.g. VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json
+// Usage: FrameBenchmark [frames] [objectCount] [width] [height] [none|cpu|gpu] [model] [framesInFlight] [lowLatency 0|1]
+// Models and shaders are loaded relative to ENGINE_DIR like the engine's, so run it from the build directory
+
+#include "lhll_buffer.hpp"
+#include "lhll_camera.hpp"
+#include "lhll_descriptors.hpp"
+#include "lhll_device.hpp"
+#include "lhll_game_object.hpp"
+#include "lhll_geometry_pool.hpp"
+#include "lhll_gpu_timer.hpp"
+#include "lhll_pipeline_registry.hpp"
+#include "lhll_render_graph.hpp"
+#include "lhll_renderer.hpp"
+#include "lhll_thread_pool.hpp"
+#include "lhll_utils.hpp"
+#include "simple_render_system.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace lhll;
+
+// nearest rank
+static double percentile(std::vector<double> samples, double fraction) {
+  if (samples.empty()) return 0.0;
+  std::sort(samples.begin(), samples.end());
+  size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(samples.size())));
+  return samples[std::min(std::max(rank, size_t{1}), samples.size()) - 1];
+}
+
+static void printPercentiles(const char* name, const std::vector<double>& samples) {
+  std::cout << name << " ms: p50 " << percentile(samples, 0.5) << ", p90 " << percentile(samples, 0.9) << ", p99 " << percentile(samples, 0.99) << ", max "
+            << percentile(samples, 1.0) << " (" << samples.size() << " frames)\n";
+}
+
+static int run(int argc, char** argv) {
+  int frameCount = 1000;
+  uint32_t objectCount = 1024;
+  uint32_t width = 1280;
+  uint32_t height = 720;
+  const char* culling = argc > 5 ? argv[5] : "gpu";
+  std::string modelPath = argc > 6 ? argv[6] : "models/smooth_vase.obj";
+  FramePacingConfig framePacing{};
+  int lowLatency = 0;
+  if ((argc > 1 && !parseInteger(argv[1], 1, INT_MAX, frameCount)) || (argc > 2 && !parseInteger<uint32_t>(argv[2], 1, UINT32_MAX, objectCount)) ||
+      (argc > 3 && !parseInteger<uint32_t>(argv[3], 1, UINT32_MAX, width)) || (argc > 4 && !parseInteger<uint32_t>(argv[4], 1, UINT32_MAX, height)) ||
+      (argc > 7 && !parseInteger(argv[7], 1, LhllSwapChain::MAX_FRAMES_IN_FLIGHT, framePacing.framesInFlight)) || (argc > 8 && !parseInteger(argv[8], 0, 1, lowLatency))) {
+    std::cerr << "usage: " << argv[0] << " [frames] [objectCount] [width] [height] [none|cpu|gpu] [model] [framesInFlight 1-" << LhllSwapChain::MAX_FRAMES_IN_FLIGHT
+              << "] [lowLatency 0|1]\n";
+    return 1;
+  }
+  framePacing.lowLatency = lowLatency != 0;
+  // pipelines are compiled in the background and the GPU timer results lag behind, the first frames are not counted
+  const int warmupFrames = 30;
+
+  LhllDevice device{};
+  LhllRenderer renderer{device, VkExtent2D{width, height}, framePacing};
+  LhllThreadPool threadPool{};
+  LhllPipelineRegistry pipelineRegistry{device, threadPool};
+  LhllGeometryPool geometryPool{device, sizeof(LhllModel::Vertex), 1 << 18, 1 << 20};
+
+  // a square grid of the model on a floor that also occludes for the software occlusion culling
+  LhllGameObject::Map gameObjects;
+  std::shared_ptr<LhllModel> model = LhllModel::createModelFromFile(device, modelPath, &geometryPool);
+  uint32_t gridSize = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(objectCount))));
+  for (uint32_t i = 0; i < objectCount; i++) {
+    auto object = LhllGameObject::createGameObject();
+    object.model = model;
+    object.transform.translation = {static_cast<float>(i % gridSize) - 0.5f * gridSize, 0.5f, static_cast<float>(i / gridSize) - 0.5f * gridSize};
+    object.transform.scale = glm::vec3{1.5f};
+    gameObjects.emplace(object.getId(), std::move(object));
+  }
+  auto floor = LhllGameObject::createGameObject();
+  floor.model = LhllModel::createModelFromFile(device, "models/quad.obj", &geometryPool, true);
+  floor.transform.translation = {0.0f, 0.5f, 0.0f};
+  floor.transform.scale = glm::vec3{static_cast<float>(gridSize)};
+  floor.occluder = true;
+  gameObjects.emplace(floor.getId(), std::move(floor));
+
+  auto globalPool = LhllDescriptorPool::Builder(device).setMaxSets(LhllSwapChain::MAX_FRAMES_IN_FLIGHT).addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, LhllSwapChain::MAX_FRAMES_IN_FLIGHT).build();
+  auto globalSetLayout = LhllDescriptorSetLayout::Builder(device).addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS).build();
+  std::vector<std::unique_ptr<LhllBuffer>> uboBuffers(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+  std::vector<VkDescriptorSet> globalDescriptorSets(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+  std::vector<uint64_t> globalDescriptorSetGenerations(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+  for (int i = 0; i < LhllSwapChain::MAX_FRAMES_IN_FLIGHT; i++) {
+    uboBuffers[i] = std::make_unique<LhllBuffer>(device, sizeof(GlobalUbo), 1, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, device.properties.limits.minUniformBufferOffsetAlignment);
+    uboBuffers[i]->map();
+    auto bufferInfo = uboBuffers[i]->descriptorInfo();
+    LhllDescriptorWriter writer(*globalSetLayout, *globalPool);
+    writer.writeBuffer(0, &bufferInfo).build(globalDescriptorSets[i]);
+    globalDescriptorSetGenerations[i] = writer.getGeneration();
+  }
+
+  SimpleRenderSystem simpleRenderSystem{device, pipelineRegistry, threadPool, renderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+  using CullingMode = SimpleRenderSystem::CullingMode;
+  if (std::strcmp(culling, "none") == 0) {
+    simpleRenderSystem.setCullingMode(CullingMode::None);
+  }
+  else if (std::strcmp(culling, "cpu") == 0) {
+    simpleRenderSystem.setCullingMode(CullingMode::Cpu);
+    simpleRenderSystem.setSoftwareOcclusionEnabled(true);
+  }
+  else {
+    simpleRenderSystem.setCullingMode(CullingMode::Gpu);
+    simpleRenderSystem.setOcclusionCullingEnabled(true);
+  }
+
+  // scope 0 is the frame's render graph
+  LhllGpuTimer gpuTimer{device, 1};
+  LhllRenderGraph renderGraph{device};
+  LhllCamera camera{};
+  camera.setPerspectiveProjection(glm::radians(50.0f), renderer.getAspectRatio(), 0.1f, 4.0f * gridSize);
+
+  std::vector<double> frameTimes;
+  std::vector<double> cpuTimes;
+  std::vector<double> gpuTimes;
+  uint32_t pipelineHitchFrames = 0;
+
+  auto lastFrameStart = std::chrono::high_resolution_clock::now();
+  for (int frame = 0; frame < warmupFrames + frameCount; frame++) {
+    auto frameStart = std::chrono::high_resolution_clock::now();
+    bool measured = frame >= warmupFrames;
+    if (measured) {
+      frameTimes.push_back(std::chrono::duration<double, std::milli>(frameStart - lastFrameStart).count());
+    }
+    lastFrameStart = frameStart;
+
+    renderer.waitForLowLatency();
+
+    // circles the grid, so what is culled changes every frame
+    float angle = 0.01f * static_cast<float>(frame);
+    float distance = 0.75f * gridSize + 2.0f;
+    camera.setViewTarget(glm::vec3{distance * std::sin(angle), -0.25f * distance, distance * std::cos(angle)}, glm::vec3{0.0f});
+
+    // waits for the frame that last used this frame slot, or for nothing after waitForLowLatency
+    VkCommandBuffer commandBuffer = renderer.beginFrame();
+    auto cpuStart = std::chrono::high_resolution_clock::now();
+
+    int frameIndex = renderer.getFrameIndex();
+    FrameInfo frameInfo{frameIndex, 1.0f / 60.0f, commandBuffer, camera, globalDescriptorSets[frameIndex], gameObjects};
+    frameInfo.renderPassTarget = {renderer.getSwapChainRenderPass(), renderer.getCurrentFramebuffer(), renderer.getSwapChainExtent(), renderer.getCurrentDepthImageView(), renderer.getRenderPassGeneration()};
+    frameInfo.globalDescriptorSetGeneration = globalDescriptorSetGenerations[frameIndex];
+
+    GlobalUbo ubo{};
+    ubo.projectionView = camera.getProjection() * camera.getView();
+    uboBuffers[frameIndex]->writeToBuffer(&ubo);
+    uboBuffers[frameIndex]->flush();
+
+    gpuTimer.beginFrame(commandBuffer, frameIndex);
+    if (measured && gpuTimer.getMilliseconds(0) > 0.0f) {
+      gpuTimes.push_back(gpuTimer.getMilliseconds(0));
+    }
+
+    simpleRenderSystem.prepareFrame(frameInfo);
+
+    // the same passes as FirstApp's, the color is left to be copied from instead of presented
+    renderGraph.beginFrame(frameIndex);
+    simpleRenderSystem.addPasses(renderGraph, renderer, frameInfo, LhllRenderGraph::Usage::transferSource());
+
+    gpuTimer.beginScope(commandBuffer, 0);
+    renderGraph.execute(commandBuffer);
+    gpuTimer.endScope(commandBuffer, 0);
+    renderer.endFrame();
+
+    if (measured) {
+      cpuTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cpuStart).count());
+      if (frameInfo.stats.pipelineFallbackDraws > 0 || frameInfo.stats.pipelineSkippedDraws > 0) {
+        pipelineHitchFrames++;
+      }
+    }
+  }
+  vkDeviceWaitIdle(device.device());
+
+  std::cout << "device: " << device.properties.deviceName << ", " << width << "x" << height << ", objects: " << objectCount << ", culling: " << culling
+            << ", frames in flight: " << framePacing.framesInFlight << (framePacing.lowLatency ? ", low latency" : "") << '\n';
+  // from one frame's start to the next, what the frame rate is made of
+  printPercentiles("frame", frameTimes);
+  // recording and submitting, without waiting for the frame slot
+  printPercentiles("cpu", cpuTimes);
+  if (gpuTimer.isSupported()) {
+    printPercentiles("gpu", gpuTimes);
+  }
+  else {
+    std::cout << "gpu: the graphics queue has no timestamps\n";
+  }
+  std::cout << "pipeline hitch frames: " << pipelineHitchFrames << '\n';
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  try {
+    return run(argc, argv);
+  }
+  catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+}
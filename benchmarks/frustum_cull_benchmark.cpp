@@ -0,0 +1,79 @@
+// Times LhllFrustumCuller::cull against the scalar reference for a large number of spheres.
+// Usage: FrustumCullBenchmark [sphereCount] [iterations]
+
+#include "lhll_camera.hpp"
+#include "lhll_frustum_culler.hpp"
+#include "lhll_utils.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace lhll;
+
+template <typename F>
+static double bestMilliseconds(int iterations, F&& function) {
+  double best = 1e30;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    function();
+    auto end = std::chrono::high_resolution_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  return best;
+}
+
+int main(int argc, char** argv) {
+  size_t sphereCount = 1000000;
+  int iterations = 20;
+  if ((argc > 1 && !parseInteger<size_t>(argv[1], 1, UINT32_MAX, sphereCount)) || (argc > 2 && !parseInteger(argv[2], 1, INT_MAX, iterations))) {
+    std::cerr << "usage: " << argv[0] << " [sphereCount] [iterations]\n";
+    return 1;
+  }
+
+  LhllCamera camera{};
+  camera.setPerspectiveProjection(glm::radians(50.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+  camera.setViewYXZ(glm::vec3{0.0f, 0.0f, -2.5f}, glm::vec3{0.0f});
+  auto planes = camera.getFrustumPlanes();
+
+  // spread around the camera so roughly a quarter ends up inside the frustum
+  std::mt19937 random{1337};
+  std::uniform_real_distribution<float> position{-100.0f, 100.0f};
+  std::uniform_real_distribution<float> radius{0.1f, 2.0f};
+
+  LhllFrustumCuller culler{};
+  culler.reserve(sphereCount);
+  for (size_t i = 0; i < sphereCount; i++) {
+    culler.addSphere(glm::vec3{position(random), position(random), position(random) + 50.0f}, radius(random));
+  }
+
+  std::vector<uint8_t> scalarVisibility;
+  std::vector<uint8_t> simdVisibility;
+  uint32_t scalarVisible = 0;
+  uint32_t simdVisible = 0;
+
+  double scalarTime = bestMilliseconds(iterations, [&] { scalarVisible = culler.cullScalar(planes, scalarVisibility); });
+  double simdTime = bestMilliseconds(iterations, [&] { simdVisible = culler.cull(planes, simdVisibility); });
+
+  size_t mismatches = 0;
+  for (size_t i = 0; i < sphereCount; i++) {
+    if (scalarVisibility[i] != simdVisibility[i]) mismatches++;
+  }
+
+  std::cout << "spheres: " << sphereCount << ", visible: " << simdVisible << ", culled: " << sphereCount - simdVisible << '\n'
+            << "scalar: " << scalarTime << " ms\n"
+            << LhllFrustumCuller::simdName() << ": " << simdTime << " ms (" << scalarTime / simdTime << "x)\n";
+
+  if (mismatches > 0 || scalarVisible != simdVisible) {
+    std::cerr << mismatches << " spheres differ between the scalar and the SIMD cull\n";
+    return 1;
+  }
+  return 0;
+}
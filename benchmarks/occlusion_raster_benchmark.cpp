@@ -0,0 +1,128 @@
+// Times LhllOcclusionRasterizer on a field of box occluders, rasterized by the scalar reference, the
+// SIMD path and the SIMD path on a thread pool, and the sphere tests against the result.
+// Usage: OcclusionRasterBenchmark [occluderCount] [sphereCount] [iterations]
+
+#include "lhll_camera.hpp"
+#include "lhll_occlusion_rasterizer.hpp"
+#include "lhll_thread_pool.hpp"
+#include "lhll_utils.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace lhll;
+
+template <typename F>
+static double bestMilliseconds(int iterations, F&& function) {
+  double best = 1e30;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    function();
+    auto end = std::chrono::high_resolution_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  return best;
+}
+
+static size_t countMismatches(const std::vector<float>& expected, const std::vector<float>& actual) {
+  size_t mismatches = 0;
+  for (size_t i = 0; i < expected.size(); i++) {
+    if (expected[i] != actual[i]) mismatches++;
+  }
+  return mismatches;
+}
+
+int main(int argc, char** argv) {
+  uint32_t occluderCount = 64;
+  size_t sphereCount = 100000;
+  int iterations = 20;
+  if ((argc > 1 && !parseInteger<uint32_t>(argv[1], 0, UINT32_MAX, occluderCount)) || (argc > 2 && !parseInteger<size_t>(argv[2], 1, UINT32_MAX, sphereCount)) ||
+      (argc > 3 && !parseInteger(argv[3], 1, INT_MAX, iterations))) {
+    std::cerr << "usage: " << argv[0] << " [occluderCount] [sphereCount] [iterations]\n";
+    return 1;
+  }
+
+  LhllCamera camera{};
+  camera.setPerspectiveProjection(glm::radians(50.0f), 2.0f, 0.1f, 100.0f);
+  camera.setViewYXZ(glm::vec3{0.0f, 0.0f, -2.5f}, glm::vec3{0.0f});
+  glm::mat4 projectionView = camera.getProjection() * camera.getView();
+
+  // unit cube, scaled and moved into walls and pillars in front of the camera
+  const std::vector<glm::vec3> cubePositions{
+    {-1.0f, -1.0f, -1.0f}, {1.0f, -1.0f, -1.0f}, {1.0f, 1.0f, -1.0f}, {-1.0f, 1.0f, -1.0f},
+    {-1.0f, -1.0f, 1.0f}, {1.0f, -1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, {-1.0f, 1.0f, 1.0f}};
+  const std::vector<uint32_t> cubeIndices{
+    0, 1, 2, 0, 2, 3, 4, 6, 5, 4, 7, 6, 0, 4, 5, 0, 5, 1,
+    3, 2, 6, 3, 6, 7, 0, 3, 7, 0, 7, 4, 1, 5, 6, 1, 6, 2};
+
+  std::mt19937 random{1337};
+  std::uniform_real_distribution<float> occluderPosition{-15.0f, 15.0f};
+  std::uniform_real_distribution<float> occluderDepth{5.0f, 40.0f};
+  std::uniform_real_distribution<float> occluderSize{0.5f, 4.0f};
+
+  std::vector<glm::mat4> occluderMatrices(occluderCount);
+  for (auto& matrix : occluderMatrices) {
+    matrix = glm::mat4{1.0f};
+    matrix[0][0] = occluderSize(random);
+    matrix[1][1] = occluderSize(random);
+    matrix[2][2] = 0.2f * occluderSize(random);
+    matrix[3] = glm::vec4{occluderPosition(random), occluderPosition(random), occluderDepth(random), 1.0f};
+  }
+
+  std::uniform_real_distribution<float> spherePosition{-20.0f, 20.0f};
+  std::uniform_real_distribution<float> sphereDepth{5.0f, 80.0f};
+  std::uniform_real_distribution<float> sphereRadius{0.1f, 1.0f};
+  std::vector<glm::vec4> spheres(sphereCount);
+  for (auto& sphere : spheres) {
+    sphere = glm::vec4{spherePosition(random), spherePosition(random), sphereDepth(random), sphereRadius(random)};
+  }
+
+  LhllOcclusionRasterizer rasterizer{};
+  LhllThreadPool threadPool{};
+
+  double setupTime = bestMilliseconds(iterations, [&] {
+    rasterizer.beginFrame(projectionView);
+    for (const auto& matrix : occluderMatrices) {
+      rasterizer.addOccluder(matrix, cubePositions.data(), static_cast<uint32_t>(cubePositions.size()), cubeIndices.data(), static_cast<uint32_t>(cubeIndices.size()));
+    }
+  });
+
+  double scalarTime = bestMilliseconds(iterations, [&] { rasterizer.rasterizeScalar(); });
+  std::vector<float> scalarDepth = rasterizer.getDepth();
+  double simdTime = bestMilliseconds(iterations, [&] { rasterizer.rasterize(); });
+  size_t simdMismatches = countMismatches(scalarDepth, rasterizer.getDepth());
+  double threadedTime = bestMilliseconds(iterations, [&] { rasterizer.rasterize(&threadPool); });
+  size_t threadedMismatches = countMismatches(scalarDepth, rasterizer.getDepth());
+
+  size_t visibleCount = 0;
+  double testTime = bestMilliseconds(iterations, [&] {
+    visibleCount = 0;
+    for (const auto& sphere : spheres) {
+      if (rasterizer.isVisible(glm::vec3{sphere}, sphere.w)) visibleCount++;
+    }
+  });
+
+  double triangleCount = static_cast<double>(rasterizer.getTriangleCount());
+  std::cout << "buffer: " << rasterizer.getWidth() << "x" << rasterizer.getHeight() << ", occluders: " << occluderCount << ", triangles set up: " << rasterizer.getTriangleCount() << '\n'
+            << "setup: " << setupTime << " ms\n"
+            << "scalar: " << scalarTime << " ms, " << triangleCount / scalarTime / 1000.0 << " Mtriangles/s\n"
+            << LhllOcclusionRasterizer::simdName() << ": " << simdTime << " ms, " << triangleCount / simdTime / 1000.0 << " Mtriangles/s (" << scalarTime / simdTime << "x)\n"
+            << LhllOcclusionRasterizer::simdName() << " on " << threadPool.getThreadCount() + 1 << " threads: " << threadedTime << " ms, " << triangleCount / threadedTime / 1000.0
+            << " Mtriangles/s (" << scalarTime / threadedTime << "x)\n"
+            << "sphere tests: " << sphereCount << ", visible: " << visibleCount << ", occluded: " << sphereCount - visibleCount << ", " << testTime << " ms, "
+            << static_cast<double>(sphereCount) / testTime / 1000.0 << " Mspheres/s\n";
+
+  if (simdMismatches > 0 || threadedMismatches > 0) {
+    std::cerr << simdMismatches << " (single threaded) and " << threadedMismatches << " (threaded) pixels differ between the scalar and the SIMD rasterizer\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,38 @@
+# Writes OUTPUT, a C++ source defining lhll::findEmbeddedShader (see src/lhll_embedded_shaders.hpp)
+# with every file of INPUTS as a byte array registered under the matching entry of NAMES.
+# Both lists use | as separator. Run with cmake -P, invoked by the Shaders build in CMakeLists.txt.
+
+string(REPLACE "|" ";" INPUTS "${INPUTS}")
+string(REPLACE "|" ";" NAMES "${NAMES}")
+list(LENGTH INPUTS SHADER_COUNT)
+
+set(CONTENT "// generated by cmake/embed_shaders.cmake, do not edit\n#include \"lhll_embedded_shaders.hpp\"\n\nnamespace lhll {\n")
+set(TABLE "")
+
+if (SHADER_COUNT GREATER 0)
+  math(EXPR LAST_INDEX "${SHADER_COUNT} - 1")
+  foreach(INDEX RANGE ${LAST_INDEX})
+    list(GET INPUTS ${INDEX} INPUT)
+    list(GET NAMES ${INDEX} NAME)
+    file(READ "${INPUT}" HEX_CONTENT HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${HEX_CONTENT}")
+    string(APPEND CONTENT "  alignas(4) static const unsigned char shader${INDEX}[] = {${BYTES}};\n")
+    string(APPEND TABLE "    {\"${NAME}\", shader${INDEX}, sizeof(shader${INDEX})},\n")
+  endforeach()
+endif()
+
+string(APPEND CONTENT "
+  static const EmbeddedShader embeddedShaders[] = {
+${TABLE}    {nullptr, nullptr, 0}
+  };
+
+  const EmbeddedShader* findEmbeddedShader(const std::string& name) {
+    for (const auto& shader : embeddedShaders) {
+      if (shader.name != nullptr && name == shader.name) return &shader;
+    }
+    return nullptr;
+  }
+}
+")
+
+file(WRITE "${OUTPUT}" "${CONTENT}")
@@ -0,0 +1,5 @@
+#version 450
+
+// depth only, the pipeline writes no color
+void main() {
+}
@@ -0,0 +1,33 @@
+#version 450
+
+// the position stream split out of the vertex buffer, nothing else is fetched
+layout(location = 0) in vec3 position;
+
+layout(set = 0, binding = 0) uniform GlobalUbo {
+  mat4 projectionViewMatrix;
+  vec4 ambientLightColor;
+  vec3 lightPosition;
+  vec4 lightColor;
+} ubo;
+
+struct ObjectData {
+  mat4 modelMatrix;
+  mat3 normalMatrix;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer ObjectBuffer {
+  ObjectData objects[];
+} objectBuffer;
+
+layout(std430, set = 1, binding = 1) readonly buffer InstanceBuffer {
+  uint objectIndices[];
+} instanceBuffer;
+
+// the main pass tests with EQUAL against this depth, both shaders compute it the same way
+invariant gl_Position;
+
+void main() {
+  ObjectData object = objectBuffer.objects[instanceBuffer.objectIndices[gl_InstanceIndex]];
+  vec4 positionWorld = object.modelMatrix * vec4(position, 1.0);
+  gl_Position = ubo.projectionViewMatrix * positionWorld;
+}
@@ -7,6 +7,9 @@ layout (location = 2) in vec3 fragNormalWorld;
 
 layout (location = 0) out vec4 outColor;
 
+// specialized per pipeline, the disabled branch is compiled away
+layout (constant_id = 0) const bool ENABLE_POINT_LIGHT = true;
+
 layout(set = 0, binding = 0) uniform GlobalUbo {
   mat4 projectionViewMatrix;
   vec4 ambientLightColor;
@@ -14,17 +17,17 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
   vec4 lightColor;
 } ubo;
 
-layout(push_constant) uniform Push {
-  mat4 modelMatrix;
-  mat4 normalMatrix;
-} push;
-
 void main() {
-  vec3 directionToLight = ubo.lightPosition - fragPosWorld;
-  float attenuation = 1.0 / dot(directionToLight, directionToLight);
-
-  vec3 lightColor = ubo.lightColor.xyz * ubo.lightColor.w * attenuation;
   vec3 ambientLight = ubo.ambientLightColor.xyz * ubo.ambientLightColor.w;
-  vec3 diffuseLight = lightColor * max(dot(normalize(fragNormalWorld), normalize(directionToLight)), 0);
+  vec3 diffuseLight = vec3(0.0);
+
+  if (ENABLE_POINT_LIGHT) {
+    vec3 directionToLight = ubo.lightPosition - fragPosWorld;
+    float attenuation = 1.0 / dot(directionToLight, directionToLight);
+
+    vec3 lightColor = ubo.lightColor.xyz * ubo.lightColor.w * attenuation;
+    diffuseLight = lightColor * max(dot(normalize(fragNormalWorld), normalize(directionToLight)), 0);
+  }
+
   outColor = vec4((diffuseLight + ambientLight) * fragColor, 1.0);
 }
@@ -16,15 +16,30 @@ layout(set = 0, binding = 0) uniform GlobalUbo {
   vec4 lightColor;
 } ubo;
 
-layout(push_constant) uniform Push {
+// std430, the mat3 columns are padded to vec4
+struct ObjectData {
   mat4 modelMatrix;
-  mat4 normalMatrix;
-} push;
+  mat3 normalMatrix;
+};
+
+// persistent entry per object, only rewritten when its transform changes
+layout(std430, set = 1, binding = 0) readonly buffer ObjectBuffer {
+  ObjectData objects[];
+} objectBuffer;
+
+// object index of every instance, each instanced draw starts at its group's firstInstance
+layout(std430, set = 1, binding = 1) readonly buffer InstanceBuffer {
+  uint objectIndices[];
+} instanceBuffer;
+
+// matches the depth pre-pass exactly, the EQUAL depth test relies on it
+invariant gl_Position;
 
 void main() {
-  vec4 positionWorld = push.modelMatrix * vec4(position, 1.0);
+  ObjectData object = objectBuffer.objects[instanceBuffer.objectIndices[gl_InstanceIndex]];
+  vec4 positionWorld = object.modelMatrix * vec4(position, 1.0);
   gl_Position = ubo.projectionViewMatrix * positionWorld;
-  fragNormalWorld = normalize(mat3(push.normalMatrix) * normal);
+  fragNormalWorld = normalize(object.normalMatrix * normal);
   fragPosWorld = positionWorld.xyz;
   fragColor = color;
 }
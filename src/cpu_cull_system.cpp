@@ -0,0 +1,62 @@
+#include "cpu_cull_system.hpp"
+
+#include <cassert>
+#include <chrono>
+
+namespace lhll {
+  CpuCullSystem::CpuCullSystem(LhllThreadPool& threadPool) : lhllThreadPool{threadPool} {}
+
+  void CpuCullSystem::cull(FrameInfo& frameInfo, const std::vector<LhllGameObject*>& objects, std::vector<uint8_t>& visibility) {
+    worldSpheres.clear();
+    frustumCuller.clear();
+    for (auto* object : objects) {
+      auto& obj = *object;
+
+      // rotation keeps the radius, non uniform scale is covered by the largest axis
+      glm::vec4 sphere = obj.model->getBoundingSphere();
+      glm::vec3 center = obj.transform.mat4() * glm::vec4{glm::vec3{sphere}, 1.0f};
+      glm::vec3 scale = glm::abs(obj.transform.scale);
+      float radius = sphere.w * glm::max(scale.x, glm::max(scale.y, scale.z));
+      worldSpheres.emplace_back(center, radius);
+      frustumCuller.addSphere(center, radius);
+    }
+
+    uint32_t visibleCount = frustumCuller.cull(frameInfo.camera.getFrustumPlanes(), visibility);
+    frameInfo.stats.cpuCulledObjects = static_cast<uint32_t>(frustumCuller.size()) - visibleCount;
+
+    if (softwareOcclusionEnabled) {
+      cullOccluded(frameInfo, objects, visibility);
+    }
+  }
+
+  // Rasterizes the occluders that survived the frustum cull and drops the objects behind them
+  void CpuCullSystem::cullOccluded(FrameInfo& frameInfo, const std::vector<LhllGameObject*>& objects, std::vector<uint8_t>& visibility) {
+    auto rasterStart = std::chrono::high_resolution_clock::now();
+    occlusionRasterizer.beginFrame(frameInfo.camera.getProjection() * frameInfo.camera.getView());
+    bool hasOccluders = false;
+    for (size_t i = 0; i < objects.size(); i++) {
+      auto& obj = *objects[i];
+      if (!visibility[i] || !obj.occluder) continue;
+      assert(obj.model->hasCpuGeometry() && "Occluder model was not built with keepCpuGeometry");
+      const auto& positions = obj.model->getPositions();
+      const auto& indices = obj.model->getIndices();
+      occlusionRasterizer.addOccluder(obj.transform.mat4(), positions.data(), static_cast<uint32_t>(positions.size()), indices.data(), static_cast<uint32_t>(indices.size()));
+      hasOccluders = true;
+    }
+    if (!hasOccluders) return;
+
+    occlusionRasterizer.rasterize(&lhllThreadPool);
+    auto rasterEnd = std::chrono::high_resolution_clock::now();
+    frameInfo.stats.occlusionRasterMicroseconds = std::chrono::duration<float, std::micro>(rasterEnd - rasterStart).count();
+
+    for (size_t i = 0; i < objects.size(); i++) {
+      auto& obj = *objects[i];
+      if (!visibility[i] || obj.occluder || !obj.renderState.isOcclusionCullable()) continue;
+      const glm::vec4& sphere = worldSpheres[i];
+      if (!occlusionRasterizer.isVisible(glm::vec3{sphere}, sphere.w)) {
+        visibility[i] = 0;
+        frameInfo.stats.cpuOccludedObjects++;
+      }
+    }
+  }
+}
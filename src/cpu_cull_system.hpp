@@ -0,0 +1,43 @@
+#ifndef CPU_CULL_SYSTEM_HPP
+#define CPU_CULL_SYSTEM_HPP
+
+#include "lhll_frame_info.hpp"
+#include "lhll_frustum_culler.hpp"
+#include "lhll_game_object.hpp"
+#include "lhll_occlusion_rasterizer.hpp"
+#include "lhll_thread_pool.hpp"
+
+#include <vector>
+
+namespace lhll {
+  // Culls objects on the CPU before anything is written for them. Bounding spheres are tested against
+  // the camera frustum with SIMD. With software occlusion on, the occluder flagged objects that are in
+  // the frustum are then rasterized on the thread pool and the others are tested against their depth
+  class CpuCullSystem {
+  public:
+    CpuCullSystem(LhllThreadPool& threadPool);
+
+    CpuCullSystem(const CpuCullSystem&) = delete;
+    CpuCullSystem& operator=(const CpuCullSystem&) = delete;
+
+    // visibility[i] is set to 1 for each of objects that is kept, the culled ones are counted in
+    // frameInfo.stats
+    void cull(FrameInfo& frameInfo, const std::vector<LhllGameObject*>& objects, std::vector<uint8_t>& visibility);
+
+    // the occluders themselves and objects not drawn with an ordinary depth test are always kept
+    void setSoftwareOcclusionEnabled(bool enabled) { softwareOcclusionEnabled = enabled; }
+    bool isSoftwareOcclusionEnabled() const { return softwareOcclusionEnabled; }
+
+  private:
+    void cullOccluded(FrameInfo& frameInfo, const std::vector<LhllGameObject*>& objects, std::vector<uint8_t>& visibility);
+
+    LhllThreadPool& lhllThreadPool;
+    LhllFrustumCuller frustumCuller;
+    LhllOcclusionRasterizer occlusionRasterizer;
+    bool softwareOcclusionEnabled = false;
+    // world space bounding sphere of each object, used by both tests
+    std::vector<glm::vec4> worldSpheres;
+  };
+}
+
+#endif
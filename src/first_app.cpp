@@ -3,6 +3,9 @@
 #include "keyboard_movement_controller.hpp"
 #include "lhll_buffer.hpp"
 #include "lhll_camera.hpp"
+#include "lhll_gpu_timer.hpp"
+#include "lhll_occlusion_rasterizer.hpp"
+#include "lhll_render_graph.hpp"
 #include "simple_render_system.hpp"
 
 #define GLM_FORCE_RADIANS
@@ -13,19 +16,40 @@
 #include <array>
 #include <chrono>
 #include <cassert>
+#include <functional>
 #include <stdexcept>
+#include <string>
 
 #include <iostream>
 
 namespace lhll {
-  struct GlobalUbo {
-    glm::mat4 projectionView{1.0f};
-    glm::vec4 ambientLightColor{1.0f, 1.0f, 1.0f, 0.02f};
-    glm::vec3 lightPosition{-1.0f};
-    alignas(16) glm::vec4 lightColor{1.0f};
+  // a setting of the render system changed when its key goes down, shown in the window title
+  struct KeyToggle {
+    int key;
+    std::string label;
+    std::function<void()> toggle;
+    std::function<const char*()> state;
+    bool keyDown = false;
   };
 
-  FirstApp::FirstApp() {
+  static KeyToggle makeFlagToggle(int key, std::string label, SimpleRenderSystem& system, bool (SimpleRenderSystem::*isEnabled)() const, void (SimpleRenderSystem::*setEnabled)(bool)) {
+    return {
+        key,
+        std::move(label),
+        [&system, isEnabled, setEnabled]() { (system.*setEnabled)(!(system.*isEnabled)()); },
+        [&system, isEnabled]() { return (system.*isEnabled)() ? "on" : "off"; }};
+  }
+
+  static std::string describeToggles(const std::vector<KeyToggle>& toggles) {
+    std::string status;
+    for (const auto& toggle : toggles) {
+      if (!status.empty()) status += ", ";
+      status += toggle.label + ": " + toggle.state();
+    }
+    return status;
+  }
+
+  FirstApp::FirstApp(const FramePacingConfig& framePacing) : lhllRenderer{lhllWindow, lhllDevice, framePacing} {
     globalPool = LhllDescriptorPool::Builder(lhllDevice).setMaxSets(LhllSwapChain::MAX_FRAMES_IN_FLIGHT).addPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, LhllSwapChain::MAX_FRAMES_IN_FLIGHT).build();
     loadGameObjects();
     }
@@ -42,12 +66,18 @@ namespace lhll {
     auto globalSetLayout = LhllDescriptorSetLayout::Builder(lhllDevice).addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS).build();
 
     std::vector<VkDescriptorSet> globalDescriptorSets(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    std::vector<uint64_t> globalDescriptorSetGenerations(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
     for (int i = 0; i < globalDescriptorSets.size(); i++) {
       auto bufferInfo = uboBuffers[i]->descriptorInfo();
-      LhllDescriptorWriter(*globalSetLayout, *globalPool).writeBuffer(0, &bufferInfo).build(globalDescriptorSets[i]);
+      LhllDescriptorWriter writer(*globalSetLayout, *globalPool);
+      writer.writeBuffer(0, &bufferInfo).build(globalDescriptorSets[i]);
+      globalDescriptorSetGenerations[i] = writer.getGeneration();
     }
 
-    SimpleRenderSystem simpleRenderSystem{lhllDevice, lhllRenderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+    SimpleRenderSystem simpleRenderSystem{lhllDevice, lhllPipelineRegistry, lhllThreadPool, lhllRenderer.getSwapChainRenderPass(), globalSetLayout->getDescriptorSetLayout()};
+    // scope 0 is the swap chain render pass
+    LhllGpuTimer gpuTimer{lhllDevice, 1};
+    LhllRenderGraph renderGraph{lhllDevice};
     LhllCamera camera{};
     //camera.setViewDirection(glm::vec3(0.0f), glm::vec3(0.5f, 0.0f, 1.0f));
     camera.setViewTarget(glm::vec3(-1.0f, -2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 2.5f));
@@ -57,11 +87,52 @@ namespace lhll {
     KeyboardMovementController cameraController{};
 
     auto currentTime = std::chrono::high_resolution_clock::now();
+    float statsTime = 0.0f;
+    uint32_t statsFrames = 0;
+    // summed over the frames since the last report
+    FrameStats statsTotal{};
+    uint32_t statsPipelineHitches = 0;
+    // frames that executed their draws from the command buffer cache
+    uint32_t statsReusedFrames = 0;
+    float statsGpuMilliseconds = 0.0f;
+    uint32_t statsGpuFrames = 0;
 
     glfwSetInputMode(lhllWindow.getGLFWwindow(), GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 
+    using CullingMode = SimpleRenderSystem::CullingMode;
+    std::vector<KeyToggle> toggles{
+        makeFlagToggle(GLFW_KEY_L, "light", simpleRenderSystem, &SimpleRenderSystem::isPointLightEnabled, &SimpleRenderSystem::setPointLightEnabled),
+        makeFlagToggle(GLFW_KEY_I, "indirect", simpleRenderSystem, &SimpleRenderSystem::isIndirectDrawEnabled, &SimpleRenderSystem::setIndirectDrawEnabled),
+        // none -> cpu -> gpu
+        {GLFW_KEY_G,
+         "culling",
+         [&simpleRenderSystem]() {
+           auto mode = simpleRenderSystem.getCullingMode();
+           simpleRenderSystem.setCullingMode(mode == CullingMode::None ? CullingMode::Cpu : mode == CullingMode::Cpu ? CullingMode::Gpu : CullingMode::None);
+         },
+         [&simpleRenderSystem]() {
+           auto mode = simpleRenderSystem.getCullingMode();
+           return mode == CullingMode::None ? "none" : mode == CullingMode::Cpu ? "cpu" : "gpu";
+         }},
+        makeFlagToggle(GLFW_KEY_P, "parallel", simpleRenderSystem, &SimpleRenderSystem::isParallelRecordingEnabled, &SimpleRenderSystem::setParallelRecordingEnabled),
+        makeFlagToggle(GLFW_KEY_K, "cache", simpleRenderSystem, &SimpleRenderSystem::isCommandCachingEnabled, &SimpleRenderSystem::setCommandCachingEnabled),
+        // needs extended dynamic state
+        {GLFW_KEY_Z,
+         "pre-pass",
+         [&simpleRenderSystem]() {
+           if (simpleRenderSystem.isDepthPrepassSupported()) simpleRenderSystem.setDepthPrepassEnabled(!simpleRenderSystem.isDepthPrepassEnabled());
+         },
+         [&simpleRenderSystem]() {
+           if (!simpleRenderSystem.isDepthPrepassSupported()) return "unsupported";
+           return simpleRenderSystem.isDepthPrepassEnabled() ? "on" : "off";
+         }},
+        makeFlagToggle(GLFW_KEY_O, "occlusion", simpleRenderSystem, &SimpleRenderSystem::isOcclusionCullingEnabled, &SimpleRenderSystem::setOcclusionCullingEnabled),
+        makeFlagToggle(GLFW_KEY_X, std::string{"software occlusion ("} + LhllOcclusionRasterizer::simdName() + ")", simpleRenderSystem, &SimpleRenderSystem::isSoftwareOcclusionEnabled, &SimpleRenderSystem::setSoftwareOcclusionEnabled)};
+    lhllWindow.setStatus(describeToggles(toggles));
+
     while (!lhllWindow.shouldClose()) {
       double xpos, ypos;
+      lhllRenderer.waitForLowLatency();
       glfwPollEvents();
       glfwGetCursorPos(lhllWindow.getGLFWwindow(), &xpos, &ypos);
 
@@ -69,6 +140,24 @@ namespace lhll {
       float frameTime = std::chrono::duration<float, std::chrono::seconds::period>(newTime - currentTime).count();
       currentTime = newTime;
 
+      bool toggled = false;
+      for (auto& toggle : toggles) {
+        bool keyPressed = glfwGetKey(lhllWindow.getGLFWwindow(), toggle.key) == GLFW_PRESS;
+        if (keyPressed && !toggle.keyDown) {
+          toggle.toggle();
+          toggled = true;
+        }
+        toggle.keyDown = keyPressed;
+      }
+      if (toggled) lhllWindow.setStatus(describeToggles(toggles));
+
+      for (const auto& shaderPath : lhllShaderWatcher.takeRecompiledShaders()) {
+        if (lhllPipelineRegistry.reloadShader(shaderPath)) {
+          std::cout << "Reloaded shader " << shaderPath << std::endl;
+          simpleRenderSystem.reloadShader(shaderPath);
+        }
+      }
+
       cameraController.moveInPlaneXZMouse(lhllWindow.getGLFWwindow(), frameTime, glm::vec2{float(ypos), float(xpos)}, viewerObject);
       camera.setViewYXZ(viewerObject.transform.translation, viewerObject.transform.rotation);
 
@@ -78,6 +167,8 @@ namespace lhll {
       if (auto commandBuffer = lhllRenderer.beginFrame()) {
         int frameIndex = lhllRenderer.getFrameIndex();
         FrameInfo frameInfo{frameIndex, frameTime, commandBuffer, camera, globalDescriptorSets[frameIndex], gameObjects};
+        frameInfo.renderPassTarget = {lhllRenderer.getSwapChainRenderPass(), lhllRenderer.getCurrentFramebuffer(), lhllRenderer.getSwapChainExtent(), lhllRenderer.getCurrentDepthImageView(), lhllRenderer.getRenderPassGeneration()};
+        frameInfo.globalDescriptorSetGeneration = globalDescriptorSetGenerations[frameIndex];
 
         // update systems
         GlobalUbo ubo{};
@@ -85,11 +176,47 @@ namespace lhll {
         uboBuffers[frameIndex]->writeToBuffer(&ubo);
         uboBuffers[frameIndex]->flush();
 
-        // render system
-        lhllRenderer.beginSwapChainRenderPass(commandBuffer);
-        simpleRenderSystem.renderGameObjects(frameInfo);
-        lhllRenderer.endSwapChainRenderPass(commandBuffer);
+        // the render pass time of the frame that last used this frame index
+        gpuTimer.beginFrame(commandBuffer, frameIndex);
+        if (gpuTimer.getMilliseconds(0) > 0.0f) {
+          statsGpuMilliseconds += gpuTimer.getMilliseconds(0);
+          statsGpuFrames++;
+        }
+
+        // compute work has to be recorded outside of the render pass
+        simpleRenderSystem.prepareFrame(frameInfo);
+
+        renderGraph.beginFrame(frameIndex);
+        simpleRenderSystem.addPasses(renderGraph, lhllRenderer, frameInfo, LhllRenderGraph::Usage::present());
+
+        gpuTimer.beginScope(commandBuffer, 0);
+        renderGraph.execute(commandBuffer);
+        gpuTimer.endScope(commandBuffer, 0);
         lhllRenderer.endFrame();
+
+        statsFrames++;
+        statsTotal += frameInfo.stats;
+        if (frameInfo.stats.reusedCommandBuffers > 0) statsReusedFrames++;
+        if (frameInfo.stats.pipelineFallbackDraws > 0 || frameInfo.stats.pipelineSkippedDraws > 0) {
+          statsPipelineHitches++;
+        }
+      }
+
+      statsTime += frameTime;
+      if (statsTime >= 1.0f) {
+        std::cout << "fps: " << statsFrames / statsTime
+                  << ", gpu render pass ms: " << (statsGpuFrames > 0 ? statsGpuMilliseconds / statsGpuFrames : 0.0f)
+                  << ", reused frames: " << statsReusedFrames
+                  << ", pipeline hitch frames: " << statsPipelineHitches << ", ";
+        statsTotal.printAverages(std::cout, statsFrames);
+        std::cout << std::endl;
+        statsTime = 0.0f;
+        statsFrames = 0;
+        statsTotal = {};
+        statsGpuMilliseconds = 0.0f;
+        statsGpuFrames = 0;
+        statsReusedFrames = 0;
+        statsPipelineHitches = 0;
       }
     }
 
@@ -97,25 +224,26 @@ namespace lhll {
   }
 
   void FirstApp::loadGameObjects() {
-    std::shared_ptr<LhllModel> lhllModel = LhllModel::createModelFromFile(lhllDevice, "models/flat_vase.obj");
+    std::shared_ptr<LhllModel> lhllModel = LhllModel::createModelFromFile(lhllDevice, "models/flat_vase.obj", &lhllGeometryPool);
     auto flatVase = LhllGameObject::createGameObject();
     flatVase.model = lhllModel;
     flatVase.transform.translation = {-0.5f, 0.5f, 0.0f};
     flatVase.transform.scale = {3.0f, 1.5f, 3.0f};
     gameObjects.emplace(flatVase.getId(), std::move(flatVase));
 
-    lhllModel = LhllModel::createModelFromFile(lhllDevice, "models/smooth_vase.obj");
+    lhllModel = LhllModel::createModelFromFile(lhllDevice, "models/smooth_vase.obj", &lhllGeometryPool);
     auto smoothVase = LhllGameObject::createGameObject();
     smoothVase.model = lhllModel;
     smoothVase.transform.translation = {0.5f, 0.5f, 0.0f};
     smoothVase.transform.scale = {3.0f, 1.5f, 3.0f};
     gameObjects.emplace(smoothVase.getId(), std::move(smoothVase));
 
-    lhllModel = LhllModel::createModelFromFile(lhllDevice, "models/quad.obj");
+    lhllModel = LhllModel::createModelFromFile(lhllDevice, "models/quad.obj", &lhllGeometryPool, true);
     auto floor = LhllGameObject::createGameObject();
     floor.model = lhllModel;
     floor.transform.translation = {0.0f, 0.5f, 0.0f};
     floor.transform.scale = {10.0f, 1.0f, 10.0f};
+    floor.occluder = true;
     gameObjects.emplace(floor.getId(), std::move(floor));
   }
 }
@@ -3,8 +3,12 @@
 
 #include "lhll_device.hpp"
 #include "lhll_game_object.hpp"
+#include "lhll_geometry_pool.hpp"
+#include "lhll_pipeline_registry.hpp"
 #include "lhll_window.hpp"
 #include "lhll_renderer.hpp"
+#include "lhll_shader_watcher.hpp"
+#include "lhll_thread_pool.hpp"
 #include "lhll_descriptors.hpp"
 
 #include <memory>
@@ -16,7 +20,7 @@ namespace lhll {
     static constexpr int WIDTH = 1200;
     static constexpr int HEIGHT = 900;
 
-    FirstApp();
+    FirstApp(const FramePacingConfig& framePacing = {});
     ~FirstApp();
 
     FirstApp(const FirstApp&) = delete;
@@ -28,9 +32,14 @@ namespace lhll {
 
     LhllWindow lhllWindow{WIDTH, HEIGHT, "Vulkan engine"};
     LhllDevice lhllDevice{lhllWindow};
-    LhllRenderer lhllRenderer{lhllWindow, lhllDevice};
+    LhllRenderer lhllRenderer;
+    LhllThreadPool lhllThreadPool{};
+    LhllPipelineRegistry lhllPipelineRegistry{lhllDevice, lhllThreadPool};
+    LhllShaderWatcher lhllShaderWatcher{};
 
     std::unique_ptr<LhllDescriptorPool> globalPool{};
+    // every model of the scene, so the whole scene can be drawn with one multi draw indirect
+    LhllGeometryPool lhllGeometryPool{lhllDevice, sizeof(LhllModel::Vertex), 1 << 18, 1 << 20};
     LhllGameObject::Map gameObjects;
   };
 }
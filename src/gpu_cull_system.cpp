@@ -0,0 +1,281 @@
+#include "gpu_cull_system.hpp"
+
+#include "lhll_swap_chain.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+namespace lhll {
+  static const std::string cullShaderPath = "shaders/frustum_cull.comp.spv";
+  static const std::string occlusionShaderPath = "shaders/occlusion_cull.comp.spv";
+  // local_size_x of frustum_cull.comp and occlusion_cull.comp
+  static constexpr uint32_t CULL_GROUP_SIZE = 64;
+  static constexpr uint32_t CULL_BINDING_COUNT = 7;
+
+  struct CullPushConstantData {
+    glm::vec4 frustumPlanes[6];
+    uint32_t objectCount;
+    VkBool32 occlusionCulled;
+  };
+
+  struct OcclusionPushConstantData {
+    glm::mat4 projectionView;
+    uint32_t objectCount;
+  };
+
+  GpuCullSystem::GpuCullSystem(LhllDevice& device, LhllPipelineRegistry& pipelineRegistry) : lhllDevice{device}, lhllPipelineRegistry{pipelineRegistry}, depthPyramid{device, pipelineRegistry} {
+    createDescriptorSets();
+    createPipelineLayouts();
+    cullPipeline = lhllPipelineRegistry.getComputePipeline(cullShaderPath, *pipelineLayout);
+    occlusionPipeline = lhllPipelineRegistry.getComputePipeline(occlusionShaderPath, *occlusionPipelineLayout);
+  }
+
+  void GpuCullSystem::createDescriptorSets() {
+    auto builder = LhllDescriptorSetLayout::Builder(lhllDevice);
+    for (uint32_t binding = 0; binding < CULL_BINDING_COUNT; binding++) {
+      builder.addBinding(binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+    }
+    cullSetLayout = builder.build();
+    pyramidSetLayout = LhllDescriptorSetLayout::Builder(lhllDevice).addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT).build();
+    // an early and a late cull set and a pyramid set per frame
+    cullPool = LhllDescriptorPool::Builder(lhllDevice)
+                   .setMaxSets(3 * LhllSwapChain::MAX_FRAMES_IN_FLIGHT)
+                   .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * CULL_BINDING_COUNT * LhllSwapChain::MAX_FRAMES_IN_FLIGHT)
+                   .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, LhllSwapChain::MAX_FRAMES_IN_FLIGHT)
+                   .build();
+
+    cullDescriptorSets.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    lateCullDescriptorSets.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    pyramidDescriptorSets.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    objectDrawBuffers.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    drawBoundsBuffers.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    visibleInstanceBuffers.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    lateVisibleInstanceBuffers.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    lateCommandBuffers.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    culledObjectCounts.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT, 0);
+    culledCommandCounts.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT, 0);
+    culledLateFrames.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT, 0);
+    for (int i = 0; i < cullDescriptorSets.size(); i++) {
+      if (!cullPool->allocateDescriptorSet(cullSetLayout->getDescriptorSetLayout(), cullDescriptorSets[i]) ||
+          !cullPool->allocateDescriptorSet(cullSetLayout->getDescriptorSetLayout(), lateCullDescriptorSets[i]) ||
+          !cullPool->allocateDescriptorSet(pyramidSetLayout->getDescriptorSetLayout(), pyramidDescriptorSets[i])) {
+        throw std::runtime_error("failed to allocate cull descriptor set");
+      }
+      LhllBuffer::reserve(visibleInstanceBuffers[i], lhllDevice, sizeof(uint32_t), 1, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      LhllBuffer::reserve(lateVisibleInstanceBuffers[i], lhllDevice, sizeof(uint32_t), 1, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      LhllBuffer::reserve(lateCommandBuffers[i], lhllDevice, sizeof(VkDrawIndexedIndirectCommand), 1, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    }
+  }
+
+  void GpuCullSystem::createPipelineLayouts() {
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstantData);
+    pipelineLayout = std::make_unique<LhllPipelineLayout>(lhllDevice, std::vector<VkDescriptorSetLayout>{cullSetLayout->getDescriptorSetLayout()}, std::vector<VkPushConstantRange>{pushConstantRange});
+
+    pushConstantRange.size = sizeof(OcclusionPushConstantData);
+    std::vector<VkDescriptorSetLayout> occlusionSetLayouts{cullSetLayout->getDescriptorSetLayout(), pyramidSetLayout->getDescriptorSetLayout()};
+    occlusionPipelineLayout = std::make_unique<LhllPipelineLayout>(lhllDevice, occlusionSetLayouts, std::vector<VkPushConstantRange>{pushConstantRange});
+  }
+
+  void GpuCullSystem::reloadShader(const std::string& filepath) {
+    depthPyramid.reloadShader(filepath);
+    if (filepath != cullShaderPath && filepath != occlusionShaderPath) return;
+
+    bool occlusion = filepath == occlusionShaderPath;
+    auto& current = occlusion ? occlusionPipeline : cullPipeline;
+    try {
+      auto pipeline = lhllPipelineRegistry.getComputePipeline(filepath, occlusion ? *occlusionPipelineLayout : *pipelineLayout);
+      current = std::move(pipeline);
+    }
+    catch (const std::exception& e) {
+      std::cerr << "Cull pipeline creation failed, keeping the previous one: " << e.what() << '\n';
+    }
+  }
+
+  // Slots without a result count as not visible in the last frame, so the late pass tests them and
+  // nothing pops in. The barrier also orders this frame's reads after the last frame's writes
+  void GpuCullSystem::reserveVisibility(VkCommandBuffer commandBuffer, uint32_t objectTableSize) {
+    VkAccessFlags srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    if (visibilityBuffer == nullptr || visibilityBuffer->getInstanceCount() < objectTableSize) {
+      uint32_t capacity = objectTableSize;
+      if (visibilityBuffer != nullptr) {
+        capacity = std::max(objectTableSize, 2 * visibilityBuffer->getInstanceCount());
+      }
+      LhllBuffer::reserve(visibilityBuffer, lhllDevice, sizeof(uint32_t), capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      vkCmdFillBuffer(commandBuffer, visibilityBuffer->getBuffer(), 0, VK_WHOLE_SIZE, 0);
+      srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccessMask;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, srcStageMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  // the buffers of this frame may have been replaced, and the set is not in use since its previous frame was waited on
+  void GpuCullSystem::writeCullSet(VkDescriptorSet descriptorSet, LhllBuffer& objectTableBuffer, LhllBuffer& instanceBuffer, LhllBuffer& drawCommandBuffer, LhllBuffer& visibleInstanceBuffer, int frameIndex) {
+    std::array<VkDescriptorBufferInfo, CULL_BINDING_COUNT> bufferInfos{
+      instanceBuffer.descriptorInfo(),
+      objectDrawBuffers[frameIndex]->descriptorInfo(),
+      drawBoundsBuffers[frameIndex]->descriptorInfo(),
+      drawCommandBuffer.descriptorInfo(),
+      visibleInstanceBuffer.descriptorInfo(),
+      objectTableBuffer.descriptorInfo(),
+      visibilityBuffer->descriptorInfo()};
+    LhllDescriptorWriter writer{*cullSetLayout, *cullPool};
+    for (uint32_t binding = 0; binding < bufferInfos.size(); binding++) {
+      writer.writeBuffer(binding, &bufferInfos[binding]);
+    }
+    writer.overwrite(descriptorSet);
+  }
+
+  // the host reads the instance counts back once the frame completed
+  void GpuCullSystem::recordResultBarrier(VkCommandBuffer commandBuffer) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+  }
+
+  // The draw of each instance, the same ranges as the batcher's instance buffer. A negative radius
+  // keeps a draw from being occlusion culled
+  void GpuCullSystem::writeCullInputs(int frameIndex, const LhllDrawBatcher& batcher) {
+    objectDrawIndices.resize(batcher.getInstanceCount());
+    drawBounds.resize(batcher.getCommandCount());
+
+    const auto& instanceGroups = batcher.getInstanceGroups();
+    for (const auto& batch : batcher.getDrawBatches()) {
+      uint32_t command = batch.firstCommand;
+      for (uint32_t groupIndex : batch.groups) {
+        const auto& group = instanceGroups[groupIndex];
+        std::fill_n(objectDrawIndices.begin() + group.firstInstance, group.instanceCount, command);
+        drawBounds[command] = group.model->getBoundingSphere();
+        if (!group.renderState.isOcclusionCullable()) drawBounds[command].w = -drawBounds[command].w;
+        command++;
+      }
+    }
+
+    LhllBuffer::reserve(objectDrawBuffers[frameIndex], lhllDevice, sizeof(uint32_t), static_cast<uint32_t>(objectDrawIndices.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    LhllBuffer::reserve(drawBoundsBuffers[frameIndex], lhllDevice, sizeof(glm::vec4), static_cast<uint32_t>(drawBounds.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    objectDrawBuffers[frameIndex]->writeToBuffer(objectDrawIndices.data(), objectDrawIndices.size() * sizeof(uint32_t));
+    objectDrawBuffers[frameIndex]->flush();
+    drawBoundsBuffers[frameIndex]->writeToBuffer(drawBounds.data(), drawBounds.size() * sizeof(glm::vec4));
+    drawBoundsBuffers[frameIndex]->flush();
+  }
+
+  void GpuCullSystem::readBackResults(FrameInfo& frameInfo, LhllDrawBatcher& batcher) {
+    int frameIndex = frameInfo.frameIndex;
+    uint32_t commandCount = culledCommandCounts[frameIndex];
+    if (commandCount == 0) return;
+
+    auto& buffer = batcher.getIndirectBuffer(frameIndex);
+    buffer.invalidate();
+    auto* commands = static_cast<const VkDrawIndexedIndirectCommand*>(buffer.getMappedMemory());
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = 0; i < commandCount; i++) {
+      visibleCount += commands[i].instanceCount;
+    }
+
+    // an object is drawn by at most one of the passes
+    if (culledLateFrames[frameIndex]) {
+      auto& lateBuffer = *lateCommandBuffers[frameIndex];
+      lateBuffer.invalidate();
+      auto* lateCommands = static_cast<const VkDrawIndexedIndirectCommand*>(lateBuffer.getMappedMemory());
+      for (uint32_t i = 0; i < commandCount; i++) {
+        frameInfo.stats.lateDrawnObjects += lateCommands[i].instanceCount;
+      }
+      visibleCount += frameInfo.stats.lateDrawnObjects;
+    }
+    frameInfo.stats.gpuCulledObjects = culledObjectCounts[frameIndex] - visibleCount;
+
+    culledObjectCounts[frameIndex] = 0;
+    culledCommandCounts[frameIndex] = 0;
+    culledLateFrames[frameIndex] = 0;
+  }
+
+  void GpuCullSystem::cull(FrameInfo& frameInfo, LhllDrawBatcher& batcher, bool occlusionCulled) {
+    assert(batcher.isAllIndirect() && "GPU cull needs every draw to be indirect");
+    int frameIndex = frameInfo.frameIndex;
+    uint32_t objectCount = batcher.getInstanceCount();
+    uint32_t commandCount = batcher.getCommandCount();
+    culledObjectCounts[frameIndex] = objectCount;
+    culledCommandCounts[frameIndex] = commandCount;
+    if (objectCount == 0) return;
+
+    writeCullInputs(frameIndex, batcher);
+    LhllBuffer::reserve(visibleInstanceBuffers[frameIndex], lhllDevice, sizeof(uint32_t), objectCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    auto& objectTableBuffer = batcher.getObjectTable().getBuffer(frameIndex);
+    auto& drawCommandBuffer = batcher.getIndirectBuffer(frameIndex);
+    // the late pass starts from the same commands, with the instance counts still 0
+    if (occlusionCulled) {
+      auto& lateBuffer = lateCommandBuffers[frameIndex];
+      LhllBuffer::reserve(lateBuffer, lhllDevice, sizeof(VkDrawIndexedIndirectCommand), commandCount, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+      lateBuffer->writeToBuffer(drawCommandBuffer.getMappedMemory(), commandCount * sizeof(VkDrawIndexedIndirectCommand));
+      lateBuffer->flush();
+    }
+
+    reserveVisibility(frameInfo.commandBuffer, objectTableBuffer.getInstanceCount());
+    writeCullSet(cullDescriptorSets[frameIndex], objectTableBuffer, batcher.getInstanceBuffer(frameIndex), drawCommandBuffer, *visibleInstanceBuffers[frameIndex], frameIndex);
+
+    CullPushConstantData push{};
+    auto frustumPlanes = frameInfo.camera.getFrustumPlanes();
+    for (size_t i = 0; i < frustumPlanes.size(); i++) {
+      push.frustumPlanes[i] = frustumPlanes[i];
+    }
+    push.objectCount = objectCount;
+    push.occlusionCulled = occlusionCulled ? VK_TRUE : VK_FALSE;
+
+    cullPipeline->bind(frameInfo.commandBuffer);
+    vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout->getHandle(), 0, 1, &cullDescriptorSets[frameIndex], 0, nullptr);
+    vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout->getHandle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstantData), &push);
+    vkCmdDispatch(frameInfo.commandBuffer, (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    recordResultBarrier(frameInfo.commandBuffer);
+  }
+
+  void GpuCullSystem::cullOccluded(FrameInfo& frameInfo, LhllDrawBatcher& batcher) {
+    int frameIndex = frameInfo.frameIndex;
+    uint32_t objectCount = culledObjectCounts[frameIndex];
+    culledLateFrames[frameIndex] = 1;
+    if (objectCount == 0) return;
+
+    const auto& target = frameInfo.renderPassTarget;
+    assert(target.depthImageView != VK_NULL_HANDLE && "Occlusion culling needs the depth of the render pass target");
+    depthPyramid.build(frameInfo.commandBuffer, frameIndex, target.depthImageView, target.extent);
+
+    LhllBuffer::reserve(lateVisibleInstanceBuffers[frameIndex], lhllDevice, sizeof(uint32_t), objectCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    writeCullSet(lateCullDescriptorSets[frameIndex], batcher.getObjectTable().getBuffer(frameIndex), batcher.getInstanceBuffer(frameIndex), *lateCommandBuffers[frameIndex], *lateVisibleInstanceBuffers[frameIndex], frameIndex);
+    auto pyramidInfo = depthPyramid.descriptorInfo(frameIndex);
+    LhllDescriptorWriter(*pyramidSetLayout, *cullPool).writeImage(0, &pyramidInfo).overwrite(pyramidDescriptorSets[frameIndex]);
+
+    OcclusionPushConstantData push{};
+    push.projectionView = frameInfo.camera.getProjection() * frameInfo.camera.getView();
+    push.objectCount = objectCount;
+
+    std::array<VkDescriptorSet, 2> descriptorSets{lateCullDescriptorSets[frameIndex], pyramidDescriptorSets[frameIndex]};
+    occlusionPipeline->bind(frameInfo.commandBuffer);
+    vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, occlusionPipelineLayout->getHandle(), 0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+    vkCmdPushConstants(frameInfo.commandBuffer, occlusionPipelineLayout->getHandle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(OcclusionPushConstantData), &push);
+    vkCmdDispatch(frameInfo.commandBuffer, (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    recordResultBarrier(frameInfo.commandBuffer);
+  }
+}
@@ -0,0 +1,100 @@
+#ifndef GPU_CULL_SYSTEM_HPP
+#define GPU_CULL_SYSTEM_HPP
+
+#include "lhll_buffer.hpp"
+#include "lhll_compute_pipeline.hpp"
+#include "lhll_depth_pyramid.hpp"
+#include "lhll_descriptors.hpp"
+#include "lhll_device.hpp"
+#include "lhll_draw_batcher.hpp"
+#include "lhll_frame_info.hpp"
+#include "lhll_pipeline_layout.hpp"
+#include "lhll_pipeline_registry.hpp"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lhll {
+  // Frustum culls objects on the GPU. A compute pass tests each object's bounding sphere and appends
+  // the survivors to their draw's range of a visible instance buffer, counting them with atomics in the
+  // instanceCount of the draw's indirect command. With occlusion culling the first pass only keeps
+  // objects that were visible in the last frame. Once they are drawn, a depth pyramid is built from
+  // their depth and the second pass tests every object against it, appending the newly visible ones
+  // to a second set of draws and remembering the result for the next frame
+  class GpuCullSystem {
+  public:
+    GpuCullSystem(LhllDevice& device, LhllPipelineRegistry& pipelineRegistry);
+
+    GpuCullSystem(const GpuCullSystem&) = delete;
+    GpuCullSystem& operator=(const GpuCullSystem&) = delete;
+
+    // Counts what the culls of the frame slot's previous use kept into frameInfo.stats, the counts lag
+    // the frames in flight. Has to be called before the batcher writes the frame's indirect commands
+    void readBackResults(FrameInfo& frameInfo, LhllDrawBatcher& batcher);
+
+    // Records the cull of the batcher's draws and the barrier to the indirect draws reading its
+    // results, has to be outside a render pass. Every batch has to be indirect and the commands
+    // written with gpuCulled. With occlusionCulled the commands are also copied for the late pass
+    void cull(FrameInfo& frameInfo, LhllDrawBatcher& batcher, bool occlusionCulled);
+    // Builds the depth pyramid from frameInfo.renderPassTarget's depth after the render pass drawing
+    // the first cull's results ended, and records the second pass of the occlusion cull into the
+    // frame's late commands
+    void cullOccluded(FrameInfo& frameInfo, LhllDrawBatcher& batcher);
+
+    // instances of the batcher's draws that were kept, in the same ranges
+    LhllBuffer& getVisibleInstanceBuffer(int frameIndex) { return *visibleInstanceBuffers[frameIndex]; }
+    LhllBuffer& getLateVisibleInstanceBuffer(int frameIndex) { return *lateVisibleInstanceBuffers[frameIndex]; }
+    // the batcher's commands with the instance counts the occlusion cull filled in
+    LhllBuffer& getLateCommandBuffer(int frameIndex) { return *lateCommandBuffers[frameIndex]; }
+
+    void reloadShader(const std::string& filepath);
+
+  private:
+    void createDescriptorSets();
+    void createPipelineLayouts();
+    void writeCullInputs(int frameIndex, const LhllDrawBatcher& batcher);
+    void reserveVisibility(VkCommandBuffer commandBuffer, uint32_t objectTableSize);
+    void writeCullSet(VkDescriptorSet descriptorSet, LhllBuffer& objectTableBuffer, LhllBuffer& instanceBuffer, LhllBuffer& drawCommandBuffer, LhllBuffer& visibleInstanceBuffer, int frameIndex);
+    void recordResultBarrier(VkCommandBuffer commandBuffer);
+
+    LhllDevice& lhllDevice;
+    LhllPipelineRegistry& lhllPipelineRegistry;
+
+    std::unique_ptr<LhllDescriptorSetLayout> cullSetLayout;
+    std::unique_ptr<LhllDescriptorPool> cullPool;
+    std::vector<VkDescriptorSet> cullDescriptorSets;
+    std::unique_ptr<LhllPipelineLayout> pipelineLayout;
+    std::shared_ptr<LhllComputePipeline> cullPipeline;
+
+    // the late pass uses a second cull set per frame and one for the depth pyramid
+    std::unique_ptr<LhllDescriptorSetLayout> pyramidSetLayout;
+    std::vector<VkDescriptorSet> lateCullDescriptorSets;
+    std::vector<VkDescriptorSet> pyramidDescriptorSets;
+    std::unique_ptr<LhllPipelineLayout> occlusionPipelineLayout;
+    std::shared_ptr<LhllComputePipeline> occlusionPipeline;
+    LhllDepthPyramid depthPyramid;
+
+    std::vector<std::unique_ptr<LhllBuffer>> objectDrawBuffers;
+    std::vector<std::unique_ptr<LhllBuffer>> drawBoundsBuffers;
+    std::vector<std::unique_ptr<LhllBuffer>> visibleInstanceBuffers;
+    std::vector<std::unique_ptr<LhllBuffer>> lateVisibleInstanceBuffers;
+    std::vector<std::unique_ptr<LhllBuffer>> lateCommandBuffers;
+    // what the first cull of each frame was given, the late pass tests the same objects
+    std::vector<uint32_t> culledObjectCounts;
+    std::vector<uint32_t> culledCommandCounts;
+    // whether the late pass was culled too
+    std::vector<uint8_t> culledLateFrames;
+
+    // the draw of each object and the model space bounding sphere of each draw, rebuilt every frame
+    std::vector<uint32_t> objectDrawIndices;
+    std::vector<glm::vec4> drawBounds;
+
+    // One entry per object table slot, shared by all frames since each frame's first pass reads what
+    // the last frame's second pass wrote. Replaced buffers go to the device's deletion queue
+    std::unique_ptr<LhllBuffer> visibilityBuffer;
+  };
+}
+
+#endif
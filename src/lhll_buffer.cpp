@@ -7,12 +7,18 @@
 
 #include "lhll_buffer.hpp"
 
+#include "lhll_deletion_queue.hpp"
+
 // std
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstring>
 
 namespace lhll {
 
+static std::atomic<uint64_t> nextBufferGeneration{1};
+
 /**
  * Returns the minimum instance size required to be compatible with devices minOffsetAlignment
  *
@@ -40,7 +46,8 @@ LhllBuffer::LhllBuffer(
       instanceSize{instanceSize},
       instanceCount{instanceCount},
       usageFlags{usageFlags},
-      memoryPropertyFlags{memoryPropertyFlags} {
+      memoryPropertyFlags{memoryPropertyFlags},
+      generation{nextBufferGeneration++} {
   alignmentSize = getAlignment(instanceSize, minOffsetAlignment);
   bufferSize = alignmentSize * instanceCount;
   device.createBuffer(bufferSize, usageFlags, memoryPropertyFlags, buffer, memory);
@@ -48,8 +55,51 @@ LhllBuffer::LhllBuffer(
 
 LhllBuffer::~LhllBuffer() {
   unmap();
-  vkDestroyBuffer(lhllDevice.device(), buffer, nullptr);
-  vkFreeMemory(lhllDevice.device(), memory, nullptr);
+  // frames in flight may still read it, replacing a buffer never has to wait for the device
+  VkDevice device = lhllDevice.device();
+  VkBuffer retiredBuffer = buffer;
+  VkDeviceMemory retiredMemory = memory;
+  lhllDevice.deletionQueue().retire([device, retiredBuffer, retiredMemory]() {
+    vkDestroyBuffer(device, retiredBuffer, nullptr);
+    vkFreeMemory(device, retiredMemory, nullptr);
+  });
+}
+
+/**
+ * Makes sure buffer holds at least instanceCount instances, replacing it with one at least twice as
+ * large when it does not. Host visible buffers are returned mapped. The old buffer is retired to the
+ * device's deletion queue, frames in flight can still use it
+ *
+ * @param buffer The buffer to grow, may be null
+ * @param instanceCount The number of instances needed
+ *
+ * @return true when the buffer was replaced and descriptors referencing it need to be rewritten
+ */
+bool LhllBuffer::reserve(
+    std::unique_ptr<LhllBuffer>& buffer,
+    LhllDevice& device,
+    VkDeviceSize instanceSize,
+    uint32_t instanceCount,
+    VkBufferUsageFlags usageFlags,
+    VkMemoryPropertyFlags memoryPropertyFlags) {
+  if (buffer != nullptr && instanceCount <= buffer->getInstanceCount()) {
+    return false;
+  }
+
+  uint32_t capacity = instanceCount;
+  if (buffer != nullptr) {
+    capacity = std::max(instanceCount, buffer->getInstanceCount() * 2);
+  }
+  buffer = std::make_unique<LhllBuffer>(
+      device,
+      instanceSize,
+      std::max(capacity, 1u),
+      usageFlags,
+      memoryPropertyFlags);
+  if (memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    buffer->map();
+  }
+  return true;
 }
 
 /**
@@ -3,6 +3,9 @@
 
 #include "lhll_device.hpp"
 
+// std
+#include <memory>
+
 namespace lhll {
 
 class LhllBuffer {
@@ -19,6 +22,14 @@ class LhllBuffer {
   LhllBuffer(const LhllBuffer&) = delete;
   LhllBuffer& operator=(const LhllBuffer&) = delete;
 
+  static bool reserve(
+      std::unique_ptr<LhllBuffer>& buffer,
+      LhllDevice& device,
+      VkDeviceSize instanceSize,
+      uint32_t instanceCount,
+      VkBufferUsageFlags usageFlags,
+      VkMemoryPropertyFlags memoryPropertyFlags);
+
   VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
   void unmap();
 
@@ -40,6 +51,9 @@ class LhllBuffer {
   VkBufferUsageFlags getUsageFlags() const { return usageFlags; }
   VkMemoryPropertyFlags getMemoryPropertyFlags() const { return memoryPropertyFlags; }
   VkDeviceSize getBufferSize() const { return bufferSize; }
+  // unique per buffer, unlike the handle a buffer created after this one was destroyed can get.
+  // Tells whether reserve replaced it since a descriptor or command buffer referenced it
+  uint64_t getGeneration() const { return generation; }
 
  private:
   static VkDeviceSize getAlignment(VkDeviceSize instanceSize, VkDeviceSize minOffsetAlignment);
@@ -55,6 +69,7 @@ class LhllBuffer {
   VkDeviceSize alignmentSize;
   VkBufferUsageFlags usageFlags;
   VkMemoryPropertyFlags memoryPropertyFlags;
+  uint64_t generation;
 };
 
 }  // namespace lhll
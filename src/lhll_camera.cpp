@@ -74,4 +74,25 @@ namespace lhll {
     viewMatrix[3][2] = -glm::dot(w, position);
   }
 
+
+  // Gribb/Hartmann plane extraction, near is row 2 alone since depth is mapped to [0, 1]
+  std::array<glm::vec4, 6> LhllCamera::getFrustumPlanes() const {
+    glm::mat4 projectionView = projectionMatrix * viewMatrix;
+    auto row = [&projectionView](int i) {
+      return glm::vec4{projectionView[0][i], projectionView[1][i], projectionView[2][i], projectionView[3][i]};
+    };
+
+    std::array<glm::vec4, 6> planes{
+      row(3) + row(0),
+      row(3) - row(0),
+      row(3) + row(1),
+      row(3) - row(1),
+      row(2),
+      row(3) - row(2)};
+
+    for (auto& plane : planes) {
+      plane /= glm::length(glm::vec3{plane});
+    }
+    return planes;
+  }
 }
@@ -5,6 +5,8 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include <array>
+
 namespace lhll {
   class LhllCamera {
   public:
@@ -21,6 +23,10 @@ namespace lhll {
     const glm::mat4& getProjection() const { return projectionMatrix; }
     const glm::mat4& getView() const { return viewMatrix; }
 
+    // World space planes of getProjection() * getView() in the order left, right, bottom, top, near,
+    // far. Normalized and pointing inwards, a point p is inside when dot(plane.xyz, p) + plane.w >= 0
+    std::array<glm::vec4, 6> getFrustumPlanes() const;
+
   private:
     glm::mat4 projectionMatrix{1.0f};
     glm::mat4 viewMatrix{1.0f};
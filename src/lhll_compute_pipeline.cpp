@@ -0,0 +1,40 @@
+#include "lhll_compute_pipeline.hpp"
+
+#include "lhll_deletion_queue.hpp"
+
+#include <stdexcept>
+
+namespace lhll {
+  LhllComputePipeline::LhllComputePipeline(LhllDevice& device, VkShaderModule computeShaderModule, VkPipelineLayout pipelineLayout) : lhllDevice{device} {
+    VkPipelineShaderStageCreateInfo stageInfo{};
+    stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    stageInfo.module = computeShaderModule;
+    stageInfo.pName = "main";
+    stageInfo.flags = 0;
+    stageInfo.pNext = nullptr;
+    stageInfo.pSpecializationInfo = nullptr;
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = stageInfo;
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(lhllDevice.device(), lhllDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &computePipeline) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create compute pipeline");
+    }
+  }
+
+  LhllComputePipeline::~LhllComputePipeline() {
+    // command buffers of frames in flight may still bind it
+    VkDevice device = lhllDevice.device();
+    VkPipeline pipeline = computePipeline;
+    lhllDevice.deletionQueue().retire([device, pipeline]() { vkDestroyPipeline(device, pipeline, nullptr); });
+  }
+
+  void LhllComputePipeline::bind(VkCommandBuffer commandBuffer) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+  }
+}
@@ -0,0 +1,25 @@
+#ifndef LHLL_COMPUTE_PIPELINE_HPP
+#define LHLL_COMPUTE_PIPELINE_HPP
+
+#include "lhll_device.hpp"
+
+namespace lhll {
+  class LhllComputePipeline {
+  public:
+    // the module is only used during creation and can be destroyed right after
+    LhllComputePipeline(LhllDevice& device, VkShaderModule computeShaderModule, VkPipelineLayout pipelineLayout);
+    ~LhllComputePipeline();
+
+    LhllComputePipeline(const LhllComputePipeline&) = delete;
+    LhllComputePipeline& operator=(const LhllComputePipeline&) = delete;
+
+    void bind(VkCommandBuffer commandBuffer);
+    VkPipeline getHandle() const { return computePipeline; }
+
+  private:
+    LhllDevice& lhllDevice;
+    VkPipeline computePipeline;
+  };
+}
+
+#endif
@@ -0,0 +1,43 @@
+#include "lhll_deletion_queue.hpp"
+
+namespace lhll {
+  LhllDeletionQueue::LhllDeletionQueue(LhllTimeline& timeline) : timeline{timeline} {}
+
+  LhllDeletionQueue::~LhllDeletionQueue() {
+    flush();
+  }
+
+  void LhllDeletionQueue::retire(std::function<void()> destroy) {
+    std::lock_guard<std::mutex> lock{mutex};
+    entries.emplace_back(timeline.getSubmittedValue() + 1, std::move(destroy));
+  }
+
+  void LhllDeletionQueue::release() {
+    while (true) {
+      std::function<void()> destroy;
+      {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (entries.empty()) return;
+        uint64_t frame = entries.front().first;
+        if (frame > timeline.getSubmittedValue() || !timeline.isComplete(frame)) return;
+        destroy = std::move(entries.front().second);
+        entries.pop_front();
+      }
+      // without the lock, destroying can retire more
+      destroy();
+    }
+  }
+
+  void LhllDeletionQueue::flush() {
+    while (true) {
+      std::function<void()> destroy;
+      {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (entries.empty()) return;
+        destroy = std::move(entries.front().second);
+        entries.pop_front();
+      }
+      destroy();
+    }
+  }
+}
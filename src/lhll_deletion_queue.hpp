@@ -0,0 +1,40 @@
+#ifndef LHLL_DELETION_QUEUE_HPP
+#define LHLL_DELETION_QUEUE_HPP
+
+#include "lhll_timeline.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace lhll {
+  // Vulkan objects that frames on the GPU may still use, destroyed once the frame being recorded when
+  // they were retired finished. Frames are the graphics timeline's values, the one being recorded is
+  // the one after the last submitted, so anything recorded before retire is covered
+  class LhllDeletionQueue {
+  public:
+    LhllDeletionQueue(LhllTimeline& timeline);
+    // runs everything left, the device has to be idle
+    ~LhllDeletionQueue();
+
+    LhllDeletionQueue(const LhllDeletionQueue&) = delete;
+    LhllDeletionQueue& operator=(const LhllDeletionQueue&) = delete;
+
+    // can be called from any thread, destroy runs on the thread recording frames
+    void retire(std::function<void()> destroy);
+    // runs what completed frames no longer use, LhllRenderer calls it when a frame begins
+    void release();
+    // runs everything, the device has to be idle
+    void flush();
+
+  private:
+    LhllTimeline& timeline;
+    std::mutex mutex;
+    // in retire order, so their frames never decrease
+    std::deque<std::pair<uint64_t, std::function<void()>>> entries;
+  };
+}
+
+#endif
@@ -0,0 +1,199 @@
+#include "lhll_depth_pyramid.hpp"
+
+#include "lhll_swap_chain.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace lhll {
+  static const std::string reduceShaderPath = "shaders/depth_pyramid.comp.spv";
+  // local_size_x and local_size_y of depth_pyramid.comp
+  static constexpr uint32_t REDUCE_GROUP_SIZE = 8;
+
+  LhllDepthPyramid::LhllDepthPyramid(LhllDevice& device, LhllPipelineRegistry& pipelineRegistry) : lhllDevice{device}, lhllPipelineRegistry{pipelineRegistry} {
+    createSampler();
+    createDescriptorSets();
+    createPipelineLayout();
+    reducePipeline = lhllPipelineRegistry.getComputePipeline(reduceShaderPath, *pipelineLayout);
+  }
+
+  LhllDepthPyramid::~LhllDepthPyramid() {
+    for (auto& pyramid : pyramids) {
+      destroyPyramid(pyramid);
+    }
+    vkDestroySampler(lhllDevice.device(), sampler, nullptr);
+  }
+
+  // the shaders only use texelFetch, the sampler just has to allow every level
+  void LhllDepthPyramid::createSampler() {
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(lhllDevice.device(), &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid sampler!");
+    }
+  }
+
+  void LhllDepthPyramid::createDescriptorSets() {
+    // binding 0 is the level below, binding 1 the level written
+    reduceSetLayout = LhllDescriptorSetLayout::Builder(lhllDevice)
+                          .addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)
+                          .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)
+                          .build();
+    uint32_t setCount = MAX_LEVELS * LhllSwapChain::MAX_FRAMES_IN_FLIGHT;
+    reducePool = LhllDescriptorPool::Builder(lhllDevice)
+                     .setMaxSets(setCount)
+                     .addPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount)
+                     .addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount)
+                     .build();
+
+    pyramids.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (auto& pyramid : pyramids) {
+      pyramid.descriptorSets.resize(MAX_LEVELS);
+      for (auto& descriptorSet : pyramid.descriptorSets) {
+        if (!reducePool->allocateDescriptorSet(reduceSetLayout->getDescriptorSetLayout(), descriptorSet)) {
+          throw std::runtime_error("failed to allocate depth pyramid descriptor set");
+        }
+      }
+    }
+  }
+
+  void LhllDepthPyramid::createPipelineLayout() {
+    pipelineLayout = std::make_unique<LhllPipelineLayout>(lhllDevice, std::vector<VkDescriptorSetLayout>{reduceSetLayout->getDescriptorSetLayout()});
+  }
+
+  void LhllDepthPyramid::createPyramid(Pyramid& pyramid, VkExtent2D depthExtent) {
+    pyramid.extent = {std::max(1u, (depthExtent.width + 1) / 2), std::max(1u, (depthExtent.height + 1) / 2)};
+    pyramid.levelCount = 1;
+    for (uint32_t size = std::max(pyramid.extent.width, pyramid.extent.height); size > 1 && pyramid.levelCount < MAX_LEVELS; size /= 2) {
+      pyramid.levelCount++;
+    }
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = pyramid.extent.width;
+    imageInfo.extent.height = pyramid.extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = pyramid.levelCount;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    lhllDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pyramid.image, pyramid.memory);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = pyramid.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R32_SFLOAT;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = pyramid.levelCount;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(lhllDevice.device(), &viewInfo, nullptr, &pyramid.view) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create depth pyramid image view!");
+    }
+
+    pyramid.levelViews.resize(pyramid.levelCount);
+    for (uint32_t level = 0; level < pyramid.levelCount; level++) {
+      viewInfo.subresourceRange.baseMipLevel = level;
+      viewInfo.subresourceRange.levelCount = 1;
+      if (vkCreateImageView(lhllDevice.device(), &viewInfo, nullptr, &pyramid.levelViews[level]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid level view!");
+      }
+    }
+
+    // level 0 reads the depth attachment, which changes with the swap chain image, so build writes it
+    for (uint32_t level = 1; level < pyramid.levelCount; level++) {
+      VkDescriptorImageInfo sourceInfo{sampler, pyramid.levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL};
+      VkDescriptorImageInfo destinationInfo{VK_NULL_HANDLE, pyramid.levelViews[level], VK_IMAGE_LAYOUT_GENERAL};
+      LhllDescriptorWriter(*reduceSetLayout, *reducePool).writeImage(0, &sourceInfo).writeImage(1, &destinationInfo).overwrite(pyramid.descriptorSets[level]);
+    }
+  }
+
+  void LhllDepthPyramid::destroyPyramid(Pyramid& pyramid) {
+    for (auto levelView : pyramid.levelViews) {
+      vkDestroyImageView(lhllDevice.device(), levelView, nullptr);
+    }
+    pyramid.levelViews.clear();
+    vkDestroyImageView(lhllDevice.device(), pyramid.view, nullptr);
+    vkDestroyImage(lhllDevice.device(), pyramid.image, nullptr);
+    vkFreeMemory(lhllDevice.device(), pyramid.memory, nullptr);
+    pyramid.view = VK_NULL_HANDLE;
+    pyramid.image = VK_NULL_HANDLE;
+    pyramid.memory = VK_NULL_HANDLE;
+    pyramid.levelCount = 0;
+  }
+
+  VkDescriptorImageInfo LhllDepthPyramid::descriptorInfo(int frameIndex) const {
+    return VkDescriptorImageInfo{sampler, pyramids[frameIndex].view, VK_IMAGE_LAYOUT_GENERAL};
+  }
+
+  void LhllDepthPyramid::reloadShader(const std::string& filepath) {
+    if (filepath != reduceShaderPath) return;
+
+    try {
+      auto pipeline = lhllPipelineRegistry.getComputePipeline(reduceShaderPath, *pipelineLayout);
+      reducePipeline = std::move(pipeline);
+    }
+    catch (const std::exception& e) {
+      std::cerr << "Depth pyramid pipeline creation failed, keeping the previous one: " << e.what() << '\n';
+    }
+  }
+
+  void LhllDepthPyramid::build(VkCommandBuffer commandBuffer, int frameIndex, VkImageView depthImageView, VkExtent2D depthExtent) {
+    // the slot's previous frame was waited on, nothing reads its pyramid anymore
+    auto& pyramid = pyramids[frameIndex];
+    VkExtent2D extent{std::max(1u, (depthExtent.width + 1) / 2), std::max(1u, (depthExtent.height + 1) / 2)};
+    if (pyramid.image == VK_NULL_HANDLE || pyramid.extent.width != extent.width || pyramid.extent.height != extent.height) {
+      if (pyramid.image != VK_NULL_HANDLE) destroyPyramid(pyramid);
+      createPyramid(pyramid, depthExtent);
+    }
+
+    VkDescriptorImageInfo depthInfo{sampler, depthImageView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo levelInfo{VK_NULL_HANDLE, pyramid.levelViews[0], VK_IMAGE_LAYOUT_GENERAL};
+    LhllDescriptorWriter(*reduceSetLayout, *reducePool).writeImage(0, &depthInfo).writeImage(1, &levelInfo).overwrite(pyramid.descriptorSets[0]);
+
+    // every texel is written again, so the previous contents can be discarded
+    VkImageMemoryBarrier layoutBarrier{};
+    layoutBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    layoutBarrier.srcAccessMask = 0;
+    layoutBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    layoutBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    layoutBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    layoutBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    layoutBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    layoutBarrier.image = pyramid.image;
+    layoutBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.levelCount, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &layoutBarrier);
+
+    // each level reads the one written before it, and the last one is read by the occlusion cull
+    VkMemoryBarrier levelBarrier{};
+    levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    reducePipeline->bind(commandBuffer);
+    VkExtent2D levelExtent = pyramid.extent;
+    for (uint32_t level = 0; level < pyramid.levelCount; level++) {
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout->getHandle(), 0, 1, &pyramid.descriptorSets[level], 0, nullptr);
+      vkCmdDispatch(commandBuffer, (levelExtent.width + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, (levelExtent.height + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE, 1);
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+      levelExtent = {std::max(1u, levelExtent.width / 2), std::max(1u, levelExtent.height / 2)};
+    }
+  }
+}
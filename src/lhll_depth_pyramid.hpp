@@ -0,0 +1,73 @@
+#ifndef LHLL_DEPTH_PYRAMID_HPP
+#define LHLL_DEPTH_PYRAMID_HPP
+
+#include "lhll_compute_pipeline.hpp"
+#include "lhll_descriptors.hpp"
+#include "lhll_device.hpp"
+#include "lhll_pipeline_layout.hpp"
+#include "lhll_pipeline_registry.hpp"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lhll {
+  // Hierarchical depth buffer built by compute from a depth attachment. Level 0 has half the depth
+  // resolution and every texel of a level holds the farthest depth of the texels it covers in the
+  // level below, so a bounding rectangle is occluded when its nearest depth is behind all the texels
+  // it overlaps. Every frame in flight has its own pyramid, kept in VK_IMAGE_LAYOUT_GENERAL
+  class LhllDepthPyramid {
+  public:
+    static constexpr uint32_t MAX_LEVELS = 16;
+
+    LhllDepthPyramid(LhllDevice& device, LhllPipelineRegistry& pipelineRegistry);
+    ~LhllDepthPyramid();
+
+    LhllDepthPyramid(const LhllDepthPyramid&) = delete;
+    LhllDepthPyramid& operator=(const LhllDepthPyramid&) = delete;
+
+    // Records the reduction of depthImageView, which has to be in
+    // VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL with its writes visible to compute, and the
+    // barrier to compute shaders reading the pyramid. Has to be outside a render pass
+    void build(VkCommandBuffer commandBuffer, int frameIndex, VkImageView depthImageView, VkExtent2D depthExtent);
+
+    // all levels, for texelFetch
+    VkDescriptorImageInfo descriptorInfo(int frameIndex) const;
+    VkExtent2D getExtent(int frameIndex) const { return pyramids[frameIndex].extent; }
+    uint32_t getLevelCount(int frameIndex) const { return pyramids[frameIndex].levelCount; }
+
+    void reloadShader(const std::string& filepath);
+
+  private:
+    struct Pyramid {
+      VkImage image = VK_NULL_HANDLE;
+      VkDeviceMemory memory = VK_NULL_HANDLE;
+      VkImageView view = VK_NULL_HANDLE;
+      std::vector<VkImageView> levelViews;
+      // one per level, reading the level below or the depth attachment
+      std::vector<VkDescriptorSet> descriptorSets;
+      VkExtent2D extent{};
+      uint32_t levelCount = 0;
+    };
+
+    void createSampler();
+    void createDescriptorSets();
+    void createPipelineLayout();
+    void createPyramid(Pyramid& pyramid, VkExtent2D depthExtent);
+    void destroyPyramid(Pyramid& pyramid);
+
+    LhllDevice& lhllDevice;
+    LhllPipelineRegistry& lhllPipelineRegistry;
+
+    VkSampler sampler;
+    std::unique_ptr<LhllDescriptorSetLayout> reduceSetLayout;
+    std::unique_ptr<LhllDescriptorPool> reducePool;
+    std::unique_ptr<LhllPipelineLayout> pipelineLayout;
+    std::shared_ptr<LhllComputePipeline> reducePipeline;
+
+    std::vector<Pyramid> pyramids;
+  };
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include "lhll_descriptors.hpp"
 
 // std
+#include <atomic>
 #include <cassert>
 #include <stdexcept>
 
@@ -132,8 +133,10 @@ void LhllDescriptorPool::resetPool() {
 
 // *************** Descriptor Writer *********************
 
+static std::atomic<uint64_t> nextWriterGeneration{1};
+
 LhllDescriptorWriter::LhllDescriptorWriter(LhllDescriptorSetLayout &setLayout, LhllDescriptorPool &pool)
-    : setLayout{setLayout}, pool{pool} {}
+    : setLayout{setLayout}, pool{pool}, generation{nextWriterGeneration++} {}
 
 LhllDescriptorWriter &LhllDescriptorWriter::writeBuffer(
     uint32_t binding, VkDescriptorBufferInfo *bufferInfo) {
@@ -95,10 +95,15 @@ class LhllDescriptorWriter {
   bool build(VkDescriptorSet &set);
   void overwrite(VkDescriptorSet &set);
 
+  // unique per writer, identifies what a set was last written with without comparing its handle,
+  // which a set allocated after another was freed can reuse
+  uint64_t getGeneration() const { return generation; }
+
  private:
   LhllDescriptorSetLayout &setLayout;
   LhllDescriptorPool &pool;
   std::vector<VkWriteDescriptorSet> writes;
+  uint64_t generation;
 };
 
 }  // namespace lhll
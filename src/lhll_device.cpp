@@ -1,7 +1,16 @@
+// set by CMake to a file in the build directory
+#ifndef LHLL_PIPELINE_CACHE_FILE
+#define LHLL_PIPELINE_CACHE_FILE "pipeline_cache.bin"
+#endif
+
 #include "lhll_device.hpp"
+#include "lhll_deletion_queue.hpp"
+#include "lhll_timeline.hpp"
 
 // std headers
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 #include <set>
 #include <unordered_set>
@@ -47,16 +56,36 @@ void DestroyDebugUtilsMessengerEXT(
 }
 
 // class member functions
-LhllDevice::LhllDevice(LhllWindow &window) : window{window} {
+LhllDevice::LhllDevice(LhllWindow &window) : window{&window} {
   createInstance();
   setupDebugMessenger();
   createSurface();
   pickPhysicalDevice();
   createLogicalDevice();
   createCommandPool();
+  createPipelineCache();
+  graphicsTimeline_ = std::make_unique<LhllTimeline>(*this);
+  deletionQueue_ = std::make_unique<LhllDeletionQueue>(*graphicsTimeline_);
+}
+
+LhllDevice::LhllDevice() {
+  createInstance();
+  setupDebugMessenger();
+  pickPhysicalDevice();
+  createLogicalDevice();
+  createCommandPool();
+  createPipelineCache();
+  graphicsTimeline_ = std::make_unique<LhllTimeline>(*this);
+  deletionQueue_ = std::make_unique<LhllDeletionQueue>(*graphicsTimeline_);
 }
 
 LhllDevice::~LhllDevice() {
+  // what was retired last may still be in use
+  vkDeviceWaitIdle(device_);
+  deletionQueue_.reset();
+  graphicsTimeline_.reset();
+  savePipelineCache();
+  vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
   vkDestroyCommandPool(device_, commandPool, nullptr);
   vkDestroyDevice(device_, nullptr);
 
@@ -64,7 +93,9 @@ LhllDevice::~LhllDevice() {
     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
   }
 
-  vkDestroySurfaceKHR(instance, surface_, nullptr);
+  if (surface_ != VK_NULL_HANDLE) {
+    vkDestroySurfaceKHR(instance, surface_, nullptr);
+  }
   vkDestroyInstance(instance, nullptr);
 }
 
@@ -79,7 +110,7 @@ void LhllDevice::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  appInfo.apiVersion = VK_API_VERSION_1_1;
 
   VkInstanceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -131,6 +162,47 @@ void LhllDevice::pickPhysicalDevice() {
 
   vkGetPhysicalDeviceProperties(physicalDevice, &properties);
   std::cout << "physical device: " << properties.deviceName << std::endl;
+
+  queryOptionalFeatures();
+}
+
+void LhllDevice::queryOptionalFeatures() {
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+  optionalFeatures_.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+  optionalFeatures_.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+
+  std::cout << "multi draw indirect: " << optionalFeatures_.multiDrawIndirect
+            << ", draw indirect first instance: " << optionalFeatures_.drawIndirectFirstInstance << std::endl;
+
+  // vkGetPhysicalDeviceFeatures2 is core since 1.1
+  if (properties.apiVersion < VK_API_VERSION_1_1) {
+    return;
+  }
+
+  VkPhysicalDeviceExtendedDynamicState2FeaturesEXT dynamicState2Features{};
+  dynamicState2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicStateFeatures{};
+  dynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+  dynamicStateFeatures.pNext = &dynamicState2Features;
+
+  VkPhysicalDeviceFeatures2 features{};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &dynamicStateFeatures;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+  optionalFeatures_.extendedDynamicState =
+      isDeviceExtensionAvailable(physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME) &&
+      dynamicStateFeatures.extendedDynamicState;
+  // state2 is only used on top of state1
+  optionalFeatures_.extendedDynamicState2 =
+      optionalFeatures_.extendedDynamicState &&
+      isDeviceExtensionAvailable(physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME) &&
+      dynamicState2Features.extendedDynamicState2;
+
+  std::cout << "extended dynamic state: " << optionalFeatures_.extendedDynamicState
+            << ", extended dynamic state 2: " << optionalFeatures_.extendedDynamicState2 << std::endl;
 }
 
 void LhllDevice::createLogicalDevice() {
@@ -151,6 +223,8 @@ void LhllDevice::createLogicalDevice() {
 
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
+  deviceFeatures.multiDrawIndirect = optionalFeatures_.multiDrawIndirect;
+  deviceFeatures.drawIndirectFirstInstance = optionalFeatures_.drawIndirectFirstInstance;
 
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -159,8 +233,38 @@ void LhllDevice::createLogicalDevice() {
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
   createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+  std::vector<const char *> enabledExtensions = getRequiredDeviceExtensions();
+  void *featureChain = nullptr;
+
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicStateFeatures{};
+  dynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+  if (optionalFeatures_.extendedDynamicState) {
+    enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+    dynamicStateFeatures.extendedDynamicState = VK_TRUE;
+    dynamicStateFeatures.pNext = featureChain;
+    featureChain = &dynamicStateFeatures;
+  }
+
+  VkPhysicalDeviceExtendedDynamicState2FeaturesEXT dynamicState2Features{};
+  dynamicState2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+  if (optionalFeatures_.extendedDynamicState2) {
+    enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+    dynamicState2Features.extendedDynamicState2 = VK_TRUE;
+    dynamicState2Features.pNext = featureChain;
+    featureChain = &dynamicState2Features;
+  }
+
+  // the extension is in getRequiredDeviceExtensions
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures{};
+  timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+  timelineSemaphoreFeatures.pNext = featureChain;
+  featureChain = &timelineSemaphoreFeatures;
+
+  createInfo.pNext = featureChain;
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+  createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
   // might not really be necessary anymore because device specific validation layers
   // have been deprecated
@@ -177,6 +281,39 @@ void LhllDevice::createLogicalDevice() {
 
   vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
   vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+
+  loadDeviceFunctions();
+}
+
+void LhllDevice::loadDeviceFunctions() {
+  timelineSemaphore_.wait = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+      vkGetDeviceProcAddr(device_, "vkWaitSemaphoresKHR"));
+  timelineSemaphore_.getCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+      vkGetDeviceProcAddr(device_, "vkGetSemaphoreCounterValueKHR"));
+
+  if (optionalFeatures_.extendedDynamicState) {
+    auto &functions = extendedDynamicState_;
+    functions.setCullMode = reinterpret_cast<PFN_vkCmdSetCullModeEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetCullModeEXT"));
+    functions.setFrontFace = reinterpret_cast<PFN_vkCmdSetFrontFaceEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetFrontFaceEXT"));
+    functions.setPrimitiveTopology = reinterpret_cast<PFN_vkCmdSetPrimitiveTopologyEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetPrimitiveTopologyEXT"));
+    functions.setDepthTestEnable = reinterpret_cast<PFN_vkCmdSetDepthTestEnableEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetDepthTestEnableEXT"));
+    functions.setDepthWriteEnable = reinterpret_cast<PFN_vkCmdSetDepthWriteEnableEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetDepthWriteEnableEXT"));
+    functions.setDepthCompareOp = reinterpret_cast<PFN_vkCmdSetDepthCompareOpEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetDepthCompareOpEXT"));
+  }
+
+  if (optionalFeatures_.extendedDynamicState2) {
+    auto &functions = extendedDynamicState_;
+    functions.setDepthBiasEnable = reinterpret_cast<PFN_vkCmdSetDepthBiasEnableEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetDepthBiasEnableEXT"));
+    functions.setPrimitiveRestartEnable = reinterpret_cast<PFN_vkCmdSetPrimitiveRestartEnableEXT>(
+        vkGetDeviceProcAddr(device_, "vkCmdSetPrimitiveRestartEnableEXT"));
+  }
 }
 
 void LhllDevice::createCommandPool() {
@@ -193,15 +330,98 @@ void LhllDevice::createCommandPool() {
   }
 }
 
-void LhllDevice::createSurface() { window.createWindowSurface(instance, &surface_); }
+void LhllDevice::createPipelineCache() {
+  const std::string cachePath = LHLL_PIPELINE_CACHE_FILE;
+  std::vector<char> cacheData;
+  std::ifstream file{cachePath, std::ios::ate | std::ios::binary};
+  if (file.is_open()) {
+    cacheData.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(cacheData.data(), cacheData.size());
+    file.close();
+
+    if (!isPipelineCacheCompatible(cacheData)) {
+      std::cout << "pipeline cache: discarding incompatible " << cachePath << std::endl;
+      cacheData.clear();
+    }
+  }
+
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = cacheData.size();
+  createInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+  if (vkCreatePipelineCache(device_, &createInfo, nullptr, &pipelineCache_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create pipeline cache!");
+  }
+
+  pipelineCacheWarm = !cacheData.empty();
+}
+
+// The header layout is fixed by the spec (VkPipelineCacheHeaderVersionOne), a cache written by a
+// different driver or GPU must not be handed back to vkCreatePipelineCache
+bool LhllDevice::isPipelineCacheCompatible(const std::vector<char> &cacheData) {
+  const size_t headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+  if (cacheData.size() < headerSize) {
+    return false;
+  }
+
+  uint32_t header[4];
+  std::memcpy(header, cacheData.data(), sizeof(header));
+  uint8_t uuid[VK_UUID_SIZE];
+  std::memcpy(uuid, cacheData.data() + sizeof(header), VK_UUID_SIZE);
+
+  return header[0] >= headerSize && header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header[2] == properties.vendorID && header[3] == properties.deviceID &&
+         std::memcmp(uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void LhllDevice::savePipelineCache() {
+  const std::string cachePath = LHLL_PIPELINE_CACHE_FILE;
+  size_t dataSize = 0;
+  if (vkGetPipelineCacheData(device_, pipelineCache_, &dataSize, nullptr) != VK_SUCCESS ||
+      dataSize == 0) {
+    return;
+  }
+  std::vector<char> cacheData(dataSize);
+  if (vkGetPipelineCacheData(device_, pipelineCache_, &dataSize, cacheData.data()) != VK_SUCCESS) {
+    return;
+  }
+
+  // write next to the real file and rename over it, so a crash mid-write never leaves a torn cache
+  const std::string tmpPath = cachePath + ".tmp";
+  std::ofstream file{tmpPath, std::ios::binary | std::ios::trunc};
+  if (!file.is_open()) {
+    std::cerr << "pipeline cache: failed to open " << tmpPath << std::endl;
+    return;
+  }
+  file.write(cacheData.data(), dataSize);
+  file.close();
+  if (file.fail()) {
+    std::remove(tmpPath.c_str());
+    return;
+  }
+
+  if (std::rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+    // rename does not replace an existing file on windows
+    std::remove(cachePath.c_str());
+    if (std::rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+      std::cerr << "pipeline cache: failed to write " << cachePath << std::endl;
+      std::remove(tmpPath.c_str());
+    }
+  }
+}
+
+void LhllDevice::createSurface() { window->createWindowSurface(instance, &surface_); }
 
 bool LhllDevice::isDeviceSuitable(VkPhysicalDevice device) {
   QueueFamilyIndices indices = findQueueFamilies(device);
 
   bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-  bool swapChainAdequate = false;
-  if (extensionsSupported) {
+  // nothing is presented without a window
+  bool swapChainAdequate = isHeadless();
+  if (extensionsSupported && !isHeadless()) {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
     swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
   }
@@ -209,8 +429,23 @@ bool LhllDevice::isDeviceSuitable(VkPhysicalDevice device) {
   VkPhysicalDeviceFeatures supportedFeatures;
   vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
+  // frames are tracked with a timeline semaphore, vkGetPhysicalDeviceFeatures2 is core since 1.1
+  bool timelineSemaphoreSupported = false;
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(device, &deviceProperties);
+  if (extensionsSupported && deviceProperties.apiVersion >= VK_API_VERSION_1_1) {
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures{};
+    timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &timelineSemaphoreFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    timelineSemaphoreSupported = timelineSemaphoreFeatures.timelineSemaphore;
+  }
+
   return indices.isComplete() && extensionsSupported && swapChainAdequate &&
-         supportedFeatures.samplerAnisotropy;
+         supportedFeatures.samplerAnisotropy && timelineSemaphoreSupported;
 }
 
 void LhllDevice::populateDebugMessengerCreateInfo(
@@ -261,11 +496,14 @@ bool LhllDevice::checkValidationLayerSupport() {
 }
 
 std::vector<const char *> LhllDevice::getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-  std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  std::vector<const char *> extensions;
+  // glfw is not initialized without a window
+  if (!isHeadless()) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions;
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enableValidationLayers) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -308,6 +546,7 @@ bool LhllDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
       &extensionCount,
       availableExtensions.data());
 
+  auto deviceExtensions = getRequiredDeviceExtensions();
   std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
   for (const auto &extension : availableExtensions) {
@@ -317,6 +556,33 @@ bool LhllDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+std::vector<const char *> LhllDevice::getRequiredDeviceExtensions() {
+  std::vector<const char *> extensions = deviceExtensions;
+  if (!isHeadless()) {
+    extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  }
+  return extensions;
+}
+
+bool LhllDevice::isDeviceExtensionAvailable(VkPhysicalDevice device, const char *extensionName) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(
+      device,
+      nullptr,
+      &extensionCount,
+      availableExtensions.data());
+
+  for (const auto &extension : availableExtensions) {
+    if (strcmp(extension.extensionName, extensionName) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 QueueFamilyIndices LhllDevice::findQueueFamilies(VkPhysicalDevice device) {
   QueueFamilyIndices indices;
 
@@ -332,11 +598,17 @@ QueueFamilyIndices LhllDevice::findQueueFamilies(VkPhysicalDevice device) {
       indices.graphicsFamily = i;
       indices.graphicsFamilyHasValue = true;
     }
-    VkBool32 presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-    if (queueFamily.queueCount > 0 && presentSupport) {
-      indices.presentFamily = i;
-      indices.presentFamilyHasValue = true;
+    if (isHeadless()) {
+      // nothing is presented, the graphics queue stands in for the present queue
+      indices.presentFamily = indices.graphicsFamily;
+      indices.presentFamilyHasValue = indices.graphicsFamilyHasValue;
+    } else {
+      VkBool32 presentSupport = false;
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+      if (queueFamily.queueCount > 0 && presentSupport) {
+        indices.presentFamily = i;
+        indices.presentFamilyHasValue = true;
+      }
     }
     if (indices.isComplete()) {
       break;
@@ -466,12 +738,13 @@ void LhllDevice::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   vkFreeCommandBuffers(device_, commandPool, 1, &commandBuffer);
 }
 
-void LhllDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+void LhllDevice::copyBuffer(
+    VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset) {
   VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
   VkBufferCopy copyRegion{};
   copyRegion.srcOffset = 0;  // Optional
-  copyRegion.dstOffset = 0;  // Optional
+  copyRegion.dstOffset = dstOffset;
   copyRegion.size = size;
   vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
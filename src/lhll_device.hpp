@@ -4,6 +4,7 @@
 #include "lhll_window.hpp"
 
 // std lib headers
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -23,6 +24,34 @@ namespace lhll {
     bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
   };
 
+  // Extensions/features that are enabled when the physical device has them
+  struct OptionalDeviceFeatures {
+    bool extendedDynamicState = false;
+    bool extendedDynamicState2 = false;
+    bool multiDrawIndirect = false;
+    bool drawIndirectFirstInstance = false;
+  };
+
+  struct ExtendedDynamicStateFunctions {
+    PFN_vkCmdSetCullModeEXT setCullMode = nullptr;
+    PFN_vkCmdSetFrontFaceEXT setFrontFace = nullptr;
+    PFN_vkCmdSetPrimitiveTopologyEXT setPrimitiveTopology = nullptr;
+    PFN_vkCmdSetDepthTestEnableEXT setDepthTestEnable = nullptr;
+    PFN_vkCmdSetDepthWriteEnableEXT setDepthWriteEnable = nullptr;
+    PFN_vkCmdSetDepthCompareOpEXT setDepthCompareOp = nullptr;
+    PFN_vkCmdSetDepthBiasEnableEXT setDepthBiasEnable = nullptr;
+    PFN_vkCmdSetPrimitiveRestartEnableEXT setPrimitiveRestartEnable = nullptr;
+  };
+
+  // VK_KHR_timeline_semaphore, required, the instance is made for 1.1
+  struct TimelineSemaphoreFunctions {
+    PFN_vkWaitSemaphoresKHR wait = nullptr;
+    PFN_vkGetSemaphoreCounterValueKHR getCounterValue = nullptr;
+  };
+
+  class LhllDeletionQueue;
+  class LhllTimeline;
+
   class LhllDevice {
    public:
   #ifdef NDEBUG
@@ -32,6 +61,9 @@ namespace lhll {
   #endif
 
     LhllDevice(LhllWindow &window);
+    // Headless, without a window, surface or the swap chain extension, for rendering into offscreen
+    // images. presentQueue() is the graphics queue and surface() is VK_NULL_HANDLE
+    LhllDevice();
     ~LhllDevice();
 
     // Not copyable or movable
@@ -43,8 +75,20 @@ namespace lhll {
     VkCommandPool getCommandPool() { return commandPool; }
     VkDevice device() { return device_; }
     VkSurfaceKHR surface() { return surface_; }
+    bool isHeadless() const { return window == nullptr; }
     VkQueue graphicsQueue() { return graphicsQueue_; }
     VkQueue presentQueue() { return presentQueue_; }
+    VkPipelineCache pipelineCache() { return pipelineCache_; }
+    bool isPipelineCacheWarm() const { return pipelineCacheWarm; }
+    const OptionalDeviceFeatures& optionalFeatures() const { return optionalFeatures_; }
+    const ExtendedDynamicStateFunctions& extendedDynamicState() const { return extendedDynamicState_; }
+    const TimelineSemaphoreFunctions& timelineSemaphore() const { return timelineSemaphore_; }
+    // Of the graphics queue, signaled by LhllRenderer's frames only, frame n with value n. Work on
+    // other queues waits for frames with it, one-off submissions wait for the queue to idle instead
+    LhllTimeline& graphicsTimeline() { return *graphicsTimeline_; }
+    // Where LhllBuffer, LhllPipeline and LhllComputePipeline put their Vulkan objects when destroyed,
+    // so they can be replaced while frames using them are in flight
+    LhllDeletionQueue& deletionQueue() { return *deletionQueue_; }
 
     SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
@@ -61,7 +105,7 @@ namespace lhll {
         VkDeviceMemory &bufferMemory);
     VkCommandBuffer beginSingleTimeCommands();
     void endSingleTimeCommands(VkCommandBuffer commandBuffer);
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset = 0);
     void copyBufferToImage(
         VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
@@ -80,6 +124,10 @@ namespace lhll {
     void pickPhysicalDevice();
     void createLogicalDevice();
     void createCommandPool();
+    void createPipelineCache();
+    void queryOptionalFeatures();
+    void loadDeviceFunctions();
+    void savePipelineCache();
 
     // helper functions
     bool isDeviceSuitable(VkPhysicalDevice device);
@@ -88,22 +136,33 @@ namespace lhll {
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
     void hasGflwRequiredInstanceExtensions();
+    std::vector<const char *> getRequiredDeviceExtensions();
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool isDeviceExtensionAvailable(VkPhysicalDevice device, const char *extensionName);
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
+    bool isPipelineCacheCompatible(const std::vector<char> &cacheData);
 
     VkInstance instance;
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-    LhllWindow &window;
+    LhllWindow *window = nullptr;
     VkCommandPool commandPool;
 
     VkDevice device_;
-    VkSurfaceKHR surface_;
+    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
     VkQueue graphicsQueue_;
     VkQueue presentQueue_;
+    VkPipelineCache pipelineCache_ = VK_NULL_HANDLE;
+    bool pipelineCacheWarm = false;
+    OptionalDeviceFeatures optionalFeatures_{};
+    ExtendedDynamicStateFunctions extendedDynamicState_{};
+    TimelineSemaphoreFunctions timelineSemaphore_{};
+    std::unique_ptr<LhllTimeline> graphicsTimeline_;
+    std::unique_ptr<LhllDeletionQueue> deletionQueue_;
 
     const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
-    const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    // the swap chain extension is added with a window
+    const std::vector<const char *> deviceExtensions = {VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME};
   };
 
 }  // namespace lhll
@@ -0,0 +1,183 @@
+#include "lhll_draw_batcher.hpp"
+
+#include "lhll_swap_chain.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace lhll {
+  // grown on demand, by at least doubling
+  static constexpr uint32_t INITIAL_INSTANCE_CAPACITY = 1024;
+  static constexpr uint32_t INITIAL_DRAW_CAPACITY = 64;
+
+  // beginFrame waited for the slot's previous frame, so its buffers can be replaced right away
+  static bool reserveFrameBuffer(LhllDevice& device, std::unique_ptr<LhllBuffer>& buffer, VkDeviceSize instanceSize, uint32_t instanceCount, VkBufferUsageFlags usageFlags) {
+    return LhllBuffer::reserve(buffer, device, instanceSize, instanceCount, usageFlags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  }
+
+  LhllDrawBatcher::LhllDrawBatcher(LhllDevice& device) : lhllDevice{device}, objectTable{device, INITIAL_INSTANCE_CAPACITY} {
+    instanceBuffers.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    indirectBuffers.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < instanceBuffers.size(); i++) {
+      reserveFrameBuffer(lhllDevice, instanceBuffers[i], sizeof(uint32_t), INITIAL_INSTANCE_CAPACITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+      // the cull pass writes instanceCount of the commands
+      reserveFrameBuffer(lhllDevice, indirectBuffers[i], sizeof(VkDrawIndexedIndirectCommand), INITIAL_DRAW_CAPACITY, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    }
+  }
+
+  void LhllDrawBatcher::collectObjects(FrameInfo& frameInfo) {
+    drawObjects.clear();
+    drawObjectSlots.clear();
+    objectTable.beginFrame(frameInfo.frameIndex);
+    for (auto& kv : frameInfo.gameObjects) {
+      if (kv.second.model == nullptr) continue;
+      drawObjects.push_back(&kv.second);
+      drawObjectSlots.push_back(objectTable.update(kv.second));
+    }
+    objectTable.endFrame();
+    frameInfo.stats.objectsWritten = objectTable.getWrittenCount();
+  }
+
+  void LhllDrawBatcher::keepVisible(const std::vector<uint8_t>& visibility) {
+    size_t keptCount = 0;
+    for (size_t i = 0; i < drawObjects.size(); i++) {
+      if (!visibility[i]) continue;
+      drawObjects[keptCount] = drawObjects[i];
+      drawObjectSlots[keptCount] = drawObjectSlots[i];
+      keptCount++;
+    }
+    drawObjects.resize(keptCount);
+    drawObjectSlots.resize(keptCount);
+  }
+
+  void LhllDrawBatcher::build(FrameInfo& frameInfo, bool useIndirect) {
+    buildDrawList(frameInfo);
+    buildInstanceGroups();
+    writeInstances(frameInfo.frameIndex);
+    buildDrawBatches(useIndirect);
+  }
+
+  uint16_t LhllDrawBatcher::renderStateId(const RenderState& renderState) {
+    // a scene rarely has more than a handful of render states, a linear search is enough
+    for (size_t i = 0; i < frameRenderStates.size(); i++) {
+      if (frameRenderStates[i] == renderState) return static_cast<uint16_t>(i);
+    }
+    assert(frameRenderStates.size() <= UINT16_MAX && "Too many render states for the sort key");
+    frameRenderStates.push_back(renderState);
+    return static_cast<uint16_t>(frameRenderStates.size() - 1);
+  }
+
+  void LhllDrawBatcher::buildDrawList(FrameInfo& frameInfo) {
+    drawList.clear();
+    frameRenderStates.clear();
+    modelIds.clear();
+
+    // view space z of the object's origin, the camera looks down +z
+    const glm::mat4& view = frameInfo.camera.getView();
+    glm::vec4 depthRow{view[0][2], view[1][2], view[2][2], view[3][2]};
+
+    for (uint32_t i = 0; i < drawObjects.size(); i++) {
+      auto* obj = drawObjects[i];
+      uint16_t stateId = renderStateId(obj->renderState);
+      auto modelId = modelIds.emplace(obj->model.get(), static_cast<uint16_t>(modelIds.size())).first->second;
+      assert(modelIds.size() <= UINT16_MAX + 1 && "Too many models for the sort key");
+      float depth = glm::dot(depthRow, glm::vec4{obj->transform.translation, 1.0f});
+      drawList.add(LhllDrawList::makeKey(stateId, modelId, depth), i);
+    }
+
+    auto sortStart = std::chrono::high_resolution_clock::now();
+    drawList.sort();
+    auto sortEnd = std::chrono::high_resolution_clock::now();
+    frameInfo.stats.drawSortMicroseconds = std::chrono::duration<float, std::micro>(sortEnd - sortStart).count();
+  }
+
+  // the draw list is sorted by render state and model first, so each group is one run of items
+  void LhllDrawBatcher::buildInstanceGroups() {
+    instanceGroups.clear();
+
+    const auto& items = drawList.getItems();
+    uint32_t groupBits = 0;
+    for (uint32_t i = 0; i < items.size(); i++) {
+      uint32_t bits = LhllDrawList::batchBits(items[i].key);
+      if (instanceGroups.empty() || bits != groupBits) {
+        auto* obj = drawObjects[items[i].index];
+        instanceGroups.push_back({obj->model.get(), obj->renderState, i, 0});
+        groupBits = bits;
+      }
+      instanceGroups.back().instanceCount++;
+    }
+  }
+
+  void LhllDrawBatcher::writeInstances(int frameIndex) {
+    const auto& items = drawList.getItems();
+    uint32_t instanceCount = static_cast<uint32_t>(items.size());
+    if (instanceCount == 0) return;
+
+    auto& buffer = instanceBuffers[frameIndex];
+    reserveFrameBuffer(lhllDevice, buffer, sizeof(uint32_t), instanceCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    auto* instances = static_cast<uint32_t*>(buffer->getMappedMemory());
+
+    // in draw list order, so the instances of a group are drawn front to back
+    for (uint32_t i = 0; i < instanceCount; i++) {
+      instances[i] = drawObjectSlots[items[i].index];
+    }
+
+    buffer->flush();
+  }
+
+  void LhllDrawBatcher::buildDrawBatches(bool useIndirect) {
+    drawBatches.clear();
+
+    for (uint32_t groupIndex = 0; groupIndex < instanceGroups.size(); groupIndex++) {
+      const auto& group = instanceGroups[groupIndex];
+      LhllGeometryPool* geometryPool = useIndirect ? group.model->getGeometryPool() : nullptr;
+
+      auto batch = std::find_if(drawBatches.begin(), drawBatches.end(), [&](const DrawBatch& candidate) {
+        return candidate.geometryPool == geometryPool && candidate.renderState == group.renderState;
+      });
+      if (batch == drawBatches.end()) {
+        drawBatches.push_back({group.renderState, geometryPool, {}, 0});
+        batch = drawBatches.end() - 1;
+      }
+      batch->groups.push_back(groupIndex);
+    }
+  }
+
+  bool LhllDrawBatcher::isAllIndirect() const {
+    for (const auto& batch : drawBatches) {
+      if (batch.geometryPool == nullptr) return false;
+    }
+    return true;
+  }
+
+  void LhllDrawBatcher::writeIndirectCommands(int frameIndex, bool gpuCulled) {
+    commandCount = 0;
+    for (auto& batch : drawBatches) {
+      if (batch.geometryPool == nullptr) continue;
+      batch.firstCommand = commandCount;
+      commandCount += static_cast<uint32_t>(batch.groups.size());
+    }
+    if (commandCount == 0) return;
+
+    auto& buffer = indirectBuffers[frameIndex];
+    reserveFrameBuffer(lhllDevice, buffer, sizeof(VkDrawIndexedIndirectCommand), commandCount, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+    auto* commands = static_cast<VkDrawIndexedIndirectCommand*>(buffer->getMappedMemory());
+    for (const auto& batch : drawBatches) {
+      if (batch.geometryPool == nullptr) continue;
+
+      uint32_t command = batch.firstCommand;
+      for (uint32_t groupIndex : batch.groups) {
+        const auto& group = instanceGroups[groupIndex];
+        commands[command++] = group.model->indirectCommand(gpuCulled ? 0 : group.instanceCount, group.firstInstance);
+      }
+    }
+
+    buffer->flush();
+  }
+}
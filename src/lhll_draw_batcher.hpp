@@ -0,0 +1,96 @@
+#ifndef LHLL_DRAW_BATCHER_HPP
+#define LHLL_DRAW_BATCHER_HPP
+
+#include "lhll_buffer.hpp"
+#include "lhll_device.hpp"
+#include "lhll_draw_list.hpp"
+#include "lhll_frame_info.hpp"
+#include "lhll_game_object.hpp"
+#include "lhll_object_table.hpp"
+#include "lhll_render_state.hpp"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace lhll {
+  // Turns the game objects of a frame into instanced draws. Objects are sorted by render state, model
+  // and depth, and objects sharing a model and render state become one instance group. The object
+  // table entries of the instances are written to a per frame instance buffer in draw list order.
+  // Groups sharing a render state and geometry pool are batched into one range of a per frame
+  // indirect command buffer, the other groups are drawn directly
+  class LhllDrawBatcher {
+  public:
+    struct InstanceGroup {
+      LhllModel* model;
+      RenderState renderState;
+      uint32_t firstInstance;
+      uint32_t instanceCount;
+    };
+
+    // groups that can be recorded without changing state, geometryPool is null for direct draws
+    struct DrawBatch {
+      RenderState renderState;
+      LhllGeometryPool* geometryPool;
+      std::vector<uint32_t> groups;
+      uint32_t firstCommand;
+    };
+
+    LhllDrawBatcher(LhllDevice& device);
+
+    LhllDrawBatcher(const LhllDrawBatcher&) = delete;
+    LhllDrawBatcher& operator=(const LhllDrawBatcher&) = delete;
+
+    // the objects with a model become the draw objects, every one of them gets an object table entry
+    void collectObjects(FrameInfo& frameInfo);
+    const std::vector<LhllGameObject*>& getDrawObjects() const { return drawObjects; }
+    // drops the draw objects whose visibility is 0, they keep their entry so static objects are only
+    // written once
+    void keepVisible(const std::vector<uint8_t>& visibility);
+
+    // Sorts the draw objects, writes the frame's instance buffer and batches the groups. Pooled
+    // models are only batched into indirect draws with useIndirect set
+    void build(FrameInfo& frameInfo, bool useIndirect);
+    // instanceCount is left at 0 for the GPU cull to fill in when gpuCulled is set
+    void writeIndirectCommands(int frameIndex, bool gpuCulled);
+
+    const std::vector<InstanceGroup>& getInstanceGroups() const { return instanceGroups; }
+    const std::vector<DrawBatch>& getDrawBatches() const { return drawBatches; }
+    uint32_t getInstanceCount() const { return static_cast<uint32_t>(drawList.size()); }
+    // of the last writeIndirectCommands
+    uint32_t getCommandCount() const { return commandCount; }
+    // directly drawn groups use the CPU side instance count, so only then can the GPU cull everything
+    bool isAllIndirect() const;
+
+    LhllObjectTable& getObjectTable() { return objectTable; }
+    LhllBuffer& getInstanceBuffer(int frameIndex) { return *instanceBuffers[frameIndex]; }
+    LhllBuffer& getIndirectBuffer(int frameIndex) { return *indirectBuffers[frameIndex]; }
+
+  private:
+    uint16_t renderStateId(const RenderState& renderState);
+    void buildDrawList(FrameInfo& frameInfo);
+    void buildInstanceGroups();
+    void writeInstances(int frameIndex);
+    void buildDrawBatches(bool useIndirect);
+
+    LhllDevice& lhllDevice;
+    LhllObjectTable objectTable;
+    std::vector<std::unique_ptr<LhllBuffer>> instanceBuffers;
+    std::vector<std::unique_ptr<LhllBuffer>> indirectBuffers;
+    uint32_t commandCount = 0;
+
+    // rebuilt every frame, kept as members so their memory is reused
+    // objects with a model that survived the CPU cull, indexed by the draw list items
+    std::vector<LhllGameObject*> drawObjects;
+    // object table entry of each of drawObjects
+    std::vector<uint32_t> drawObjectSlots;
+    LhllDrawList drawList;
+    // ids of the sort keys, assigned in the order they are first seen
+    std::vector<RenderState> frameRenderStates;
+    std::unordered_map<LhllModel*, uint16_t> modelIds;
+    std::vector<InstanceGroup> instanceGroups;
+    std::vector<DrawBatch> drawBatches;
+  };
+}
+
+#endif
@@ -0,0 +1,47 @@
+#include "lhll_draw_list.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace lhll {
+  uint64_t LhllDrawList::makeKey(uint16_t stateId, uint16_t modelId, float viewDepth, bool backToFront) {
+    // the bits of a non negative float sort like the float, behind the camera clamps to 0
+    float depth = viewDepth > 0.0f ? viewDepth : 0.0f;
+    uint32_t depthBits;
+    std::memcpy(&depthBits, &depth, sizeof(depthBits));
+    if (backToFront) depthBits = ~depthBits;
+
+    return (static_cast<uint64_t>(stateId) << 48) | (static_cast<uint64_t>(modelId) << 32) | depthBits;
+  }
+
+  void LhllDrawList::sort() {
+    size_t count = items.size();
+    if (count < 2) return;
+
+    // all 8 histograms in one pass over the keys
+    std::array<std::array<uint32_t, 256>, 8> histograms{};
+    for (const auto& item : items) {
+      for (int pass = 0; pass < 8; pass++) {
+        histograms[pass][(item.key >> (pass * 8)) & 0xff]++;
+      }
+    }
+
+    scratch.resize(count);
+    for (int pass = 0; pass < 8; pass++) {
+      auto& histogram = histograms[pass];
+      if (histogram[(items[0].key >> (pass * 8)) & 0xff] == count) continue;
+
+      uint32_t offset = 0;
+      for (auto& bucket : histogram) {
+        uint32_t bucketCount = bucket;
+        bucket = offset;
+        offset += bucketCount;
+      }
+
+      for (const auto& item : items) {
+        scratch[histogram[(item.key >> (pass * 8)) & 0xff]++] = item;
+      }
+      items.swap(scratch);
+    }
+  }
+}
@@ -0,0 +1,39 @@
+#ifndef LHLL_DRAW_LIST_HPP
+#define LHLL_DRAW_LIST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lhll {
+  // Compact (key, draw index) items sorted by key, so recording in list order groups draws by the
+  // state encoded in the high bits of the key. Rebuilt every frame, the memory is kept
+  class LhllDrawList {
+  public:
+    struct Item {
+      uint64_t key;
+      uint32_t index;
+    };
+
+    // state:16 | model:16 | depth:32. Opaque draws sort front to back within the same state and
+    // model, backToFront inverts the depth for transparent ones
+    static uint64_t makeKey(uint16_t stateId, uint16_t modelId, float viewDepth, bool backToFront = false);
+    // the key without the depth, equal for draws that can share one instanced draw
+    static uint32_t batchBits(uint64_t key) { return static_cast<uint32_t>(key >> 32); }
+
+    void clear() { items.clear(); }
+    void add(uint64_t key, uint32_t index) { items.push_back({key, index}); }
+
+    // LSD radix sort, 8 bits per pass, passes where every key has the same byte are skipped. Stable
+    void sort();
+
+    const std::vector<Item>& getItems() const { return items; }
+    size_t size() const { return items.size(); }
+
+  private:
+    std::vector<Item> items;
+    std::vector<Item> scratch;
+  };
+}
+
+#endif
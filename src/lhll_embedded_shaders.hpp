@@ -0,0 +1,19 @@
+#ifndef LHLL_EMBEDDED_SHADERS_HPP
+#define LHLL_EMBEDDED_SHADERS_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace lhll {
+  struct EmbeddedShader {
+    const char* name;
+    const unsigned char* data;
+    size_t size;
+  };
+
+  // Defined in the embedded_shaders.cpp generated by the Shaders target when LHLL_EMBED_SHADERS is
+  // on, returns nullptr for shaders that were not embedded
+  const EmbeddedShader* findEmbeddedShader(const std::string& name);
+}
+
+#endif
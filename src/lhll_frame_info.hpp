@@ -6,7 +6,106 @@
 
 #include <vulkan/vulkan.h>
 
+#include <ostream>
+
 namespace lhll {
+    // the global uniform buffer as the shaders read it
+    struct GlobalUbo {
+        glm::mat4 projectionView{1.0f};
+        glm::vec4 ambientLightColor{1.0f, 1.0f, 1.0f, 0.02f};
+        glm::vec3 lightPosition{-1.0f};
+        alignas(16) glm::vec4 lightColor{1.0f};
+    };
+
+    // Filled in by the render systems while recording, FirstApp reports it once per second
+    struct FrameStats {
+        uint32_t drawCalls = 0;
+        // draws of the depth pre-pass, not included in drawCalls
+        uint32_t depthPrepassDraws = 0;
+        // objects drawn, several per draw call when instanced
+        uint32_t instances = 0;
+        // draws executed from indirect buffers, drawCalls counts each multi draw once
+        uint32_t indirectDraws = 0;
+        // object table entries rewritten because their transform changed
+        uint32_t objectsWritten = 0;
+        uint32_t cpuCulledObjects = 0;
+        // objects the CPU cull found behind the occluders, not included in cpuCulledObjects
+        uint32_t cpuOccludedObjects = 0;
+        // read back from the GPU cull of an earlier frame that used the same frame slot, includes the
+        // objects the occlusion cull removed
+        uint32_t gpuCulledObjects = 0;
+        // objects not visible in the last frame that the occlusion cull found visible, read back like
+        // gpuCulledObjects
+        uint32_t lateDrawnObjects = 0;
+        // draws recorded with the fallback pipeline, or skipped, while the real one was still compiling
+        uint32_t pipelineFallbackDraws = 0;
+        uint32_t pipelineSkippedDraws = 0;
+        // vkCmdSet* calls for per object render state, redundant ones are not recorded
+        uint32_t renderStateChanges = 0;
+        // vertex and index buffer binds, redundant ones are not recorded
+        uint32_t geometryBinds = 0;
+        // radix sort of the draw list
+        float drawSortMicroseconds = 0.0f;
+        // software rasterization of the occluders
+        float occlusionRasterMicroseconds = 0.0f;
+        // wall clock time of renderGameObjects
+        float recordMicroseconds = 0.0f;
+        uint32_t secondaryCommandBuffers = 0;
+        // secondary command buffers executed again without being recorded, the scene was unchanged
+        uint32_t reusedCommandBuffers = 0;
+
+        // sums the stats of command buffers recorded separately
+        FrameStats& operator+=(const FrameStats& other) {
+            drawCalls += other.drawCalls;
+            depthPrepassDraws += other.depthPrepassDraws;
+            instances += other.instances;
+            indirectDraws += other.indirectDraws;
+            objectsWritten += other.objectsWritten;
+            cpuCulledObjects += other.cpuCulledObjects;
+            cpuOccludedObjects += other.cpuOccludedObjects;
+            gpuCulledObjects += other.gpuCulledObjects;
+            lateDrawnObjects += other.lateDrawnObjects;
+            pipelineFallbackDraws += other.pipelineFallbackDraws;
+            pipelineSkippedDraws += other.pipelineSkippedDraws;
+            renderStateChanges += other.renderStateChanges;
+            geometryBinds += other.geometryBinds;
+            drawSortMicroseconds += other.drawSortMicroseconds;
+            occlusionRasterMicroseconds += other.occlusionRasterMicroseconds;
+            recordMicroseconds += other.recordMicroseconds;
+            secondaryCommandBuffers += other.secondaryCommandBuffers;
+            reusedCommandBuffers += other.reusedCommandBuffers;
+            return *this;
+        }
+
+        // the per frame averages of stats summed over frameCount frames, on one line
+        void printAverages(std::ostream& out, uint32_t frameCount) const {
+            const uint32_t frames = frameCount > 0 ? frameCount : 1;
+            out << "draw calls/frame: " << drawCalls / frames
+                << ", pre-pass draws/frame: " << depthPrepassDraws / frames
+                << ", objects/frame: " << instances / frames
+                << ", state changes/frame: " << renderStateChanges / frames
+                << ", geometry binds/frame: " << geometryBinds / frames
+                << ", draw sort us/frame: " << drawSortMicroseconds / frames
+                << ", record us/frame: " << recordMicroseconds / frames
+                << ", cpu culled/frame: " << cpuCulledObjects / frames
+                << ", cpu occluded/frame: " << cpuOccludedObjects / frames
+                << ", occlusion raster us/frame: " << occlusionRasterMicroseconds / frames
+                << ", gpu culled/frame: " << gpuCulledObjects / frames
+                << ", late drawn/frame: " << lateDrawnObjects / frames;
+        }
+    };
+
+    // the render pass the systems record into, secondary command buffers have to inherit it
+    struct RenderPassTarget {
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        VkExtent2D extent{};
+        // read by the occlusion cull after the render pass
+        VkImageView depthImageView = VK_NULL_HANDLE;
+        // LhllRenderer::getRenderPassGeneration, 0 keeps the draws from being cached
+        uint64_t generation = 0;
+    };
+
     struct FrameInfo {
         int frameIndex;
         float frameTime;
@@ -14,6 +113,10 @@ namespace lhll {
         LhllCamera &camera;
         VkDescriptorSet globalDescriptorSet;
         LhllGameObject::Map& gameObjects;
+        RenderPassTarget renderPassTarget{};
+        // of the writer that last wrote globalDescriptorSet, 0 keeps the draws from being cached
+        uint64_t globalDescriptorSetGeneration = 0;
+        FrameStats stats{};
     };
 }
 
@@ -0,0 +1,131 @@
+#include "lhll_frustum_culler.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define LHLL_CULL_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LHLL_CULL_SSE
+#endif
+
+namespace lhll {
+  void LhllFrustumCuller::clear() {
+    centersX.clear();
+    centersY.clear();
+    centersZ.clear();
+    radii.clear();
+  }
+
+  void LhllFrustumCuller::reserve(size_t sphereCount) {
+    centersX.reserve(sphereCount);
+    centersY.reserve(sphereCount);
+    centersZ.reserve(sphereCount);
+    radii.reserve(sphereCount);
+  }
+
+  void LhllFrustumCuller::addSphere(const glm::vec3& center, float radius) {
+    centersX.push_back(center.x);
+    centersY.push_back(center.y);
+    centersZ.push_back(center.z);
+    radii.push_back(radius);
+  }
+
+  const char* LhllFrustumCuller::simdName() {
+#if defined(LHLL_CULL_AVX)
+    return "AVX";
+#elif defined(LHLL_CULL_SSE)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+  }
+
+  // a sphere is outside when it lies completely behind any of the planes
+  uint32_t LhllFrustumCuller::cullRange(const std::array<glm::vec4, 6>& planes, uint8_t* visibility, size_t begin, size_t end) const {
+    uint32_t visibleCount = 0;
+    for (size_t i = begin; i < end; i++) {
+      bool visible = true;
+      for (const auto& plane : planes) {
+        // grouped like the SIMD paths so both give the same result
+        float distance = (plane.x * centersX[i] + plane.y * centersY[i]) + (plane.z * centersZ[i] + plane.w);
+        visible = visible && distance >= -radii[i];
+      }
+      visibility[i] = visible ? 1 : 0;
+      visibleCount += visibility[i];
+    }
+    return visibleCount;
+  }
+
+  uint32_t LhllFrustumCuller::cullScalar(const std::array<glm::vec4, 6>& planes, std::vector<uint8_t>& visibility) const {
+    visibility.resize(size());
+    return cullRange(planes, visibility.data(), 0, size());
+  }
+
+  uint32_t LhllFrustumCuller::cull(const std::array<glm::vec4, 6>& planes, std::vector<uint8_t>& visibility) const {
+    size_t count = size();
+    visibility.resize(count);
+    uint32_t visibleCount = 0;
+    size_t i = 0;
+
+#if defined(LHLL_CULL_AVX)
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; p++) {
+      planeX[p] = _mm256_set1_ps(planes[p].x);
+      planeY[p] = _mm256_set1_ps(planes[p].y);
+      planeZ[p] = _mm256_set1_ps(planes[p].z);
+      planeW[p] = _mm256_set1_ps(planes[p].w);
+    }
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+    for (; i + 8 <= count; i += 8) {
+      __m256 x = _mm256_loadu_ps(&centersX[i]);
+      __m256 y = _mm256_loadu_ps(&centersY[i]);
+      __m256 z = _mm256_loadu_ps(&centersZ[i]);
+      __m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(&radii[i]), signBit);
+
+      __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+      for (int p = 0; p < 6; p++) {
+        __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)), _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+      }
+
+      int mask = _mm256_movemask_ps(inside);
+      for (int lane = 0; lane < 8; lane++) {
+        visibility[i + lane] = (mask >> lane) & 1;
+        visibleCount += visibility[i + lane];
+      }
+    }
+#elif defined(LHLL_CULL_SSE)
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; p++) {
+      planeX[p] = _mm_set1_ps(planes[p].x);
+      planeY[p] = _mm_set1_ps(planes[p].y);
+      planeZ[p] = _mm_set1_ps(planes[p].z);
+      planeW[p] = _mm_set1_ps(planes[p].w);
+    }
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+
+    for (; i + 4 <= count; i += 4) {
+      __m128 x = _mm_loadu_ps(&centersX[i]);
+      __m128 y = _mm_loadu_ps(&centersY[i]);
+      __m128 z = _mm_loadu_ps(&centersZ[i]);
+      __m128 negativeRadius = _mm_xor_ps(_mm_loadu_ps(&radii[i]), signBit);
+
+      __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (int p = 0; p < 6; p++) {
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+      }
+
+      int mask = _mm_movemask_ps(inside);
+      for (int lane = 0; lane < 4; lane++) {
+        visibility[i + lane] = (mask >> lane) & 1;
+        visibleCount += visibility[i + lane];
+      }
+    }
+#endif
+
+    // the spheres that do not fill a whole register
+    return visibleCount + cullRange(planes, visibility.data(), i, count);
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef LHLL_FRUSTUM_CULLER_HPP
+#define LHLL_FRUSTUM_CULLER_HPP
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lhll {
+  // Tests world space bounding spheres against the six planes of LhllCamera::getFrustumPlanes. The
+  // spheres are kept as structure of arrays so 8 (AVX) or 4 (SSE) of them are tested per instruction
+  class LhllFrustumCuller {
+  public:
+    void clear();
+    void reserve(size_t sphereCount);
+    void addSphere(const glm::vec3& center, float radius);
+    size_t size() const { return radii.size(); }
+
+    // visibility[i] is 1 when sphere i intersects the frustum, returns the number of visible spheres
+    uint32_t cull(const std::array<glm::vec4, 6>& planes, std::vector<uint8_t>& visibility) const;
+    // the same test one sphere at a time, as reference for cull
+    uint32_t cullScalar(const std::array<glm::vec4, 6>& planes, std::vector<uint8_t>& visibility) const;
+
+    // name of the instruction set cull uses, decided at compile time
+    static const char* simdName();
+
+  private:
+    uint32_t cullRange(const std::array<glm::vec4, 6>& planes, uint8_t* visibility, size_t begin, size_t end) const;
+
+    std::vector<float> centersX;
+    std::vector<float> centersY;
+    std::vector<float> centersZ;
+    std::vector<float> radii;
+  };
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define LHLL_GAME_OBJECT_HPP
 
 #include "lhll_model.hpp"
+#include "lhll_render_state.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -19,6 +20,10 @@ namespace lhll {
     // https://en.wikipedia.org/wiki/Euler_angles#Rotation_matrix
     glm::mat4 mat4();
     glm::mat3 normalMatrix();
+
+    bool operator==(const TransformComponent& other) const {
+      return translation == other.translation && scale == other.scale && rotation == other.rotation;
+    }
   };
 
   class LhllGameObject {
@@ -41,6 +46,10 @@ namespace lhll {
     std::shared_ptr<LhllModel> model{};
     glm::vec3 color{};
     TransformComponent transform{};
+    RenderState renderState{};
+    // Drawn into the software occlusion buffer of the CPU cull. Meant for a few large, simple meshes
+    // like walls and floors, every triangle of the model is rasterized
+    bool occluder = false;
 
   private:
     LhllGameObject(id_t objId) : id{objId} {}
@@ -0,0 +1,60 @@
+#include "lhll_geometry_pool.hpp"
+
+#include <stdexcept>
+
+namespace lhll {
+  LhllGeometryPool::LhllGeometryPool(LhllDevice& device, VkDeviceSize vertexStride, uint32_t maxVertexCount, uint32_t maxIndexCount) : lhllDevice{device}, vertexStride{vertexStride} {
+    vertexBuffer = std::make_unique<LhllBuffer>(lhllDevice, vertexStride, maxVertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    positionBuffer = std::make_unique<LhllBuffer>(lhllDevice, sizeof(glm::vec3), maxVertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    indexBuffer = std::make_unique<LhllBuffer>(lhllDevice, sizeof(uint32_t), maxIndexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  }
+
+  LhllGeometryPool::~LhllGeometryPool() {}
+
+  LhllGeometryPool::Allocation LhllGeometryPool::allocate(const void* vertexData, const glm::vec3* positions, uint32_t newVertexCount, const uint32_t* indices, uint32_t newIndexCount) {
+    if (vertexCount + newVertexCount > vertexBuffer->getInstanceCount() || indexCount + newIndexCount > indexBuffer->getInstanceCount()) {
+      throw std::runtime_error("geometry pool is full");
+    }
+
+    Allocation allocation{};
+    allocation.firstIndex = indexCount;
+    allocation.indexCount = newIndexCount;
+    allocation.vertexOffset = static_cast<int32_t>(vertexCount);
+    allocation.vertexCount = newVertexCount;
+
+    LhllBuffer vertexStaging{lhllDevice, vertexStride, newVertexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+    vertexStaging.map();
+    vertexStaging.writeToBuffer(const_cast<void*>(vertexData));
+    lhllDevice.copyBuffer(vertexStaging.getBuffer(), vertexBuffer->getBuffer(), vertexStride * newVertexCount, vertexStride * vertexCount);
+
+    LhllBuffer positionStaging{lhllDevice, sizeof(glm::vec3), newVertexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+    positionStaging.map();
+    positionStaging.writeToBuffer(const_cast<glm::vec3*>(positions));
+    lhllDevice.copyBuffer(positionStaging.getBuffer(), positionBuffer->getBuffer(), sizeof(glm::vec3) * newVertexCount, sizeof(glm::vec3) * vertexCount);
+
+    if (newIndexCount > 0) {
+      LhllBuffer indexStaging{lhllDevice, sizeof(uint32_t), newIndexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+      indexStaging.map();
+      indexStaging.writeToBuffer(const_cast<uint32_t*>(indices));
+      lhllDevice.copyBuffer(indexStaging.getBuffer(), indexBuffer->getBuffer(), sizeof(uint32_t) * newIndexCount, sizeof(uint32_t) * indexCount);
+    }
+
+    vertexCount += newVertexCount;
+    indexCount += newIndexCount;
+    return allocation;
+  }
+
+  void LhllGeometryPool::bind(VkCommandBuffer commandBuffer) {
+    VkBuffer buffers[] = {vertexBuffer->getBuffer()};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+  }
+
+  void LhllGeometryPool::bindPositions(VkCommandBuffer commandBuffer) {
+    VkBuffer buffers[] = {positionBuffer->getBuffer()};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+  }
+}
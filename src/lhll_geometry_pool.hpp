@@ -0,0 +1,57 @@
+#ifndef LHLL_GEOMETRY_POOL_HPP
+#define LHLL_GEOMETRY_POOL_HPP
+
+#include "lhll_buffer.hpp"
+#include "lhll_device.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <memory>
+
+namespace lhll {
+  // One device local vertex and index buffer shared by many models, so a single bind covers all of
+  // them and they can be drawn with one multi draw indirect call. Allocations are linear and live as
+  // long as the pool. The vertex positions are also kept in a tightly packed stream of their own for
+  // passes that need nothing else
+  class LhllGeometryPool {
+  public:
+    struct Allocation {
+      uint32_t firstIndex;
+      uint32_t indexCount;
+      int32_t vertexOffset;
+      uint32_t vertexCount;
+    };
+
+    LhllGeometryPool(LhllDevice& device, VkDeviceSize vertexStride, uint32_t maxVertexCount, uint32_t maxIndexCount);
+    ~LhllGeometryPool();
+
+    LhllGeometryPool(const LhllGeometryPool&) = delete;
+    LhllGeometryPool& operator=(const LhllGeometryPool&) = delete;
+
+    // vertexData holds vertexCount vertices of vertexStride bytes and positions their positions,
+    // indices are relative to them
+    Allocation allocate(const void* vertexData, const glm::vec3* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
+
+    void bind(VkCommandBuffer commandBuffer);
+    // the position stream at binding 0 with the same index buffer, allocations keep their offsets
+    void bindPositions(VkCommandBuffer commandBuffer);
+
+    VkDeviceSize getVertexStride() const { return vertexStride; }
+    uint32_t getVertexCount() const { return vertexCount; }
+    uint32_t getIndexCount() const { return indexCount; }
+
+  private:
+    LhllDevice& lhllDevice;
+    VkDeviceSize vertexStride;
+
+    std::unique_ptr<LhllBuffer> vertexBuffer;
+    std::unique_ptr<LhllBuffer> positionBuffer;
+    std::unique_ptr<LhllBuffer> indexBuffer;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+  };
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include "lhll_gpu_timer.hpp"
+
+#include "lhll_swap_chain.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace lhll {
+  LhllGpuTimer::LhllGpuTimer(LhllDevice& device, uint32_t scopeCount) : lhllDevice{device}, scopeCount{scopeCount} {
+    supported = lhllDevice.properties.limits.timestampComputeAndGraphics == VK_TRUE;
+    milliseconds.resize(scopeCount, 0.0f);
+    timestamps.resize(2 * scopeCount);
+    if (!supported) return;
+
+    queryPools.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    endedScopes.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT, std::vector<uint8_t>(scopeCount, 0));
+    for (auto& queryPool : queryPools) {
+      VkQueryPoolCreateInfo queryPoolInfo{};
+      queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      queryPoolInfo.queryCount = 2 * scopeCount;
+
+      if (vkCreateQueryPool(lhllDevice.device(), &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timestamp query pool!");
+      }
+    }
+  }
+
+  LhllGpuTimer::~LhllGpuTimer() {
+    for (auto queryPool : queryPools) {
+      vkDestroyQueryPool(lhllDevice.device(), queryPool, nullptr);
+    }
+  }
+
+  void LhllGpuTimer::beginFrame(VkCommandBuffer commandBuffer, int frameIndex) {
+    this->frameIndex = frameIndex;
+    if (!supported) return;
+
+    auto& ended = endedScopes[frameIndex];
+    VkQueryPool queryPool = queryPools[frameIndex];
+    for (uint32_t scope = 0; scope < scopeCount; scope++) {
+      milliseconds[scope] = 0.0f;
+      if (!ended[scope]) continue;
+
+      // the slot's previous frame was waited on, the results are available without waiting
+      VkResult result = vkGetQueryPoolResults(lhllDevice.device(), queryPool, 2 * scope, 2, 2 * sizeof(uint64_t), &timestamps[2 * scope], sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+      uint64_t begin = timestamps[2 * scope];
+      uint64_t end = timestamps[2 * scope + 1];
+      if (result == VK_SUCCESS && end >= begin) {
+        milliseconds[scope] = static_cast<float>(end - begin) * lhllDevice.properties.limits.timestampPeriod * 1e-6f;
+      }
+      ended[scope] = 0;
+    }
+
+    vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2 * scopeCount);
+  }
+
+  void LhllGpuTimer::beginScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+    assert(scope < scopeCount && "GPU timer scope out of range");
+    if (!supported) return;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPools[frameIndex], 2 * scope);
+  }
+
+  void LhllGpuTimer::endScope(VkCommandBuffer commandBuffer, uint32_t scope) {
+    assert(scope < scopeCount && "GPU timer scope out of range");
+    if (!supported) return;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPools[frameIndex], 2 * scope + 1);
+    endedScopes[frameIndex][scope] = 1;
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef LHLL_GPU_TIMER_HPP
+#define LHLL_GPU_TIMER_HPP
+
+#include "lhll_device.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace lhll {
+  // Measures the GPU time of ranges of a frame's command buffer with timestamp queries. Every frame in
+  // flight has its own queries, they are read back once the slot's previous frame was waited on, so
+  // the results lag the frames in flight but reading them never stalls
+  class LhllGpuTimer {
+  public:
+    LhllGpuTimer(LhllDevice& device, uint32_t scopeCount);
+    ~LhllGpuTimer();
+
+    LhllGpuTimer(const LhllGpuTimer&) = delete;
+    LhllGpuTimer& operator=(const LhllGpuTimer&) = delete;
+
+    // the other calls do nothing when the graphics queue has no timestamps
+    bool isSupported() const { return supported; }
+
+    // Reads the results of the frame slot's previous use and resets its queries, has to be recorded
+    // outside a render pass
+    void beginFrame(VkCommandBuffer commandBuffer, int frameIndex);
+    void beginScope(VkCommandBuffer commandBuffer, uint32_t scope);
+    void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+    // of the frame read back by the last beginFrame, 0 when the scope was not measured in it
+    float getMilliseconds(uint32_t scope) const { return milliseconds[scope]; }
+
+  private:
+    LhllDevice& lhllDevice;
+    bool supported;
+    uint32_t scopeCount;
+
+    int frameIndex = 0;
+    // two timestamps per scope
+    std::vector<VkQueryPool> queryPools;
+    // [frameIndex][scope], whether both timestamps were written
+    std::vector<std::vector<uint8_t>> endedScopes;
+    std::vector<float> milliseconds;
+    std::vector<uint64_t> timestamps;
+  };
+}
+
+#endif
@@ -11,6 +11,7 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 
+#include <atomic>
 #include <cassert>
 #include <cstring>
 #include <unordered_map>
@@ -27,17 +28,76 @@ namespace std {
 }
 
 namespace lhll {
-  LhllModel::LhllModel(LhllDevice& device, const LhllModel::Builder& builder) : lhllDevice{device} {
-    createVertexBuffers(builder.vertices);
-    createIndexBuffers(builder.indices);
+  static std::atomic<uint64_t> nextModelGeneration{1};
+
+  LhllModel::LhllModel(LhllDevice& device, const LhllModel::Builder& builder, LhllGeometryPool* geometryPool) : lhllDevice{device}, generation{nextModelGeneration++}, geometryPool{geometryPool} {
+    computeBounds(builder.vertices);
+
+    std::vector<glm::vec3> vertexPositions(builder.vertices.size());
+    for (size_t i = 0; i < vertexPositions.size(); i++) {
+      vertexPositions[i] = builder.vertices[i].position;
+    }
+
+    // non indexed models get sequential indices, for the pool and for CPU side users
+    std::vector<uint32_t> triangleIndices = builder.indices;
+    if (triangleIndices.empty()) {
+      triangleIndices.resize(builder.vertices.size());
+      for (uint32_t i = 0; i < static_cast<uint32_t>(triangleIndices.size()); i++) {
+        triangleIndices[i] = i;
+      }
+    }
+
+    if (geometryPool == nullptr) {
+      createVertexBuffers(builder.vertices);
+      createPositionBuffer(vertexPositions);
+      createIndexBuffers(builder.indices);
+    }
+    else {
+      assert(geometryPool->getVertexStride() == sizeof(Vertex) && "Geometry pool vertex stride does not match LhllModel::Vertex");
+      vertexCount = static_cast<uint32_t>(builder.vertices.size());
+      assert(vertexCount >= 3 && "Vertex count must be at least 3");
+
+      // pooled models are always indexed, so they can all be drawn by the same indexed indirect call
+      geometryAllocation = geometryPool->allocate(builder.vertices.data(), vertexPositions.data(), vertexCount, triangleIndices.data(), static_cast<uint32_t>(triangleIndices.size()));
+      indexCount = geometryAllocation.indexCount;
+      hasIndexBuffer = true;
+    }
+
+    if (builder.keepCpuGeometry) {
+      positions = std::move(vertexPositions);
+      indices = std::move(triangleIndices);
+    }
   }
 
   LhllModel::~LhllModel() {}
 
-  std::unique_ptr<LhllModel> LhllModel::createModelFromFile(LhllDevice& device, const std::string& filepath) {
+  std::unique_ptr<LhllModel> LhllModel::createModelFromFile(LhllDevice& device, const std::string& filepath, LhllGeometryPool* geometryPool, bool keepCpuGeometry) {
     Builder builder{};
     builder.loadModel(ENGINE_DIR + filepath);
-    return std::make_unique<LhllModel>(device, builder);
+    builder.keepCpuGeometry = keepCpuGeometry;
+    return std::make_unique<LhllModel>(device, builder, geometryPool);
+  }
+
+  // centered on the bounding box, not minimal but cheap and tight enough for culling
+  void LhllModel::computeBounds(const std::vector<Vertex> &vertices) {
+    if (vertices.empty()) return;
+
+    glm::vec3 minPosition = vertices[0].position;
+    glm::vec3 maxPosition = vertices[0].position;
+    for (const auto& vertex : vertices) {
+      minPosition = glm::min(minPosition, vertex.position);
+      maxPosition = glm::max(maxPosition, vertex.position);
+    }
+
+    boundingBox = {minPosition, maxPosition};
+
+    glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (const auto& vertex : vertices) {
+      glm::vec3 offset = vertex.position - center;
+      radiusSquared = glm::max(radiusSquared, glm::dot(offset, offset));
+    }
+    boundingSphere = glm::vec4{center, glm::sqrt(radiusSquared)};
   }
 
   void LhllModel::createVertexBuffers(const std::vector<Vertex> &vertices) {
@@ -56,6 +116,20 @@ namespace lhll {
     lhllDevice.copyBuffer(stagingBuffer.getBuffer(), vertexBuffer->getBuffer(), bufferSize);
   }
 
+  void LhllModel::createPositionBuffer(const std::vector<glm::vec3> &positions) {
+    VkDeviceSize bufferSize = sizeof(positions[0]) * vertexCount;
+    uint32_t positionSize = sizeof(positions[0]);
+
+    LhllBuffer stagingBuffer{lhllDevice, positionSize, vertexCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+
+    stagingBuffer.map();
+    stagingBuffer.writeToBuffer((void*)positions.data());
+
+    positionBuffer = std::make_unique<LhllBuffer>(lhllDevice, positionSize, vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    lhllDevice.copyBuffer(stagingBuffer.getBuffer(), positionBuffer->getBuffer(), bufferSize);
+  }
+
   void LhllModel::createIndexBuffers(const std::vector<uint32_t> &indices) {
     indexCount = static_cast<uint32_t>(indices.size());
     hasIndexBuffer = indexCount > 0;
@@ -75,6 +149,11 @@ namespace lhll {
   }
 
   void LhllModel::bind(VkCommandBuffer commandBuffer) {
+    if (geometryPool != nullptr) {
+      geometryPool->bind(commandBuffer);
+      return;
+    }
+
     VkBuffer buffers[] = {vertexBuffer->getBuffer()};
     VkDeviceSize offsets[] = {0};
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
@@ -84,15 +163,41 @@ namespace lhll {
     }
   }
 
-  void LhllModel::draw(VkCommandBuffer commandBuffer) {
+  void LhllModel::bindPositions(VkCommandBuffer commandBuffer) {
+    if (geometryPool != nullptr) {
+      geometryPool->bindPositions(commandBuffer);
+      return;
+    }
+
+    VkBuffer buffers[] = {positionBuffer->getBuffer()};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+
+    if (hasIndexBuffer) {
+      vkCmdBindIndexBuffer(commandBuffer, indexBuffer->getBuffer(), 0, VK_INDEX_TYPE_UINT32);
+    }
+  }
+
+  void LhllModel::draw(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance) {
     if (hasIndexBuffer) {
-      vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
+      vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, geometryAllocation.firstIndex, geometryAllocation.vertexOffset, firstInstance);
     }
     else {
-      vkCmdDraw(commandBuffer, vertexCount, 1, 0, 0);
+      vkCmdDraw(commandBuffer, vertexCount, instanceCount, 0, firstInstance);
     }
   }
 
+  VkDrawIndexedIndirectCommand LhllModel::indirectCommand(uint32_t instanceCount, uint32_t firstInstance) const {
+    assert(hasIndexBuffer && "Indirect commands are only built for indexed models");
+    VkDrawIndexedIndirectCommand command{};
+    command.indexCount = indexCount;
+    command.instanceCount = instanceCount;
+    command.firstIndex = geometryAllocation.firstIndex;
+    command.vertexOffset = geometryAllocation.vertexOffset;
+    command.firstInstance = firstInstance;
+    return command;
+  }
+
   std::vector<VkVertexInputBindingDescription> LhllModel::Vertex::getBindingDescriptions() {
     std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
     bindingDescriptions[0].binding = 0;
@@ -112,6 +217,18 @@ namespace lhll {
     return attributeDescriptions;
   }
 
+  std::vector<VkVertexInputBindingDescription> LhllModel::Vertex::getPositionBindingDescriptions() {
+    std::vector<VkVertexInputBindingDescription> bindingDescriptions(1);
+    bindingDescriptions[0].binding = 0;
+    bindingDescriptions[0].stride = sizeof(glm::vec3);
+    bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    return bindingDescriptions;
+  }
+
+  std::vector<VkVertexInputAttributeDescription> LhllModel::Vertex::getPositionAttributeDescriptions() {
+    return {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0}};
+  }
+
   void LhllModel::Builder::loadModel(const std::string& filepath) {
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
@@ -3,11 +3,13 @@
 
 #include "lhll_device.hpp"
 #include "lhll_buffer.hpp"
+#include "lhll_geometry_pool.hpp"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -23,42 +25,85 @@ namespace lhll {
 
       static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
       static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
+      // the separate stream bound by bindPositions, location 0 is the position
+      static std::vector<VkVertexInputBindingDescription> getPositionBindingDescriptions();
+      static std::vector<VkVertexInputAttributeDescription> getPositionAttributeDescriptions();
 
       bool operator==(const Vertex& other) const {
         return (position == other.position) && (color == other.color) && (normal == other.normal) && (uv == other.uv);
       }
     };
 
+    // model space, axis aligned
+    struct BoundingBox {
+      glm::vec3 min{0.0f};
+      glm::vec3 max{0.0f};
+    };
+
     struct Builder {
       std::vector<Vertex> vertices{};
       std::vector<uint32_t> indices{};
+      // keeps CPU copies of the positions and indices in the model, needed by occluders
+      bool keepCpuGeometry = false;
 
       void loadModel(const std::string& filepath);
     };
 
-    LhllModel(LhllDevice& device, const LhllModel::Builder& builder);
+    // with a geometryPool the model lives in the pool's shared buffers instead of its own
+    LhllModel(LhllDevice& device, const LhllModel::Builder& builder, LhllGeometryPool* geometryPool = nullptr);
     ~LhllModel();
 
     LhllModel(const LhllModel&) = delete;
     LhllModel& operator=(const LhllModel&) = delete;
 
-    static std::unique_ptr<LhllModel> createModelFromFile(LhllDevice& device, const std::string& filepath);
+    static std::unique_ptr<LhllModel> createModelFromFile(LhllDevice& device, const std::string& filepath, LhllGeometryPool* geometryPool = nullptr, bool keepCpuGeometry = false);
 
     void bind(VkCommandBuffer commandBuffer);
-    void draw(VkCommandBuffer commandBuffer);
+    // only the positions, for depth only passes. draw works the same after either bind
+    void bindPositions(VkCommandBuffer commandBuffer);
+    // firstInstance offsets gl_InstanceIndex, used to index per instance data
+    void draw(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+    // models in the same pool can be drawn together from one indirect buffer after a single bind
+    LhllGeometryPool* getGeometryPool() const { return geometryPool; }
+    // never reused, unlike the address of a destroyed model, so it can identify the model in caches
+    uint64_t getGeneration() const { return generation; }
+    VkDrawIndexedIndirectCommand indirectCommand(uint32_t instanceCount, uint32_t firstInstance) const;
+
+    const BoundingBox& getBoundingBox() const { return boundingBox; }
+    // model space, xyz is the center and w the radius
+    glm::vec4 getBoundingSphere() const { return boundingSphere; }
+    // CPU copies of the geometry, triangle list indices even when the model is drawn without them.
+    // Empty unless the model was built with keepCpuGeometry
+    bool hasCpuGeometry() const { return !positions.empty(); }
+    const std::vector<glm::vec3>& getPositions() const { return positions; }
+    const std::vector<uint32_t>& getIndices() const { return indices; }
 
   private:
+    void computeBounds(const std::vector<Vertex> &vertices);
     void createVertexBuffers(const std::vector<Vertex> &vertices);
+    void createPositionBuffer(const std::vector<glm::vec3> &positions);
     void createIndexBuffers(const std::vector<uint32_t> &indices);
 
     LhllDevice& lhllDevice;
+    uint64_t generation;
 
     std::unique_ptr<LhllBuffer> vertexBuffer;
     uint32_t vertexCount;
+    // positions of vertexBuffer split out, so depth only passes fetch 12 instead of 44 bytes a vertex
+    std::unique_ptr<LhllBuffer> positionBuffer;
 
     bool hasIndexBuffer = false;
     std::unique_ptr<LhllBuffer> indexBuffer;
     uint32_t indexCount;
+
+    BoundingBox boundingBox{};
+    glm::vec4 boundingSphere{0.0f};
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+
+    LhllGeometryPool* geometryPool = nullptr;
+    LhllGeometryPool::Allocation geometryAllocation{};
   };
 }
 
@@ -0,0 +1,97 @@
+#include "lhll_object_table.hpp"
+
+#include "lhll_swap_chain.hpp"
+
+#include <cassert>
+
+namespace lhll {
+  LhllObjectTable::LhllObjectTable(LhllDevice& device, uint32_t initialCapacity) : lhllDevice{device} {
+    frameBuffers.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    frameVersions.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (auto& buffer : frameBuffers) {
+      LhllBuffer::reserve(buffer, lhllDevice, sizeof(ObjectData), initialCapacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    }
+  }
+
+  void LhllObjectTable::beginFrame(int frameIndex) {
+    this->frameIndex = frameIndex;
+    frameCounter++;
+  }
+
+  uint32_t LhllObjectTable::update(LhllGameObject& obj) {
+    auto it = slotsById.find(obj.getId());
+    if (it == slotsById.end()) {
+      uint32_t slotIndex;
+      if (!freeSlots.empty()) {
+        slotIndex = freeSlots.back();
+        freeSlots.pop_back();
+      }
+      else {
+        slotIndex = static_cast<uint32_t>(slots.size());
+        slots.emplace_back();
+      }
+      slots[slotIndex] = {obj.transform, obj.model->getGeneration(), obj.renderState, nextVersion++, frameCounter, true};
+      slotsById.emplace(obj.getId(), slotIndex);
+      sceneVersion++;
+      return slotIndex;
+    }
+
+    auto& slot = slots[it->second];
+    if (!(slot.transform == obj.transform)) {
+      slot.transform = obj.transform;
+      slot.version = nextVersion++;
+      sceneVersion++;
+    }
+    if (slot.modelGeneration != obj.model->getGeneration() || !(slot.renderState == obj.renderState)) {
+      slot.modelGeneration = obj.model->getGeneration();
+      slot.renderState = obj.renderState;
+      sceneVersion++;
+    }
+    slot.lastUpdatedFrame = frameCounter;
+    return it->second;
+  }
+
+  bool LhllObjectTable::endFrame() {
+    for (auto it = slotsById.begin(); it != slotsById.end();) {
+      auto& slot = slots[it->second];
+      if (slot.lastUpdatedFrame != frameCounter) {
+        slot.used = false;
+        freeSlots.push_back(it->second);
+        sceneVersion++;
+        it = slotsById.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+
+    auto& versions = frameVersions[frameIndex];
+    bool replaced = LhllBuffer::reserve(frameBuffers[frameIndex], lhllDevice, sizeof(ObjectData), static_cast<uint32_t>(slots.size()), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    if (replaced) {
+      // the new copy holds nothing yet
+      versions.assign(versions.size(), 0);
+    }
+    versions.resize(slots.size(), 0);
+
+    auto& buffer = frameBuffers[frameIndex];
+    auto* objects = static_cast<ObjectData*>(buffer->getMappedMemory());
+    writtenCount = 0;
+    for (uint32_t i = 0; i < slots.size(); i++) {
+      auto& slot = slots[i];
+      if (!slot.used || versions[i] == slot.version) continue;
+
+      objects[i].modelMatrix = slot.transform.mat4();
+      glm::mat3 normalMatrix = slot.transform.normalMatrix();
+      for (int column = 0; column < 3; column++) {
+        objects[i].normalMatrix[column] = glm::vec4{normalMatrix[column], 0.0f};
+      }
+      versions[i] = slot.version;
+      writtenCount++;
+    }
+
+    if (writtenCount > 0) {
+      buffer->flush();
+    }
+    return replaced;
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef LHLL_OBJECT_TABLE_HPP
+#define LHLL_OBJECT_TABLE_HPP
+
+#include "lhll_buffer.hpp"
+#include "lhll_device.hpp"
+#include "lhll_game_object.hpp"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace lhll {
+  // Persistently mapped storage buffer with one entry per object, so instances only need the 4 byte
+  // index of their entry. Entries keep their slot while the object is updated every frame and are only
+  // rewritten when its transform changed. There is a copy per frame in flight, each catches up on the
+  // changes it missed when its frame is prepared
+  class LhllObjectTable {
+  public:
+    // std430 layout of ObjectData in the shaders, the mat3 columns are padded to vec4
+    struct ObjectData {
+      glm::mat4 modelMatrix{1.f};
+      glm::vec4 normalMatrix[3]{};
+    };
+
+    LhllObjectTable(LhllDevice& device, uint32_t initialCapacity);
+
+    LhllObjectTable(const LhllObjectTable&) = delete;
+    LhllObjectTable& operator=(const LhllObjectTable&) = delete;
+
+    void beginFrame(int frameIndex);
+    // returns the object's entry, valid as long as the object is updated every frame, it needs a model
+    uint32_t update(LhllGameObject& obj);
+    // Frees the entries of objects not updated since beginFrame and writes the changed ones to the
+    // frame's copy. Returns true when the copy was replaced and descriptors have to be rewritten
+    bool endFrame();
+
+    LhllBuffer& getBuffer(int frameIndex) { return *frameBuffers[frameIndex]; }
+    // entries written by the last endFrame
+    uint32_t getWrittenCount() const { return writtenCount; }
+    // changes when an object is added or freed or its transform, model or render state changed, what
+    // was drawn from the objects of an earlier frame with the same version can be drawn again
+    uint64_t getSceneVersion() const { return sceneVersion; }
+
+  private:
+    struct Slot {
+      TransformComponent transform;
+      // not written to the buffer, only compared for the scene version
+      uint64_t modelGeneration;
+      RenderState renderState;
+      // changes with every write to the slot, the frame copies compare it with what they hold
+      uint64_t version;
+      uint64_t lastUpdatedFrame;
+      bool used;
+    };
+
+    LhllDevice& lhllDevice;
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    std::unordered_map<LhllGameObject::id_t, uint32_t> slotsById;
+    uint64_t nextVersion = 1;
+    uint64_t sceneVersion = 1;
+
+    int frameIndex = 0;
+    uint64_t frameCounter = 0;
+    uint32_t writtenCount = 0;
+    std::vector<std::unique_ptr<LhllBuffer>> frameBuffers;
+    // [frameIndex][slot], version of the slot each copy holds
+    std::vector<std::vector<uint64_t>> frameVersions;
+  };
+}
+
+#endif
@@ -0,0 +1,233 @@
+#include "lhll_occlusion_rasterizer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <future>
+#include <utility>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define LHLL_RASTER_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LHLL_RASTER_SSE
+#endif
+
+namespace lhll {
+  // below this many rows per band a worker costs more than it saves
+  static constexpr uint32_t MIN_BAND_ROWS = 16;
+
+  LhllOcclusionRasterizer::LhllOcclusionRasterizer(uint32_t width, uint32_t height) : width{width}, height{height} {
+    assert(width > 0 && width % 8 == 0 && height > 0 && "Occlusion buffer width has to be a multiple of 8");
+    depth.resize(static_cast<size_t>(width) * height, 1.0f);
+  }
+
+  const char* LhllOcclusionRasterizer::simdName() {
+#if defined(LHLL_RASTER_AVX)
+    return "AVX";
+#elif defined(LHLL_RASTER_SSE)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+  }
+
+  void LhllOcclusionRasterizer::beginFrame(const glm::mat4& projectionView) {
+    this->projectionView = projectionView;
+    triangles.clear();
+  }
+
+  void LhllOcclusionRasterizer::addOccluder(const glm::mat4& modelMatrix, const glm::vec3* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount) {
+    glm::mat4 transform = projectionView * modelMatrix;
+    glm::vec2 screenSize{static_cast<float>(width), static_cast<float>(height)};
+
+    transformedVertices.resize(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; i++) {
+      glm::vec4 clip = transform * glm::vec4{positions[i], 1.0f};
+      if (clip.z < 0.0f || clip.w <= 0.0f) {
+        transformedVertices[i] = glm::vec4{0.0f, 0.0f, 0.0f, -1.0f};
+        continue;
+      }
+      glm::vec3 ndc = glm::vec3{clip} / clip.w;
+      // Vulkan's y points down like the rows
+      glm::vec2 screen = (glm::vec2{ndc} * 0.5f + 0.5f) * screenSize;
+      transformedVertices[i] = glm::vec4{screen, ndc.z, 1.0f};
+    }
+
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+      glm::vec4 v[3] = {transformedVertices[indices[i]], transformedVertices[indices[i + 1]], transformedVertices[indices[i + 2]]};
+      if (v[0].w < 0.0f || v[1].w < 0.0f || v[2].w < 0.0f) continue;
+
+      // both windings occlude, the edges are made positive inside
+      float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+      if (std::abs(area) < 1e-6f) continue;
+      if (area < 0.0f) {
+        std::swap(v[1], v[2]);
+        area = -area;
+      }
+
+      Triangle triangle{};
+      triangle.minX = std::max(0, static_cast<int>(std::floor(std::min({v[0].x, v[1].x, v[2].x}))));
+      triangle.minY = std::max(0, static_cast<int>(std::floor(std::min({v[0].y, v[1].y, v[2].y}))));
+      triangle.maxX = std::min(static_cast<int>(width), static_cast<int>(std::ceil(std::max({v[0].x, v[1].x, v[2].x}))));
+      triangle.maxY = std::min(static_cast<int>(height), static_cast<int>(std::ceil(std::max({v[0].y, v[1].y, v[2].y}))));
+      if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY) continue;
+
+      // edge i is opposite vertex i, and is the weight of vertex i times area
+      for (int edge = 0; edge < 3; edge++) {
+        const glm::vec4& a = v[(edge + 1) % 3];
+        const glm::vec4& b = v[(edge + 2) % 3];
+        triangle.edgeA[edge] = a.y - b.y;
+        triangle.edgeB[edge] = b.x - a.x;
+        triangle.edgeC[edge] = -(triangle.edgeA[edge] * a.x + triangle.edgeB[edge] * a.y);
+      }
+
+      // depth is affine in screen space, interpolated with the same weights
+      float inverseArea = 1.0f / area;
+      triangle.depthA = (triangle.edgeA[0] * v[0].z + triangle.edgeA[1] * v[1].z + triangle.edgeA[2] * v[2].z) * inverseArea;
+      triangle.depthB = (triangle.edgeB[0] * v[0].z + triangle.edgeB[1] * v[1].z + triangle.edgeB[2] * v[2].z) * inverseArea;
+      triangle.depthC = (triangle.edgeC[0] * v[0].z + triangle.edgeC[1] * v[1].z + triangle.edgeC[2] * v[2].z) * inverseArea;
+      triangles.push_back(triangle);
+    }
+  }
+
+  void LhllOcclusionRasterizer::rasterize(LhllThreadPool* threadPool) {
+    uint32_t bandCount = 1;
+    if (threadPool != nullptr) {
+      bandCount = std::max(1u, std::min(threadPool->getThreadCount() + 1, height / MIN_BAND_ROWS));
+    }
+
+    // every band only touches its own rows
+    std::vector<std::future<void>> workers;
+    workers.reserve(bandCount - 1);
+    for (uint32_t band = 1; band < bandCount; band++) {
+      int rowBegin = static_cast<int>(height * band / bandCount);
+      int rowEnd = static_cast<int>(height * (band + 1) / bandCount);
+      workers.push_back(threadPool->submit([this, rowBegin, rowEnd]() { rasterizeBand(rowBegin, rowEnd, true); }));
+    }
+    rasterizeBand(0, static_cast<int>(height / bandCount), true);
+    for (auto& worker : workers) {
+      worker.get();
+    }
+  }
+
+  void LhllOcclusionRasterizer::rasterizeScalar() {
+    rasterizeBand(0, static_cast<int>(height), false);
+  }
+
+  // a pixel is covered when its center is inside all three edges, the SIMD paths compute the same
+  // values in the same order so both give the same buffer
+  void LhllOcclusionRasterizer::rasterizeBand(int rowBegin, int rowEnd, bool useSimd) {
+    std::fill(depth.begin() + static_cast<size_t>(rowBegin) * width, depth.begin() + static_cast<size_t>(rowEnd) * width, 1.0f);
+
+    for (const auto& triangle : triangles) {
+      int rowFirst = std::max(triangle.minY, rowBegin);
+      int rowLast = std::min(triangle.maxY, rowEnd);
+
+      for (int y = rowFirst; y < rowLast; y++) {
+        float centerY = static_cast<float>(y) + 0.5f;
+        float edgeRow[3];
+        for (int edge = 0; edge < 3; edge++) {
+          edgeRow[edge] = triangle.edgeB[edge] * centerY + triangle.edgeC[edge];
+        }
+        float depthRow = triangle.depthB * centerY + triangle.depthC;
+        float* line = &depth[static_cast<size_t>(y) * width];
+        int x = triangle.minX;
+
+#if defined(LHLL_RASTER_AVX)
+        if (useSimd) {
+          // the width is a multiple of 8, so aligning the start down never leaves the row
+          const __m256 laneCenters = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+          const __m256 zero = _mm256_setzero_ps();
+          for (x &= ~7; x < triangle.maxX; x += 8) {
+            __m256 centerX = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneCenters);
+            __m256 inside = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.edgeA[0]), centerX), _mm256_set1_ps(edgeRow[0])), zero, _CMP_GE_OQ);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.edgeA[1]), centerX), _mm256_set1_ps(edgeRow[1])), zero, _CMP_GE_OQ));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.edgeA[2]), centerX), _mm256_set1_ps(edgeRow[2])), zero, _CMP_GE_OQ));
+            if (_mm256_movemask_ps(inside) == 0) continue;
+
+            __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.depthA), centerX), _mm256_set1_ps(depthRow));
+            __m256 current = _mm256_loadu_ps(line + x);
+            _mm256_storeu_ps(line + x, _mm256_blendv_ps(current, _mm256_min_ps(current, z), inside));
+          }
+          continue;
+        }
+#elif defined(LHLL_RASTER_SSE)
+        if (useSimd) {
+          const __m128 laneCenters = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+          const __m128 zero = _mm_setzero_ps();
+          for (x &= ~3; x < triangle.maxX; x += 4) {
+            __m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneCenters);
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edgeA[0]), centerX), _mm_set1_ps(edgeRow[0])), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edgeA[1]), centerX), _mm_set1_ps(edgeRow[1])), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edgeA[2]), centerX), _mm_set1_ps(edgeRow[2])), zero));
+            if (_mm_movemask_ps(inside) == 0) continue;
+
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.depthA), centerX), _mm_set1_ps(depthRow));
+            __m128 current = _mm_loadu_ps(line + x);
+            // SSE2 has no blend, the masked lanes keep the current depth
+            __m128 closer = _mm_min_ps(current, z);
+            _mm_storeu_ps(line + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, current)));
+          }
+          continue;
+        }
+#endif
+
+        for (; x < triangle.maxX; x++) {
+          float centerX = static_cast<float>(x) + 0.5f;
+          bool inside = triangle.edgeA[0] * centerX + edgeRow[0] >= 0.0f && triangle.edgeA[1] * centerX + edgeRow[1] >= 0.0f && triangle.edgeA[2] * centerX + edgeRow[2] >= 0.0f;
+          if (!inside) continue;
+          float z = triangle.depthA * centerX + depthRow;
+          line[x] = std::min(line[x], z);
+        }
+      }
+    }
+  }
+
+  // Bounds like occlusion_cull.comp, the corners of the sphere's box. Anything the buffer cannot
+  // judge, crossing the near plane or off screen, counts as visible
+  bool LhllOcclusionRasterizer::isVisible(const glm::vec3& center, float radius) const {
+    glm::vec2 screenSize{static_cast<float>(width), static_cast<float>(height)};
+    glm::vec2 minScreen{screenSize};
+    glm::vec2 maxScreen{0.0f};
+    float nearestDepth = 1.0f;
+    for (int i = 0; i < 8; i++) {
+      glm::vec3 offset{(i & 1) != 0 ? radius : -radius, (i & 2) != 0 ? radius : -radius, (i & 4) != 0 ? radius : -radius};
+      glm::vec4 clip = projectionView * glm::vec4{center + offset, 1.0f};
+      if (clip.z < 0.0f || clip.w <= 0.0f) return true;
+
+      glm::vec3 ndc = glm::vec3{clip} / clip.w;
+      glm::vec2 screen = (glm::vec2{ndc} * 0.5f + 0.5f) * screenSize;
+      minScreen = glm::min(minScreen, screen);
+      maxScreen = glm::max(maxScreen, screen);
+      nearestDepth = std::min(nearestDepth, ndc.z);
+    }
+
+    int minX = std::max(0, static_cast<int>(std::floor(minScreen.x)));
+    int minY = std::max(0, static_cast<int>(std::floor(minScreen.y)));
+    int maxX = std::min(static_cast<int>(width), static_cast<int>(std::ceil(maxScreen.x)));
+    int maxY = std::min(static_cast<int>(height), static_cast<int>(std::ceil(maxScreen.y)));
+    if (minX >= maxX || minY >= maxY) return true;
+
+    for (int y = minY; y < maxY; y++) {
+      const float* line = &depth[static_cast<size_t>(y) * width];
+      int x = minX;
+#if defined(LHLL_RASTER_AVX)
+      const __m256 nearest = _mm256_set1_ps(nearestDepth);
+      for (; x + 8 <= maxX; x += 8) {
+        if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(line + x), nearest, _CMP_GE_OQ)) != 0) return true;
+      }
+#elif defined(LHLL_RASTER_SSE)
+      const __m128 nearest = _mm_set1_ps(nearestDepth);
+      for (; x + 4 <= maxX; x += 4) {
+        if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(line + x), nearest)) != 0) return true;
+      }
+#endif
+      for (; x < maxX; x++) {
+        if (line[x] >= nearestDepth) return true;
+      }
+    }
+    return false;
+  }
+}
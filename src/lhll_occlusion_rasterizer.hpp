@@ -0,0 +1,77 @@
+#ifndef LHLL_OCCLUSION_RASTERIZER_HPP
+#define LHLL_OCCLUSION_RASTERIZER_HPP
+
+#include "lhll_thread_pool.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace lhll {
+  // Software depth buffer for occlusion culling without the GPU. A few occluder meshes are rasterized
+  // into a small depth buffer, 8 (AVX) or 4 (SSE) pixels at a time with the writes masked by the edge
+  // tests, and the rows are split into bands rasterized on several threads. Bounding spheres are then
+  // occluded when their nearest depth is behind everything in the pixels they cover. Depth is NDC z of
+  // the projectionView given to beginFrame, 0 at the near plane
+  class LhllOcclusionRasterizer {
+  public:
+    // width has to be a multiple of 8
+    LhllOcclusionRasterizer(uint32_t width = 256, uint32_t height = 128);
+
+    LhllOcclusionRasterizer(const LhllOcclusionRasterizer&) = delete;
+    LhllOcclusionRasterizer& operator=(const LhllOcclusionRasterizer&) = delete;
+
+    // drops the occluders of the last frame
+    void beginFrame(const glm::mat4& projectionView);
+    // Transforms and sets up the triangles of a mesh. Triangles crossing the near plane are left out,
+    // which only makes the buffer less occluding
+    void addOccluder(const glm::mat4& modelMatrix, const glm::vec3* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount);
+    // clears the buffer and draws the occluders, on the pool's workers too when one is given
+    void rasterize(LhllThreadPool* threadPool = nullptr);
+    // the same one pixel at a time on the calling thread, as reference for rasterize
+    void rasterizeScalar();
+
+    // false when the sphere is behind the occluders in every pixel its bounds cover
+    bool isVisible(const glm::vec3& center, float radius) const;
+
+    uint32_t getWidth() const { return width; }
+    uint32_t getHeight() const { return height; }
+    size_t getTriangleCount() const { return triangles.size(); }
+    const std::vector<float>& getDepth() const { return depth; }
+
+    // name of the instruction set rasterize and isVisible use, decided at compile time
+    static const char* simdName();
+
+  private:
+    // edge functions and depth plane in pixel coordinates, all three edges are >= 0 inside
+    struct Triangle {
+      float edgeA[3];
+      float edgeB[3];
+      float edgeC[3];
+      float depthA;
+      float depthB;
+      float depthC;
+      // pixel bounds, end exclusive
+      int minX;
+      int minY;
+      int maxX;
+      int maxY;
+    };
+
+    void rasterizeBand(int rowBegin, int rowEnd, bool useSimd);
+
+    uint32_t width;
+    uint32_t height;
+    glm::mat4 projectionView{1.0f};
+    std::vector<float> depth;
+    std::vector<Triangle> triangles;
+    // screen space x, y and depth of the occluder being added, w < 0 when in front of the near plane
+    std::vector<glm::vec4> transformedVertices;
+  };
+}
+
+#endif
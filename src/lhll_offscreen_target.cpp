@@ -0,0 +1,144 @@
+#include "lhll_offscreen_target.hpp"
+
+#include "lhll_timeline.hpp"
+
+#include <array>
+#include <cassert>
+#include <stdexcept>
+
+namespace lhll {
+  LhllOffscreenTarget::LhllOffscreenTarget(LhllDevice& device, VkExtent2D extent, const FramePacingConfig& config)
+      : lhllDevice{device}, extent{extent}, framesInFlight{config.framesInFlight} {
+    assert(framesInFlight >= 1 && framesInFlight <= LhllSwapChain::MAX_FRAMES_IN_FLIGHT && "frames in flight out of range");
+
+    // the formats a swap chain would most likely have, so the pipelines behave the same
+    colorFormat = lhllDevice.findSupportedFormat(
+        {VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB},
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT);
+    depthFormat = LhllSwapChain::findDepthFormat(lhllDevice);
+
+    LhllSwapChain::createRenderPasses(lhllDevice, colorFormat, depthFormat, renderPass, loadRenderPass);
+    createImages();
+    createFramebuffers();
+  }
+
+  LhllOffscreenTarget::~LhllOffscreenTarget() {
+    for (auto framebuffer : framebuffers) {
+      vkDestroyFramebuffer(lhllDevice.device(), framebuffer, nullptr);
+    }
+
+    for (size_t i = 0; i < colorImages.size(); i++) {
+      vkDestroyImageView(lhllDevice.device(), colorImageViews[i], nullptr);
+      vkDestroyImage(lhllDevice.device(), colorImages[i], nullptr);
+      vkFreeMemory(lhllDevice.device(), colorImageMemorys[i], nullptr);
+      vkDestroyImageView(lhllDevice.device(), depthImageViews[i], nullptr);
+      vkDestroyImage(lhllDevice.device(), depthImages[i], nullptr);
+      vkFreeMemory(lhllDevice.device(), depthImageMemorys[i], nullptr);
+    }
+
+    vkDestroyRenderPass(lhllDevice.device(), renderPass, nullptr);
+    vkDestroyRenderPass(lhllDevice.device(), loadRenderPass, nullptr);
+  }
+
+  VkImageAspectFlags LhllOffscreenTarget::getDepthAspectMask() const {
+    return LhllSwapChain::depthAspectMask(depthFormat);
+  }
+
+  VkResult LhllOffscreenTarget::acquireNextImage(uint32_t* imageIndex) {
+    *imageIndex = currentFrame;
+    return VK_SUCCESS;
+  }
+
+  VkResult LhllOffscreenTarget::submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex, uint64_t frameNumber) {
+    VkSemaphore timeline = lhllDevice.graphicsTimeline().getSemaphore();
+
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &frameNumber;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = buffers;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &timeline;
+
+    VkResult result = vkQueueSubmit(lhllDevice.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE);
+
+    currentFrame = (currentFrame + 1) % framesInFlight;
+    return result;
+  }
+
+  void LhllOffscreenTarget::createImages() {
+    colorImages.resize(framesInFlight);
+    colorImageMemorys.resize(framesInFlight);
+    colorImageViews.resize(framesInFlight);
+    depthImages.resize(framesInFlight);
+    depthImageMemorys.resize(framesInFlight);
+    depthImageViews.resize(framesInFlight);
+
+    for (size_t i = 0; i < colorImages.size(); i++) {
+      // a transfer source, so the frame can be read back
+      createImage(colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT, colorImages[i], colorImageMemorys[i], colorImageViews[i]);
+      // sampled by the depth pyramid, as the swap chain's
+      createImage(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, depthImages[i], depthImageMemorys[i], depthImageViews[i]);
+    }
+  }
+
+  void LhllOffscreenTarget::createImage(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkImage& image, VkDeviceMemory& memory, VkImageView& view) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = extent.width;
+    imageInfo.extent.height = extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = usage;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    lhllDevice.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange.aspectMask = aspect;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(lhllDevice.device(), &viewInfo, nullptr, &view) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create offscreen image view!");
+    }
+  }
+
+  void LhllOffscreenTarget::createFramebuffers() {
+    framebuffers.resize(colorImages.size());
+    for (size_t i = 0; i < framebuffers.size(); i++) {
+      std::array<VkImageView, 2> attachments = {colorImageViews[i], depthImageViews[i]};
+
+      VkFramebufferCreateInfo framebufferInfo{};
+      framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      framebufferInfo.renderPass = renderPass;
+      framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+      framebufferInfo.pAttachments = attachments.data();
+      framebufferInfo.width = extent.width;
+      framebufferInfo.height = extent.height;
+      framebufferInfo.layers = 1;
+
+      if (vkCreateFramebuffer(lhllDevice.device(), &framebufferInfo, nullptr, &framebuffers[i]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create offscreen framebuffer!");
+      }
+    }
+  }
+}
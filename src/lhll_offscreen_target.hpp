@@ -0,0 +1,70 @@
+#ifndef LHLL_OFFSCREEN_TARGET_HPP
+#define LHLL_OFFSCREEN_TARGET_HPP
+
+#include "lhll_device.hpp"
+#include "lhll_swap_chain.hpp"
+
+#include <vector>
+
+namespace lhll {
+  // What LhllSwapChain is for a window without one: a color and a depth image per frame in flight and
+  // framebuffers for the same render passes. Nothing is presented, frame slot i always renders into
+  // image i, which is left to be read back
+  class LhllOffscreenTarget {
+  public:
+    // only framesInFlight of the config applies, there is an image for every frame in flight
+    LhllOffscreenTarget(LhllDevice& device, VkExtent2D extent, const FramePacingConfig& config = {});
+    ~LhllOffscreenTarget();
+
+    LhllOffscreenTarget(const LhllOffscreenTarget&) = delete;
+    LhllOffscreenTarget& operator=(const LhllOffscreenTarget&) = delete;
+
+    VkFramebuffer getFrameBuffer(int index) const { return framebuffers[index]; }
+    VkRenderPass getRenderPass() const { return renderPass; }
+    VkRenderPass getLoadRenderPass() const { return loadRenderPass; }
+    // the layouts the render passes expect are the same as for the swap chain
+    VkImage getImage(int index) const { return colorImages[index]; }
+    VkImageView getImageView(int index) const { return colorImageViews[index]; }
+    VkImage getDepthImage(int index) const { return depthImages[index]; }
+    VkImageView getDepthImageView(int index) const { return depthImageViews[index]; }
+    VkImageAspectFlags getDepthAspectMask() const;
+    VkFormat getImageFormat() const { return colorFormat; }
+    VkExtent2D getExtent() const { return extent; }
+    int getFramesInFlight() const { return framesInFlight; }
+
+    float extentAspectRatio() const {
+      return static_cast<float>(extent.width) / static_cast<float>(extent.height);
+    }
+
+    // the image of the next frame slot, the caller waits for the frame that used the slot before
+    VkResult acquireNextImage(uint32_t* imageIndex);
+    // signals frameNumber on the device's graphics timeline when the frame finished
+    VkResult submitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* imageIndex, uint64_t frameNumber);
+
+  private:
+    void createImages();
+    void createFramebuffers();
+    void createImage(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkImage& image, VkDeviceMemory& memory, VkImageView& view);
+
+    LhllDevice& lhllDevice;
+    VkExtent2D extent;
+    int framesInFlight;
+    VkFormat colorFormat;
+    VkFormat depthFormat;
+
+    VkRenderPass renderPass;
+    VkRenderPass loadRenderPass;
+    std::vector<VkFramebuffer> framebuffers;
+
+    std::vector<VkImage> colorImages;
+    std::vector<VkDeviceMemory> colorImageMemorys;
+    std::vector<VkImageView> colorImageViews;
+    std::vector<VkImage> depthImages;
+    std::vector<VkDeviceMemory> depthImageMemorys;
+    std::vector<VkImageView> depthImageViews;
+
+    uint32_t currentFrame = 0;
+  };
+}
+
+#endif
@@ -0,0 +1,171 @@
+#include "lhll_parallel_recorder.hpp"
+
+#include "lhll_swap_chain.hpp"
+
+#include <cassert>
+#include <exception>
+#include <future>
+#include <stdexcept>
+
+namespace lhll {
+  LhllParallelRecorder::LhllParallelRecorder(LhllDevice& device, LhllThreadPool& threadPool) : lhllDevice{device}, lhllThreadPool{threadPool} {
+    uint32_t chunkCount = lhllThreadPool.getThreadCount() + 1;
+    QueueFamilyIndices queueFamilyIndices = lhllDevice.findPhysicalQueueFamilies();
+
+    chunkPools.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    recordedKeys.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    recordedChunkCounts.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT, 0);
+    recordedStats.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (auto& framePools : chunkPools) {
+      framePools.resize(chunkCount);
+      for (auto& chunkPool : framePools) {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        if (vkCreateCommandPool(lhllDevice.device(), &poolInfo, nullptr, &chunkPool.commandPool) != VK_SUCCESS) {
+          throw std::runtime_error("failed to create secondary command pool!");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandPool = chunkPool.commandPool;
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(lhllDevice.device(), &allocInfo, &chunkPool.commandBuffer) != VK_SUCCESS) {
+          throw std::runtime_error("failed to allocate secondary command buffer!");
+        }
+      }
+    }
+  }
+
+  LhllParallelRecorder::~LhllParallelRecorder() {
+    for (auto& framePools : chunkPools) {
+      for (auto& chunkPool : framePools) {
+        vkDestroyCommandPool(lhllDevice.device(), chunkPool.commandPool, nullptr);
+      }
+    }
+  }
+
+  void LhllParallelRecorder::recordSecondary(const ChunkPool& chunkPool, VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent, bool oneTimeSubmit, uint32_t chunkIndex, const std::function<void(VkCommandBuffer, uint32_t, FrameStats&)>& recordChunk) {
+    // the slot's previous frame was waited on, nothing recorded from this pool is still executing
+    vkResetCommandPool(lhllDevice.device(), chunkPool.commandPool, 0);
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    if (oneTimeSubmit) beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    if (vkBeginCommandBuffer(chunkPool.commandBuffer, &beginInfo) != VK_SUCCESS) {
+      throw std::runtime_error("failed to begin recording secondary command buffer!");
+    }
+
+    // dynamic state is not inherited from the primary
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    VkRect2D scissor{{0, 0}, extent};
+    vkCmdSetViewport(chunkPool.commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(chunkPool.commandBuffer, 0, 1, &scissor);
+
+    recordChunk(chunkPool.commandBuffer, chunkIndex, chunkStats[chunkIndex]);
+
+    if (vkEndCommandBuffer(chunkPool.commandBuffer) != VK_SUCCESS) {
+      throw std::runtime_error("failed to record secondary command buffer!");
+    }
+  }
+
+  void LhllParallelRecorder::record(
+      VkCommandBuffer primaryCommandBuffer,
+      int frameIndex,
+      const RenderPassTarget& target,
+      uint32_t chunkCount,
+      const std::function<void(VkCommandBuffer, uint32_t, FrameStats&)>& recordChunk,
+      const std::vector<uint64_t>& cacheKey,
+      FrameStats& stats) {
+    assert(chunkCount > 0 && chunkCount <= getMaxChunkCount() && "Chunk count exceeds the secondary command pools");
+    const auto& framePools = chunkPools[frameIndex];
+    bool cached = !cacheKey.empty();
+
+    if (cached && recordedKeys[frameIndex] == cacheKey && recordedChunkCounts[frameIndex] == chunkCount) {
+      stats.reusedCommandBuffers += chunkCount;
+    }
+    else {
+      chunkStats.assign(chunkCount, FrameStats{});
+      recordChunks(framePools, target.renderPass, cached ? VK_NULL_HANDLE : target.framebuffer, target.extent, !cached, chunkCount, recordChunk);
+      recordedKeys[frameIndex] = cacheKey;
+      recordedChunkCounts[frameIndex] = chunkCount;
+      recordedStats[frameIndex] = FrameStats{};
+      for (const auto& chunk : chunkStats) {
+        recordedStats[frameIndex] += chunk;
+      }
+    }
+    stats += recordedStats[frameIndex];
+    stats.secondaryCommandBuffers += chunkCount;
+
+    executeBuffers.resize(chunkCount);
+    for (uint32_t chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++) {
+      executeBuffers[chunkIndex] = framePools[chunkIndex].commandBuffer;
+    }
+    vkCmdExecuteCommands(primaryCommandBuffer, chunkCount, executeBuffers.data());
+  }
+
+  void LhllParallelRecorder::invalidate() {
+    for (auto& key : recordedKeys) {
+      key.clear();
+    }
+  }
+
+  void LhllParallelRecorder::recordChunks(
+      const std::vector<ChunkPool>& framePools,
+      VkRenderPass renderPass,
+      VkFramebuffer framebuffer,
+      VkExtent2D extent,
+      bool oneTimeSubmit,
+      uint32_t chunkCount,
+      const std::function<void(VkCommandBuffer, uint32_t, FrameStats&)>& recordChunk) {
+
+    std::vector<std::future<void>> workers;
+    workers.reserve(chunkCount - 1);
+    for (uint32_t chunkIndex = 1; chunkIndex < chunkCount; chunkIndex++) {
+      workers.push_back(lhllThreadPool.submit([&, chunkIndex]() {
+        recordSecondary(framePools[chunkIndex], renderPass, framebuffer, extent, oneTimeSubmit, chunkIndex, recordChunk);
+      }));
+    }
+
+    // the workers reference recordChunk, all of them have to finish before an error can propagate
+    std::exception_ptr error;
+    try {
+      recordSecondary(framePools[0], renderPass, framebuffer, extent, oneTimeSubmit, 0, recordChunk);
+    }
+    catch (...) {
+      error = std::current_exception();
+    }
+    for (auto& worker : workers) {
+      try {
+        worker.get();
+      }
+      catch (...) {
+        if (!error) error = std::current_exception();
+      }
+    }
+    if (error) {
+      // the buffers may be partly recorded
+      invalidate();
+      std::rethrow_exception(error);
+    }
+  }
+}
@@ -0,0 +1,79 @@
+#ifndef LHLL_PARALLEL_RECORDER_HPP
+#define LHLL_PARALLEL_RECORDER_HPP
+
+#include "lhll_device.hpp"
+#include "lhll_frame_info.hpp"
+#include "lhll_thread_pool.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace lhll {
+  // Records the contents of a render pass as several secondary command buffers at once. Every chunk
+  // index has its own command pool per frame in flight, so a chunk is only ever recorded by one
+  // thread and its pool can be reset once the slot's previous frame was waited on. The buffers of a
+  // frame can be kept and executed again as long as the caller's key of what they contain stays the
+  // same
+  class LhllParallelRecorder {
+  public:
+    LhllParallelRecorder(LhllDevice& device, LhllThreadPool& threadPool);
+    ~LhllParallelRecorder();
+
+    LhllParallelRecorder(const LhllParallelRecorder&) = delete;
+    LhllParallelRecorder& operator=(const LhllParallelRecorder&) = delete;
+
+    // the calling thread records the first chunk, the workers the rest
+    uint32_t getMaxChunkCount() const { return static_cast<uint32_t>(chunkPools[0].size()); }
+
+    // The render pass of target has to be begun on primaryCommandBuffer with
+    // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. recordChunk is called concurrently once per
+    // chunk index with a secondary command buffer that already has the viewport and scissor set and
+    // stats of its own, the buffers are then executed in chunk order and the stats added to stats.
+    // With a cacheKey the buffers are only recorded when the key or chunk count differs from the last
+    // record for this frame index, and they do not reference the framebuffer. The key is the
+    // generations of whatever the buffers reference, compared as a whole, empty to always record.
+    // Reused buffers add the stats counted when they were recorded
+    void record(
+        VkCommandBuffer primaryCommandBuffer,
+        int frameIndex,
+        const RenderPassTarget& target,
+        uint32_t chunkCount,
+        const std::function<void(VkCommandBuffer, uint32_t, FrameStats&)>& recordChunk,
+        const std::vector<uint64_t>& cacheKey,
+        FrameStats& stats);
+
+  private:
+    struct ChunkPool {
+      VkCommandPool commandPool;
+      VkCommandBuffer commandBuffer;
+    };
+
+    void recordChunks(
+        const std::vector<ChunkPool>& framePools,
+        VkRenderPass renderPass,
+        VkFramebuffer framebuffer,
+        VkExtent2D extent,
+        bool oneTimeSubmit,
+        uint32_t chunkCount,
+        const std::function<void(VkCommandBuffer, uint32_t, FrameStats&)>& recordChunk);
+    void recordSecondary(const ChunkPool& chunkPool, VkRenderPass renderPass, VkFramebuffer framebuffer, VkExtent2D extent, bool oneTimeSubmit, uint32_t chunkIndex, const std::function<void(VkCommandBuffer, uint32_t, FrameStats&)>& recordChunk);
+    // the next record of every frame index records again
+    void invalidate();
+
+    LhllDevice& lhllDevice;
+    LhllThreadPool& lhllThreadPool;
+
+    // [frameIndex][chunkIndex]
+    std::vector<std::vector<ChunkPool>> chunkPools;
+    // what the buffers of each frame index hold, an empty key is never reused
+    std::vector<std::vector<uint64_t>> recordedKeys;
+    std::vector<uint32_t> recordedChunkCounts;
+    // what recording counted, added again when the buffers are reused
+    std::vector<FrameStats> recordedStats;
+    // each thread counts into its own stats
+    std::vector<FrameStats> chunkStats;
+    std::vector<VkCommandBuffer> executeBuffers;
+  };
+}
+
+#endif
@@ -1,55 +1,44 @@
-#ifndef ENGINE_DIR
-#define ENGINE_DIR "../"
-#endif
-
 #include "lhll_pipeline.hpp"
 
+#include "lhll_deletion_queue.hpp"
 #include "lhll_model.hpp"
 
-#include <fstream>
+#include <atomic>
 #include <stdexcept>
 #include <cassert>
 
 #include <iostream>
 
 namespace lhll {
-  LhllPipeline::LhllPipeline(LhllDevice& device, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo)
-  : lhllDevice{device} {
-    createGraphicsPipeline(vertFilepath, fragFilepath, configInfo);
-  }
+  static std::atomic<uint64_t> nextPipelineGeneration{1};
 
-  LhllPipeline::~LhllPipeline() {
-    vkDestroyShaderModule(lhllDevice.device(), vertShaderModule, nullptr);
-    vkDestroyShaderModule(lhllDevice.device(), fragShaderModule, nullptr);
-    vkDestroyPipeline(lhllDevice.device(), graphicsPipeline, nullptr);
+  LhllPipeline::LhllPipeline(LhllDevice& device, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const PipelineConfigInfo& configInfo)
+  : lhllDevice{device}, generation{nextPipelineGeneration++} {
+    createGraphicsPipeline(vertShaderModule, fragShaderModule, configInfo);
   }
 
-  std::vector<char> LhllPipeline::readFile(const std::string& filepath) {
-    std::ifstream file {ENGINE_DIR + filepath, std::ios::ate | std::ios::binary};
-
-    if (!file.is_open()) {
-      throw std::runtime_error("Failed to open file: " + filepath);
-    }
-
-    size_t fileSize = static_cast<size_t>(file.tellg());
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-    file.close();
-
-    return buffer;
+  LhllPipeline::~LhllPipeline() {
+    // command buffers of frames in flight may still bind it
+    VkDevice device = lhllDevice.device();
+    VkPipeline pipeline = graphicsPipeline;
+    lhllDevice.deletionQueue().retire([device, pipeline]() { vkDestroyPipeline(device, pipeline, nullptr); });
   }
 
-  void LhllPipeline::createGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo) {
+  void LhllPipeline::createGraphicsPipeline(VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const PipelineConfigInfo& configInfo) {
     assert(configInfo.pipelineLayout != VK_NULL_HANDLE && "Cannot create graphics pipeline: no pipelineLayout provided in configInfo");
     assert(configInfo.renderPass != VK_NULL_HANDLE && "Cannot create graphics pipeline: no renderPass provided in configInfo");
 
-    auto vertCode = readFile(vertFilepath);
-    auto fragCode = readFile(fragFilepath);
+    VkSpecializationInfo vertSpecializationInfo{};
+    vertSpecializationInfo.mapEntryCount = static_cast<uint32_t>(configInfo.vertSpecialization.mapEntries.size());
+    vertSpecializationInfo.pMapEntries = configInfo.vertSpecialization.mapEntries.data();
+    vertSpecializationInfo.dataSize = configInfo.vertSpecialization.data.size();
+    vertSpecializationInfo.pData = configInfo.vertSpecialization.data.data();
 
-    createShaderModule(vertCode, &vertShaderModule);
-    createShaderModule(fragCode, &fragShaderModule);
+    VkSpecializationInfo fragSpecializationInfo{};
+    fragSpecializationInfo.mapEntryCount = static_cast<uint32_t>(configInfo.fragSpecialization.mapEntries.size());
+    fragSpecializationInfo.pMapEntries = configInfo.fragSpecialization.mapEntries.data();
+    fragSpecializationInfo.dataSize = configInfo.fragSpecialization.data.size();
+    fragSpecializationInfo.pData = configInfo.fragSpecialization.data.data();
 
     VkPipelineShaderStageCreateInfo shaderStages[2];
     shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -58,7 +47,7 @@ namespace lhll {
     shaderStages[0].pName = "main";
     shaderStages[0].flags = 0;
     shaderStages[0].pNext = nullptr;
-    shaderStages[0].pSpecializationInfo = nullptr;
+    shaderStages[0].pSpecializationInfo = configInfo.vertSpecialization.empty() ? nullptr : &vertSpecializationInfo;
 
     shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
@@ -66,10 +55,10 @@ namespace lhll {
     shaderStages[1].pName = "main";
     shaderStages[1].flags = 0;
     shaderStages[1].pNext = nullptr;
-    shaderStages[1].pSpecializationInfo = nullptr;
+    shaderStages[1].pSpecializationInfo = configInfo.fragSpecialization.empty() ? nullptr : &fragSpecializationInfo;
 
-    auto bindingDescriptions = LhllModel::Vertex::getBindingDescriptions();
-    auto attributeDescriptions = LhllModel::Vertex::getAttributeDescriptions();
+    const auto& bindingDescriptions = configInfo.bindingDescriptions;
+    const auto& attributeDescriptions = configInfo.attributeDescriptions;
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
     vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
@@ -94,22 +83,15 @@ namespace lhll {
     pipelineInfo.renderPass = configInfo.renderPass;
     pipelineInfo.subpass = configInfo.subpass;
 
+    pipelineInfo.flags = configInfo.flags;
     pipelineInfo.basePipelineIndex = -1;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-
-    if (vkCreateGraphicsPipelines(lhllDevice.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-      throw std::runtime_error("faild to create graphics pipeline");
+    pipelineInfo.basePipelineHandle = configInfo.basePipelineHandle;
+    if (configInfo.basePipelineHandle != VK_NULL_HANDLE) {
+      pipelineInfo.flags |= VK_PIPELINE_CREATE_DERIVATIVE_BIT;
     }
-  }
 
-  void LhllPipeline::createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule) {
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-    if (vkCreateShaderModule(lhllDevice.device(), &createInfo, nullptr, shaderModule) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create shader module");
+    if (vkCreateGraphicsPipelines(lhllDevice.device(), lhllDevice.pipelineCache(), 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+      throw std::runtime_error("faild to create graphics pipeline");
     }
   }
 
@@ -118,6 +100,9 @@ namespace lhll {
   }
 
   void LhllPipeline::defaultPipelineConfigInfo(PipelineConfigInfo& configInfo) {
+    configInfo.bindingDescriptions = LhllModel::Vertex::getBindingDescriptions();
+    configInfo.attributeDescriptions = LhllModel::Vertex::getAttributeDescriptions();
+
     configInfo.inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     configInfo.inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     configInfo.inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
@@ -183,6 +168,30 @@ namespace lhll {
     configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
     configInfo.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
     configInfo.dynamicStateInfo.flags = 0;
+
+    configInfo.flags = 0;
+    configInfo.basePipelineHandle = VK_NULL_HANDLE;
+  }
+
+  void LhllPipeline::enableExtendedDynamicState(PipelineConfigInfo& configInfo, const OptionalDeviceFeatures& features) {
+    if (features.extendedDynamicState) {
+      configInfo.dynamicStateEnables.insert(configInfo.dynamicStateEnables.end(), {
+        VK_DYNAMIC_STATE_CULL_MODE_EXT,
+        VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+        VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT,
+        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+        VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT});
+    }
+    if (features.extendedDynamicState2) {
+      configInfo.dynamicStateEnables.insert(configInfo.dynamicStateEnables.end(), {
+        VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE_EXT,
+        VK_DYNAMIC_STATE_DEPTH_BIAS,
+        VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE_EXT});
+    }
+
+    configInfo.dynamicStateInfo.pDynamicStates = configInfo.dynamicStateEnables.data();
+    configInfo.dynamicStateInfo.dynamicStateCount = static_cast<uint32_t>(configInfo.dynamicStateEnables.size());
   }
 
 }
@@ -3,14 +3,43 @@
 
 #include "lhll_device.hpp"
 
+#include <cassert>
+#include <cstring>
 #include <string>
 #include <vector>
 
 namespace lhll {
+  // Per stage specialization constants, set with the same constant_id the shader declares
+  struct SpecializationConstants {
+    std::vector<VkSpecializationMapEntry> mapEntries;
+    std::vector<uint8_t> data;
+
+    // bools have to be passed as VkBool32
+    template <typename T>
+    void set(uint32_t constantID, const T& value) {
+      for (auto& entry : mapEntries) {
+        if (entry.constantID == constantID) {
+          assert(entry.size == sizeof(T) && "Specialization constant set again with a different size");
+          std::memcpy(data.data() + entry.offset, &value, sizeof(T));
+          return;
+        }
+      }
+      mapEntries.push_back({constantID, static_cast<uint32_t>(data.size()), sizeof(T)});
+      data.resize(data.size() + sizeof(T));
+      std::memcpy(data.data() + mapEntries.back().offset, &value, sizeof(T));
+    }
+
+    bool empty() const { return mapEntries.empty(); }
+  };
+
   struct PipelineConfigInfo {
+    PipelineConfigInfo() = default;
     PipelineConfigInfo(const PipelineConfigInfo&) = delete;
     PipelineConfigInfo& operator=(const PipelineConfigInfo&) = delete;
 
+    // defaultPipelineConfigInfo sets the interleaved LhllModel::Vertex layout
+    std::vector<VkVertexInputBindingDescription> bindingDescriptions{};
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
     VkPipelineViewportStateCreateInfo viewportInfo;
     VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
     VkPipelineRasterizationStateCreateInfo rasterizationInfo;
@@ -23,12 +52,17 @@ namespace lhll {
     VkPipelineLayout pipelineLayout = nullptr;
     VkRenderPass renderPass = nullptr;
     uint32_t subpass = 0;
+    VkPipelineCreateFlags flags = 0;
+    VkPipeline basePipelineHandle = VK_NULL_HANDLE;
+    SpecializationConstants vertSpecialization;
+    SpecializationConstants fragSpecialization;
   };
 
 
   class LhllPipeline {
   public:
-    LhllPipeline(LhllDevice& device, const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo);
+    // the modules are only used during creation and can be destroyed right after
+    LhllPipeline(LhllDevice& device, VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const PipelineConfigInfo& configInfo);
     ~LhllPipeline();
 
     LhllPipeline() = default;
@@ -36,19 +70,23 @@ namespace lhll {
     void operator=(const LhllPipeline&) = delete;
 
     void bind(VkCommandBuffer commandBuffer);
+    VkPipeline getHandle() const { return graphicsPipeline; }
+    // unique per pipeline, a pipeline created after this one was destroyed can get its handle
+    uint64_t getGeneration() const { return generation; }
     static void defaultPipelineConfigInfo(PipelineConfigInfo& configInfo);
+    // Moves cull mode, front face, topology and depth state (plus depth bias and primitive restart with
+    // extended dynamic state 2) out of the pipeline, so one pipeline covers all of those variants.
+    // Does nothing for features the device does not have, the static values are used then.
+    // Extended dynamic state 3 is not used: it only adds blend, polygon mode and multisample state,
+    // none of which RenderState varies per object
+    static void enableExtendedDynamicState(PipelineConfigInfo& configInfo, const OptionalDeviceFeatures& features);
 
   private:
-    static std::vector<char> readFile(const std::string& filepath);
-
-    void createGraphicsPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo);
-
-    void createShaderModule(const std::vector<char>& code, VkShaderModule* shaderModule);
+    void createGraphicsPipeline(VkShaderModule vertShaderModule, VkShaderModule fragShaderModule, const PipelineConfigInfo& configInfo);
 
     LhllDevice& lhllDevice;
     VkPipeline graphicsPipeline;
-    VkShaderModule vertShaderModule;
-    VkShaderModule fragShaderModule;
+    uint64_t generation;
   };
 }
 
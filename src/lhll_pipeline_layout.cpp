@@ -0,0 +1,26 @@
+#include "lhll_pipeline_layout.hpp"
+
+#include <atomic>
+#include <stdexcept>
+
+namespace lhll {
+  static std::atomic<uint64_t> nextPipelineLayoutGeneration{1};
+
+  LhllPipelineLayout::LhllPipelineLayout(LhllDevice& device, const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges)
+  : lhllDevice{device}, generation{nextPipelineLayoutGeneration++} {
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+    pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+    if (vkCreatePipelineLayout(lhllDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create pipeline layout!");
+    }
+  }
+
+  LhllPipelineLayout::~LhllPipelineLayout() {
+    vkDestroyPipelineLayout(lhllDevice.device(), pipelineLayout, nullptr);
+  }
+}
@@ -0,0 +1,30 @@
+#ifndef LHLL_PIPELINE_LAYOUT_HPP
+#define LHLL_PIPELINE_LAYOUT_HPP
+
+#include "lhll_device.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace lhll {
+  // Owns a VkPipelineLayout together with a generation id that is never reused, the pipeline
+  // registry keys on the id because a new layout can get the handle of one destroyed before
+  class LhllPipelineLayout {
+  public:
+    LhllPipelineLayout(LhllDevice& device, const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges = {});
+    ~LhllPipelineLayout();
+
+    LhllPipelineLayout(const LhllPipelineLayout&) = delete;
+    LhllPipelineLayout& operator=(const LhllPipelineLayout&) = delete;
+
+    VkPipelineLayout getHandle() const { return pipelineLayout; }
+    uint64_t getGeneration() const { return generation; }
+
+  private:
+    LhllDevice& lhllDevice;
+    uint64_t generation;
+    VkPipelineLayout pipelineLayout;
+  };
+}
+
+#endif
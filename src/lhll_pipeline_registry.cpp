@@ -0,0 +1,431 @@
+#include "lhll_pipeline_registry.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+
+namespace lhll {
+  template <typename T>
+  static void appendKey(std::string& key, const T& value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    key.append(bytes, sizeof(T));
+  }
+
+  // the words themselves, so code with colliding hashes never shares an entry
+  static void appendKey(std::string& key, const LhllShaderCode& code) {
+    appendKey(key, static_cast<uint64_t>(code.words.size()));
+    key.append(reinterpret_cast<const char*>(code.words.data()), code.words.size() * sizeof(uint32_t));
+  }
+
+  static void appendKey(std::string& key, const SpecializationConstants& specialization) {
+    appendKey(key, static_cast<uint32_t>(specialization.mapEntries.size()));
+    for (const auto& entry : specialization.mapEntries) {
+      appendKey(key, entry.constantID);
+      appendKey(key, entry.offset);
+      appendKey(key, static_cast<uint64_t>(entry.size));
+    }
+    appendKey(key, static_cast<uint64_t>(specialization.data.size()));
+    key.append(reinterpret_cast<const char*>(specialization.data.data()), specialization.data.size());
+  }
+
+  // Keeps the modules of one pipeline acquired from the shader cache while it compiles, shared by
+  // every job of a batch that uses the same shaders
+  class ShaderStageModules {
+  public:
+    ShaderStageModules(LhllShaderCache& shaderCache, std::shared_ptr<const LhllShaderCode> vert, std::shared_ptr<const LhllShaderCode> frag)
+    : shaderCache{shaderCache}, vertCode{std::move(vert)}, fragCode{std::move(frag)} {
+      vertModule = shaderCache.acquireModule(*vertCode);
+      try {
+        fragModule = shaderCache.acquireModule(*fragCode);
+      }
+      catch (...) {
+        shaderCache.releaseModule(*vertCode);
+        throw;
+      }
+    }
+
+    ~ShaderStageModules() {
+      shaderCache.releaseModule(*vertCode);
+      shaderCache.releaseModule(*fragCode);
+    }
+
+    ShaderStageModules(const ShaderStageModules&) = delete;
+    ShaderStageModules& operator=(const ShaderStageModules&) = delete;
+
+    VkShaderModule vertModule;
+    VkShaderModule fragModule;
+
+  private:
+    LhllShaderCache& shaderCache;
+    std::shared_ptr<const LhllShaderCode> vertCode;
+    std::shared_ptr<const LhllShaderCode> fragCode;
+  };
+
+  LhllPipelineRegistry::LhllPipelineRegistry(LhllDevice& device, LhllThreadPool& threadPool) : lhllDevice{device}, lhllThreadPool{threadPool}, lhllShaderCache{device} {}
+
+  LhllPipelineRegistry::~LhllPipelineRegistry() {
+    // async jobs still reference this registry
+    std::vector<std::shared_future<std::shared_ptr<LhllPipeline>>> pending;
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      for (auto& kv : pendingPipelines) {
+        pending.push_back(kv.second);
+      }
+      pending.insert(pending.end(), droppedPipelines.begin(), droppedPipelines.end());
+    }
+    for (auto& future : pending) {
+      future.wait();
+    }
+
+    std::cout << "Pipeline registry: " << pipelines.size() + computePipelines.size() << " pipelines for " << requestCount << " requests" << std::endl;
+  }
+
+  std::shared_ptr<LhllPipeline> LhllPipelineRegistry::getPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo) {
+    return getPipelines({{vertFilepath, fragFilepath, &configInfo}})[0];
+  }
+
+  // The mutex is never held while waiting on the thread pool, async jobs lock it from the workers
+  // when they finish and would otherwise deadlock against a batch waiting on those same workers
+  std::vector<std::shared_ptr<LhllPipeline>> LhllPipelineRegistry::getPipelines(const std::vector<PipelineRequest>& requests) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::shared_ptr<LhllPipeline>> results(requests.size());
+    std::vector<std::string> keys(requests.size());
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<LhllPipeline>>> jobs;
+    // released at the end of the batch, so shared modules are destroyed once every pipeline is built
+    std::vector<std::shared_ptr<ShaderStageModules>> batchModules;
+    size_t compileCount = 0;
+
+    std::vector<std::shared_ptr<const LhllShaderCode>> vertCodes(requests.size());
+    std::vector<std::shared_ptr<const LhllShaderCode>> fragCodes(requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+      vertCodes[i] = lhllShaderCache.loadCode(requests[i].vertFilepath);
+      fragCodes[i] = lhllShaderCache.loadCode(requests[i].fragFilepath);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      requestCount += requests.size();
+
+      for (size_t i = 0; i < requests.size(); i++) {
+        const auto& request = requests[i];
+        assert(request.configInfo != nullptr && "Cannot create pipeline: no configInfo provided in request");
+
+        keys[i] = makeKey(*vertCodes[i], *fragCodes[i], *request.configInfo);
+        auto it = pipelines.find(keys[i]);
+        if (it != pipelines.end()) {
+          results[i] = it->second;
+          continue;
+        }
+        if (jobs.count(keys[i]) != 0) {
+          continue;
+        }
+
+        auto pending = pendingPipelines.find(keys[i]);
+        if (pending != pendingPipelines.end()) {
+          jobs.emplace(keys[i], pending->second);
+          continue;
+        }
+
+        auto modules = std::make_shared<ShaderStageModules>(lhllShaderCache, vertCodes[i], fragCodes[i]);
+        batchModules.push_back(modules);
+        jobs.emplace(keys[i], lhllThreadPool.submit([this, &request, modules]() mutable {
+          auto pipeline = std::make_shared<LhllPipeline>(lhllDevice, modules->vertModule, modules->fragModule, *request.configInfo);
+          modules.reset();
+          return pipeline;
+        }, LhllThreadPool::Priority::Background).share());
+        compileCount++;
+      }
+    }
+
+    // wait for every job before rethrowing, the jobs reference requests owned by the caller
+    for (auto& kv : jobs) {
+      kv.second.wait();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      for (auto& kv : jobs) {
+        pipelines.emplace(kv.first, kv.second.get());
+      }
+      for (size_t i = 0; i < requests.size(); i++) {
+        if (results[i] == nullptr) {
+          results[i] = pipelines.at(keys[i]);
+        }
+      }
+    }
+
+    if (compileCount > 0) {
+      float batchTime = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+      std::cout << "Pipeline batch: compiled " << compileCount << " pipelines in " << batchTime << " ms on " << lhllThreadPool.getThreadCount() << " threads ("
+                << (lhllDevice.isPipelineCacheWarm() ? "warm" : "cold") << " cache)" << std::endl;
+    }
+
+    return results;
+  }
+
+  LhllAsyncPipeline LhllPipelineRegistry::getPipelineAsync(const std::string& vertFilepath, const std::string& fragFilepath, std::shared_ptr<const PipelineConfigInfo> configInfo) {
+    assert(configInfo != nullptr && "Cannot create pipeline: no configInfo provided");
+
+    auto vertCode = lhllShaderCache.loadCode(vertFilepath);
+    auto fragCode = lhllShaderCache.loadCode(fragFilepath);
+
+    std::lock_guard<std::mutex> lock{mutex};
+    requestCount++;
+
+    std::string key = makeKey(*vertCode, *fragCode, *configInfo);
+    auto it = pipelines.find(key);
+    if (it != pipelines.end()) {
+      std::promise<std::shared_ptr<LhllPipeline>> ready;
+      ready.set_value(it->second);
+      return LhllAsyncPipeline{ready.get_future().share()};
+    }
+
+    auto pending = pendingPipelines.find(key);
+    if (pending != pendingPipelines.end()) {
+      return LhllAsyncPipeline{pending->second};
+    }
+
+    auto modules = std::make_shared<ShaderStageModules>(lhllShaderCache, vertCode, fragCode);
+    // modules are released inside the job, the registry may be destroyed as soon as the future is ready
+    auto future = lhllThreadPool.submit([this, key, modules, configInfo]() mutable {
+      std::shared_ptr<LhllPipeline> pipeline;
+      try {
+        pipeline = std::make_shared<LhllPipeline>(lhllDevice, modules->vertModule, modules->fragModule, *configInfo);
+      } catch (...) {
+        modules.reset();
+        std::lock_guard<std::mutex> lock{mutex};
+        pendingPipelines.erase(key);
+        throw;
+      }
+      modules.reset();
+
+      // reloadShader drops the entry when the code changed while compiling, the caller still gets
+      // the pipeline but it is not kept in the registry
+      std::lock_guard<std::mutex> lock{mutex};
+      auto pending = pendingPipelines.find(key);
+      if (pending == pendingPipelines.end()) {
+        return pipeline;
+      }
+      pendingPipelines.erase(pending);
+      return pipelines.emplace(key, pipeline).first->second;
+    }, LhllThreadPool::Priority::Background).share();
+
+    pendingPipelines.emplace(std::move(key), future);
+    return LhllAsyncPipeline{future};
+  }
+
+  std::shared_ptr<LhllComputePipeline> LhllPipelineRegistry::getComputePipeline(const std::string& compFilepath, const LhllPipelineLayout& pipelineLayout) {
+    auto compCode = lhllShaderCache.loadCode(compFilepath);
+
+    // same layout as makeKey, the code hash comes first
+    std::string key;
+    appendKey(key, compCode->hash);
+    appendKey(key, pipelineLayout.getGeneration());
+    appendKey(key, *compCode);
+
+    std::lock_guard<std::mutex> lock{mutex};
+    requestCount++;
+
+    auto it = computePipelines.find(key);
+    if (it != computePipelines.end()) {
+      return it->second;
+    }
+
+    VkShaderModule module = lhllShaderCache.acquireModule(*compCode);
+    std::shared_ptr<LhllComputePipeline> pipeline;
+    try {
+      pipeline = std::make_shared<LhllComputePipeline>(lhllDevice, module, pipelineLayout.getHandle());
+    }
+    catch (...) {
+      lhllShaderCache.releaseModule(*compCode);
+      throw;
+    }
+    lhllShaderCache.releaseModule(*compCode);
+
+    return computePipelines.emplace(std::move(key), std::move(pipeline)).first->second;
+  }
+
+  bool LhllPipelineRegistry::reloadShader(const std::string& filepath) {
+    std::shared_ptr<const LhllShaderCode> oldCode;
+    std::shared_ptr<const LhllShaderCode> newCode;
+    try {
+      oldCode = lhllShaderCache.loadCode(filepath);
+      newCode = lhllShaderCache.reloadCode(filepath);
+    }
+    catch (const std::exception& e) {
+      std::cerr << "Failed to reload shader " << filepath << ": " << e.what() << '\n';
+      return false;
+    }
+
+    if (newCode->hash == oldCode->hash) {
+      return false;
+    }
+
+    // makeKey starts with the vertex and fragment code hashes
+    auto usesOldCode = [&oldCode](const std::string& key) {
+      uint64_t vertHash;
+      uint64_t fragHash;
+      std::memcpy(&vertHash, key.data(), sizeof(uint64_t));
+      std::memcpy(&fragHash, key.data() + sizeof(uint64_t), sizeof(uint64_t));
+      return vertHash == oldCode->hash || fragHash == oldCode->hash;
+    };
+
+    std::lock_guard<std::mutex> lock{mutex};
+    for (auto it = pipelines.begin(); it != pipelines.end();) {
+      if (usesOldCode(it->first)) {
+        it = pipelines.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+
+    // jobs still compiling the old code finish for their callers but are not added to pipelines,
+    // the destructor waits on them through droppedPipelines
+    droppedPipelines.erase(std::remove_if(droppedPipelines.begin(), droppedPipelines.end(), [](const std::shared_future<std::shared_ptr<LhllPipeline>>& future) {
+      return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }), droppedPipelines.end());
+    for (auto it = pendingPipelines.begin(); it != pendingPipelines.end();) {
+      if (usesOldCode(it->first)) {
+        droppedPipelines.push_back(it->second);
+        it = pendingPipelines.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+
+    for (auto it = computePipelines.begin(); it != computePipelines.end();) {
+      uint64_t compHash;
+      std::memcpy(&compHash, it->first.data(), sizeof(uint64_t));
+      if (compHash == oldCode->hash) {
+        it = computePipelines.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+
+    return true;
+  }
+
+  size_t LhllPipelineRegistry::getPipelineCount() const {
+    std::lock_guard<std::mutex> lock{mutex};
+    return pipelines.size() + computePipelines.size();
+  }
+
+  size_t LhllPipelineRegistry::getRequestCount() const {
+    std::lock_guard<std::mutex> lock{mutex};
+    return requestCount;
+  }
+
+  void LhllPipelineRegistry::clear() {
+    std::lock_guard<std::mutex> lock{mutex};
+    pipelines.clear();
+    computePipelines.clear();
+  }
+
+  // Builds a byte string out of every field that ends up in VkGraphicsPipelineCreateInfo. Fields are
+  // appended one by one instead of hashing the raw structs, so padding and the pointers into
+  // configInfo itself never leak into the key. A base and its derivatives differ in flags and
+  // basePipelineHandle, so one is never handed out for the other.
+  std::string LhllPipelineRegistry::makeKey(const LhllShaderCode& vertCode, const LhllShaderCode& fragCode, const PipelineConfigInfo& configInfo) {
+    assert(configInfo.colorBlendInfo.attachmentCount <= 1 && "Pipeline registry only supports a single color attachment");
+
+    std::string key;
+    key.reserve(256 + (vertCode.words.size() + fragCode.words.size()) * sizeof(uint32_t));
+    appendKey(key, vertCode.hash);
+    appendKey(key, fragCode.hash);
+
+    appendKey(key, static_cast<uint32_t>(configInfo.bindingDescriptions.size()));
+    for (const auto& binding : configInfo.bindingDescriptions) {
+      appendKey(key, binding.binding);
+      appendKey(key, binding.stride);
+      appendKey(key, binding.inputRate);
+    }
+    appendKey(key, static_cast<uint32_t>(configInfo.attributeDescriptions.size()));
+    for (const auto& attribute : configInfo.attributeDescriptions) {
+      appendKey(key, attribute.location);
+      appendKey(key, attribute.binding);
+      appendKey(key, attribute.format);
+      appendKey(key, attribute.offset);
+    }
+
+    appendKey(key, configInfo.inputAssemblyInfo.topology);
+    appendKey(key, configInfo.inputAssemblyInfo.primitiveRestartEnable);
+
+    appendKey(key, configInfo.viewportInfo.viewportCount);
+    appendKey(key, configInfo.viewportInfo.scissorCount);
+
+    const auto& raster = configInfo.rasterizationInfo;
+    appendKey(key, raster.depthClampEnable);
+    appendKey(key, raster.rasterizerDiscardEnable);
+    appendKey(key, raster.polygonMode);
+    appendKey(key, raster.cullMode);
+    appendKey(key, raster.frontFace);
+    appendKey(key, raster.depthBiasEnable);
+    appendKey(key, raster.depthBiasConstantFactor);
+    appendKey(key, raster.depthBiasClamp);
+    appendKey(key, raster.depthBiasSlopeFactor);
+    appendKey(key, raster.lineWidth);
+
+    const auto& multisample = configInfo.multisampleInfo;
+    appendKey(key, multisample.rasterizationSamples);
+    appendKey(key, multisample.sampleShadingEnable);
+    appendKey(key, multisample.minSampleShading);
+    appendKey(key, multisample.alphaToCoverageEnable);
+    appendKey(key, multisample.alphaToOneEnable);
+
+    const auto& blend = configInfo.colorBlendAttachment;
+    appendKey(key, blend.blendEnable);
+    appendKey(key, blend.srcColorBlendFactor);
+    appendKey(key, blend.dstColorBlendFactor);
+    appendKey(key, blend.colorBlendOp);
+    appendKey(key, blend.srcAlphaBlendFactor);
+    appendKey(key, blend.dstAlphaBlendFactor);
+    appendKey(key, blend.alphaBlendOp);
+    appendKey(key, blend.colorWriteMask);
+
+    const auto& blendInfo = configInfo.colorBlendInfo;
+    appendKey(key, blendInfo.logicOpEnable);
+    appendKey(key, blendInfo.logicOp);
+    appendKey(key, blendInfo.attachmentCount);
+    appendKey(key, blendInfo.blendConstants);
+
+    const auto& depth = configInfo.depthStencilInfo;
+    appendKey(key, depth.depthTestEnable);
+    appendKey(key, depth.depthWriteEnable);
+    appendKey(key, depth.depthCompareOp);
+    appendKey(key, depth.depthBoundsTestEnable);
+    appendKey(key, depth.stencilTestEnable);
+    appendKey(key, depth.front);
+    appendKey(key, depth.back);
+    appendKey(key, depth.minDepthBounds);
+    appendKey(key, depth.maxDepthBounds);
+
+    appendKey(key, static_cast<uint32_t>(configInfo.dynamicStateEnables.size()));
+    for (auto state : configInfo.dynamicStateEnables) {
+      appendKey(key, state);
+    }
+
+    appendKey(key, configInfo.pipelineLayout);
+    appendKey(key, configInfo.renderPass);
+    appendKey(key, configInfo.subpass);
+    appendKey(key, configInfo.flags);
+    appendKey(key, configInfo.basePipelineHandle);
+
+    appendKey(key, configInfo.vertSpecialization);
+    appendKey(key, configInfo.fragSpecialization);
+
+    // a hash match alone does not prove the code is the same
+    appendKey(key, vertCode);
+    appendKey(key, fragCode);
+
+    return key;
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef LHLL_PIPELINE_REGISTRY_HPP
+#define LHLL_PIPELINE_REGISTRY_HPP
+
+#include "lhll_compute_pipeline.hpp"
+#include "lhll_device.hpp"
+#include "lhll_pipeline.hpp"
+#include "lhll_pipeline_layout.hpp"
+#include "lhll_shader_cache.hpp"
+#include "lhll_thread_pool.hpp"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lhll {
+  struct PipelineRequest {
+    std::string vertFilepath;
+    std::string fragFilepath;
+    const PipelineConfigInfo* configInfo = nullptr;
+  };
+
+  // Result of LhllPipelineRegistry::getPipelineAsync, poll isReady() once per frame and swap the
+  // pipeline in when it is
+  class LhllAsyncPipeline {
+  public:
+    LhllAsyncPipeline() = default;
+    LhllAsyncPipeline(std::shared_future<std::shared_ptr<LhllPipeline>> pipelineFuture) : future{std::move(pipelineFuture)} {}
+
+    bool valid() const { return future.valid(); }
+    bool isReady() const { return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+    // blocks until compiled, rethrows if compilation failed
+    std::shared_ptr<LhllPipeline> get() const { return future.get(); }
+
+  private:
+    std::shared_future<std::shared_ptr<LhllPipeline>> future;
+  };
+
+  // Hands out one shared LhllPipeline per unique (SPIR-V, PipelineConfigInfo) combination
+  class LhllPipelineRegistry {
+  public:
+    LhllPipelineRegistry(LhllDevice& device, LhllThreadPool& threadPool);
+    ~LhllPipelineRegistry();
+
+    LhllPipelineRegistry(const LhllPipelineRegistry&) = delete;
+    LhllPipelineRegistry& operator=(const LhllPipelineRegistry&) = delete;
+
+    // set configInfo.basePipelineHandle to create the pipeline as a derivative of an existing one,
+    // which must have been created with VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT in its flags
+    std::shared_ptr<LhllPipeline> getPipeline(const std::string& vertFilepath, const std::string& fragFilepath, const PipelineConfigInfo& configInfo);
+
+    // Compiles every pipeline that is not in the registry yet concurrently on the thread pool and
+    // blocks until all of them are done, results are in the same order as requests
+    std::vector<std::shared_ptr<LhllPipeline>> getPipelines(const std::vector<PipelineRequest>& requests);
+
+    // Compiles on the thread pool and returns immediately, configInfo is kept alive until the job is done
+    LhllAsyncPipeline getPipelineAsync(const std::string& vertFilepath, const std::string& fragFilepath, std::shared_ptr<const PipelineConfigInfo> configInfo);
+
+    // Compute pipelines are few and small, they are created synchronously and shared per
+    // (SPIR-V, layout generation)
+    std::shared_ptr<LhllComputePipeline> getComputePipeline(const std::string& compFilepath, const LhllPipelineLayout& pipelineLayout);
+
+    // Picks up a shader file that changed on disk. Pipelines built or still compiling from the old
+    // code are dropped from the registry, users holding one keep it alive until they swap it out.
+    // Returns false when the code did not change or could not be read
+    bool reloadShader(const std::string& filepath);
+
+    size_t getPipelineCount() const;
+    size_t getRequestCount() const;
+    void clear();
+
+  private:
+    static std::string makeKey(const LhllShaderCode& vertCode, const LhllShaderCode& fragCode, const PipelineConfigInfo& configInfo);
+
+    LhllDevice& lhllDevice;
+    LhllThreadPool& lhllThreadPool;
+    LhllShaderCache lhllShaderCache;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<LhllPipeline>> pipelines;
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<LhllPipeline>>> pendingPipelines;
+    // async jobs whose code was reloaded while they compiled
+    std::vector<std::shared_future<std::shared_ptr<LhllPipeline>>> droppedPipelines;
+    std::unordered_map<std::string, std::shared_ptr<LhllComputePipeline>> computePipelines;
+    size_t requestCount = 0;
+  };
+}
+
+#endif
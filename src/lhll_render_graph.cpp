@@ -0,0 +1,549 @@
+#include "lhll_render_graph.hpp"
+
+#include "lhll_swap_chain.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <stdexcept>
+
+namespace lhll {
+  // the accesses a later use has to wait for to be made available, reads never need that
+  static constexpr VkAccessFlags WRITE_ACCESS_MASK = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                                     VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+  LhllRenderGraph::Usage LhllRenderGraph::Usage::colorAttachment() {
+    return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  }
+
+  LhllRenderGraph::Usage LhllRenderGraph::Usage::depthAttachment() {
+    return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+  }
+
+  LhllRenderGraph::Usage LhllRenderGraph::Usage::depthReadOnly(VkPipelineStageFlags stages) {
+    return {stages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+  }
+
+  LhllRenderGraph::Usage LhllRenderGraph::Usage::sampled(VkPipelineStageFlags stages) {
+    return {stages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+  }
+
+  LhllRenderGraph::Usage LhllRenderGraph::Usage::storage(VkPipelineStageFlags stages) {
+    return {stages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL};
+  }
+
+  LhllRenderGraph::Usage LhllRenderGraph::Usage::indirectCommands() {
+    return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED};
+  }
+
+  LhllRenderGraph::Usage LhllRenderGraph::Usage::transferSource() {
+    return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+  }
+
+  LhllRenderGraph::Usage LhllRenderGraph::Usage::transferDestination() {
+    return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+  }
+
+  LhllRenderGraph::Usage LhllRenderGraph::Usage::present() {
+    return {VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+  }
+
+  LhllRenderGraph::PassBuilder& LhllRenderGraph::PassBuilder::read(ResourceId resource, const Usage& usage) {
+    return use(resource, usage, true, false);
+  }
+
+  LhllRenderGraph::PassBuilder& LhllRenderGraph::PassBuilder::write(ResourceId resource, const Usage& usage) {
+    return use(resource, usage, false, true);
+  }
+
+  LhllRenderGraph::PassBuilder& LhllRenderGraph::PassBuilder::readWrite(ResourceId resource, const Usage& usage) {
+    return use(resource, usage, true, true);
+  }
+
+  LhllRenderGraph::PassBuilder& LhllRenderGraph::PassBuilder::setSideEffects() {
+    graph.passes[passIndex].sideEffects = true;
+    return *this;
+  }
+
+  LhllRenderGraph::PassBuilder& LhllRenderGraph::PassBuilder::setExecute(std::function<void(VkCommandBuffer)> execute) {
+    graph.passes[passIndex].execute = std::move(execute);
+    return *this;
+  }
+
+  // a resource used several ways by one pass is one usage with all of their stages and accesses
+  LhllRenderGraph::PassBuilder& LhllRenderGraph::PassBuilder::use(ResourceId resource, const Usage& usage, bool readsContents, bool writes) {
+    assert(resource < graph.resources.size() && "Render graph resource does not exist");
+    auto& usages = graph.passes[passIndex].usages;
+    for (auto& existing : usages) {
+      if (existing.resource != resource) continue;
+      assert((!graph.resources[resource].isImage || existing.usage.layout == usage.layout) && "A pass has to use an image in a single layout");
+      existing.usage.stages |= usage.stages;
+      existing.usage.access |= usage.access;
+      existing.readsContents = existing.readsContents || readsContents;
+      existing.writes = existing.writes || writes;
+      return *this;
+    }
+    usages.push_back({resource, usage, readsContents, writes});
+    return *this;
+  }
+
+  LhllRenderGraph::LhllRenderGraph(LhllDevice& device) : lhllDevice{device} {
+    transientFrames.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+  }
+
+  LhllRenderGraph::~LhllRenderGraph() {
+    for (auto& frame : transientFrames) {
+      destroyTransients(frame);
+    }
+  }
+
+  void LhllRenderGraph::beginFrame(int frameIndex) {
+    assert(frameIndex >= 0 && frameIndex < static_cast<int>(transientFrames.size()) && "Render graph frame index out of range");
+    this->frameIndex = frameIndex;
+    resources.clear();
+    passes.clear();
+  }
+
+  LhllRenderGraph::ResourceId LhllRenderGraph::importImage(const std::string& name, VkImage image, VkImageAspectFlags aspect, const Usage& initialUsage, const Usage& finalUsage) {
+    Resource resource{};
+    resource.name = name;
+    resource.isImage = true;
+    resource.imported = true;
+    resource.image = image;
+    resource.aspect = aspect;
+    resource.finalUsage = finalUsage;
+    resource.state = stateAfter(initialUsage);
+    resources.push_back(std::move(resource));
+    return static_cast<ResourceId>(resources.size() - 1);
+  }
+
+  LhllRenderGraph::ResourceId LhllRenderGraph::importBuffer(const std::string& name, VkBuffer buffer, const Usage& initialUsage) {
+    Resource resource{};
+    resource.name = name;
+    resource.isImage = false;
+    resource.imported = true;
+    resource.buffer = buffer;
+    resource.state = stateAfter(initialUsage);
+    resources.push_back(std::move(resource));
+    return static_cast<ResourceId>(resources.size() - 1);
+  }
+
+  LhllRenderGraph::ResourceId LhllRenderGraph::createImage(const std::string& name, const ImageDesc& desc) {
+    Resource resource{};
+    resource.name = name;
+    resource.isImage = true;
+    resource.imported = false;
+    resource.aspect = desc.aspect;
+    resource.desc = desc;
+    resources.push_back(std::move(resource));
+    return static_cast<ResourceId>(resources.size() - 1);
+  }
+
+  void LhllRenderGraph::markOutput(ResourceId resource) {
+    assert(resource < resources.size() && "Render graph resource does not exist");
+    resources[resource].output = true;
+  }
+
+  LhllRenderGraph::PassBuilder LhllRenderGraph::addPass(const std::string& name) {
+    assert(frameIndex >= 0 && "beginFrame has to be called before passes are added");
+    Pass pass{};
+    pass.name = name;
+    passes.push_back(std::move(pass));
+    return PassBuilder{*this, static_cast<uint32_t>(passes.size() - 1)};
+  }
+
+  LhllRenderGraph::RendererTargets LhllRenderGraph::importRendererTargets(LhllRenderer& renderer, const Usage& colorFinalUsage) {
+    // An acquired swap chain image is waited for at the color output stage. Any other color image was
+    // last used as colorFinalUsage by an earlier frame, the depth image by the frame that had it before
+    VkPipelineStageFlags colorWaitStages = colorFinalUsage.layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR ? VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT : colorFinalUsage.stages;
+    RendererTargets targets{};
+    targets.color = importImage(
+        "color",
+        renderer.getCurrentImage(),
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        {colorWaitStages, 0, VK_IMAGE_LAYOUT_UNDEFINED},
+        colorFinalUsage);
+    targets.depth = importImage(
+        "depth",
+        renderer.getCurrentDepthImage(),
+        renderer.getDepthAspectMask(),
+        {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED},
+        {0, 0, VK_IMAGE_LAYOUT_UNDEFINED});
+    markOutput(targets.color);
+    return targets;
+  }
+
+  LhllRenderGraph::PassBuilder LhllRenderGraph::addRendererPass(const std::string& name, LhllRenderer& renderer, const RendererTargets& targets, VkSubpassContents contents, std::function<void(VkCommandBuffer)> record) {
+    auto pass = addPass(name);
+    pass.write(targets.color, Usage::colorAttachment())
+        .write(targets.depth, Usage::depthAttachment())
+        .setExecute([&renderer, contents, record = std::move(record)](VkCommandBuffer commandBuffer) {
+          renderer.beginSwapChainRenderPass(commandBuffer, contents);
+          record(commandBuffer);
+          renderer.endSwapChainRenderPass(commandBuffer);
+        });
+    return pass;
+  }
+
+  LhllRenderGraph::PassBuilder LhllRenderGraph::addResumedRendererPass(const std::string& name, LhllRenderer& renderer, const RendererTargets& targets, std::function<void(VkCommandBuffer)> record) {
+    auto pass = addPass(name);
+    pass.readWrite(targets.color, Usage::colorAttachment())
+        .readWrite(targets.depth, Usage::depthAttachment())
+        .setExecute([&renderer, record = std::move(record)](VkCommandBuffer commandBuffer) {
+          renderer.resumeSwapChainRenderPass(commandBuffer);
+          record(commandBuffer);
+          renderer.endSwapChainRenderPass(commandBuffer);
+        });
+    return pass;
+  }
+
+  VkImageView LhllRenderGraph::getImageView(ResourceId resource) const {
+    const auto& image = resources[resource];
+    assert(image.isImage && !image.imported && image.firstPass >= 0 && "Only images created by the graph and used by a pass have a view");
+    return transientFrames[frameIndex].images[image.transientIndex].view;
+  }
+
+  VkDeviceSize LhllRenderGraph::getTransientMemorySize(int frameIndex) const {
+    return transientFrames[frameIndex].memorySize;
+  }
+
+  // a write, and the stages that used it as the ones a later use has to wait for
+  LhllRenderGraph::ResourceState LhllRenderGraph::stateAfter(const Usage& usage) {
+    ResourceState state{};
+    state.writeStages = usage.stages;
+    state.writeAccess = usage.access & WRITE_ACCESS_MASK;
+    state.readStages = usage.stages;
+    state.layout = usage.layout;
+    return state;
+  }
+
+  // Walks the passes backwards from the outputs. A pass is kept when it has side effects or writes
+  // something a kept pass after it reads, writing over all of a resource ends the need for it
+  void LhllRenderGraph::cullPasses() {
+    std::vector<uint8_t> needed(resources.size(), 0);
+    for (size_t i = 0; i < resources.size(); i++) {
+      needed[i] = resources[i].output ? 1 : 0;
+    }
+
+    culledPassCount = 0;
+    for (size_t i = passes.size(); i-- > 0;) {
+      auto& pass = passes[i];
+      pass.live = pass.sideEffects;
+      for (const auto& use : pass.usages) {
+        if (use.writes && needed[use.resource]) pass.live = true;
+      }
+      if (!pass.live) {
+        culledPassCount++;
+        continue;
+      }
+
+      for (const auto& use : pass.usages) {
+        if (use.writes && !use.readsContents) needed[use.resource] = 0;
+      }
+      for (const auto& use : pass.usages) {
+        if (use.readsContents) needed[use.resource] = 1;
+      }
+    }
+  }
+
+  void LhllRenderGraph::findLifetimes() {
+    for (int i = 0; i < static_cast<int>(passes.size()); i++) {
+      if (!passes[i].live) continue;
+      for (const auto& use : passes[i].usages) {
+        auto& resource = resources[use.resource];
+        if (resource.firstPass < 0) {
+          if (!resource.imported && use.readsContents) {
+            throw std::runtime_error("render graph pass " + passes[i].name + " reads " + resource.name + " before any pass wrote it");
+          }
+          resource.firstPass = i;
+        }
+        resource.lastPass = i;
+      }
+    }
+  }
+
+  // Images are assigned to memory blocks in the order of their first use, into the first block whose
+  // images are all done by then. Every block is bound at offset 0, so it just has to fit the largest
+  void LhllRenderGraph::allocateTransients() {
+    auto& frame = transientFrames[frameIndex];
+
+    std::vector<TransientEntry> entries;
+    for (auto& resource : resources) {
+      if (resource.imported || resource.firstPass < 0) continue;
+      resource.transientIndex = static_cast<uint32_t>(entries.size());
+      entries.push_back({resource.desc, resource.firstPass, resource.lastPass});
+    }
+    if (entries == frame.entries) return;
+
+    // the frame that used them last has finished
+    destroyTransients(frame);
+    frame.entries = entries;
+    frame.images.resize(entries.size());
+
+    std::vector<VkMemoryRequirements> requirements(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+      const auto& desc = entries[i].desc;
+      VkImageCreateInfo imageInfo{};
+      imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      imageInfo.imageType = VK_IMAGE_TYPE_2D;
+      imageInfo.extent.width = desc.extent.width;
+      imageInfo.extent.height = desc.extent.height;
+      imageInfo.extent.depth = 1;
+      imageInfo.mipLevels = 1;
+      imageInfo.arrayLayers = 1;
+      imageInfo.format = desc.format;
+      imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+      imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      imageInfo.usage = desc.usage;
+      imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+      imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+      if (vkCreateImage(lhllDevice.device(), &imageInfo, nullptr, &frame.images[i].image) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render graph image!");
+      }
+      vkGetImageMemoryRequirements(lhllDevice.device(), frame.images[i].image, &requirements[i]);
+    }
+
+    std::vector<uint32_t> order(entries.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&entries](uint32_t a, uint32_t b) { return entries[a].firstPass < entries[b].firstPass; });
+
+    struct Block {
+      VkDeviceSize size;
+      uint32_t memoryTypeBits;
+      int lastPass;
+    };
+    std::vector<Block> blocks;
+    for (uint32_t i : order) {
+      uint32_t block = 0;
+      while (block < blocks.size() && (blocks[block].lastPass >= entries[i].firstPass || (blocks[block].memoryTypeBits & requirements[i].memoryTypeBits) == 0)) {
+        block++;
+      }
+      if (block == blocks.size()) {
+        blocks.push_back({requirements[i].size, requirements[i].memoryTypeBits, entries[i].lastPass});
+      }
+      else {
+        blocks[block].size = std::max(blocks[block].size, requirements[i].size);
+        blocks[block].memoryTypeBits &= requirements[i].memoryTypeBits;
+        blocks[block].lastPass = entries[i].lastPass;
+      }
+      frame.images[i].block = block;
+    }
+
+    frame.blocks.resize(blocks.size(), VK_NULL_HANDLE);
+    frame.memorySize = 0;
+    for (size_t i = 0; i < blocks.size(); i++) {
+      VkMemoryAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+      allocInfo.allocationSize = blocks[i].size;
+      allocInfo.memoryTypeIndex = lhllDevice.findMemoryType(blocks[i].memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+      if (vkAllocateMemory(lhllDevice.device(), &allocInfo, nullptr, &frame.blocks[i]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate render graph memory!");
+      }
+      frame.memorySize += blocks[i].size;
+    }
+
+    for (size_t i = 0; i < entries.size(); i++) {
+      auto& image = frame.images[i];
+      if (vkBindImageMemory(lhllDevice.device(), image.image, frame.blocks[image.block], 0) != VK_SUCCESS) {
+        throw std::runtime_error("failed to bind render graph image memory!");
+      }
+
+      VkImageViewCreateInfo viewInfo{};
+      viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      viewInfo.image = image.image;
+      viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.format = entries[i].desc.format;
+      viewInfo.subresourceRange.aspectMask = entries[i].desc.aspect;
+      viewInfo.subresourceRange.baseMipLevel = 0;
+      viewInfo.subresourceRange.levelCount = 1;
+      viewInfo.subresourceRange.baseArrayLayer = 0;
+      viewInfo.subresourceRange.layerCount = 1;
+
+      if (vkCreateImageView(lhllDevice.device(), &viewInfo, nullptr, &image.view) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render graph image view!");
+      }
+    }
+  }
+
+  void LhllRenderGraph::destroyTransients(TransientFrame& frame) {
+    for (auto& image : frame.images) {
+      vkDestroyImageView(lhllDevice.device(), image.view, nullptr);
+      vkDestroyImage(lhllDevice.device(), image.image, nullptr);
+    }
+    for (auto memory : frame.blocks) {
+      vkFreeMemory(lhllDevice.device(), memory, nullptr);
+    }
+    frame.entries.clear();
+    frame.images.clear();
+    frame.blocks.clear();
+    frame.memorySize = 0;
+  }
+
+  // Reads wait for the last write unless it was made visible to them already, writes wait for the
+  // last write and the reads since. Without a layout transition or a write to make available, a
+  // dependency on reads only needs the stages
+  void LhllRenderGraph::recordBarriers(VkCommandBuffer commandBuffer, int passIndex, std::vector<ResourceState>& blockStates) {
+    const auto& frame = transientFrames[frameIndex];
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    imageBarriers.clear();
+    bufferBarriers.clear();
+
+    for (const auto& use : passes[passIndex].usages) {
+      auto& resource = resources[use.resource];
+      auto& state = resource.state;
+      if (!resource.imported && resource.firstPass == passIndex) {
+        // starts out in memory the earlier images of its block are done with
+        state = blockStates[frame.images[resource.transientIndex].block];
+        state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+      }
+
+      bool layoutChange = resource.isImage && state.layout != use.usage.layout;
+      VkPipelineStageFlags waitStages = 0;
+      VkAccessFlags srcAccess = 0;
+      if (use.writes) {
+        waitStages = state.writeStages | state.readStages;
+        srcAccess = state.writeAccess;
+      }
+      else {
+        bool visible = (use.usage.stages & ~state.visibleStages) == 0 && (use.usage.access & ~state.visibleAccess) == 0;
+        if (state.writeAccess != 0 && !visible) {
+          waitStages = state.writeStages;
+          srcAccess = state.writeAccess;
+        }
+        // the transition writes the image, so it has to wait for the reads too
+        if (layoutChange) waitStages |= state.writeStages | state.readStages;
+      }
+
+      if (waitStages != 0 || layoutChange) {
+        srcStages |= waitStages;
+        dstStages |= use.usage.stages;
+
+        if (resource.isImage && (layoutChange || srcAccess != 0)) {
+          VkImageMemoryBarrier barrier{};
+          barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+          barrier.srcAccessMask = srcAccess;
+          barrier.dstAccessMask = use.usage.access;
+          // what is overwritten anyway is not kept through the transition
+          barrier.oldLayout = use.readsContents || !layoutChange ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+          barrier.newLayout = use.usage.layout;
+          barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+          barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+          barrier.image = resource.imported ? resource.image : frame.images[resource.transientIndex].image;
+          barrier.subresourceRange = {resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+          imageBarriers.push_back(barrier);
+        }
+        else if (!resource.isImage && srcAccess != 0) {
+          VkBufferMemoryBarrier barrier{};
+          barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+          barrier.srcAccessMask = srcAccess;
+          barrier.dstAccessMask = use.usage.access;
+          barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+          barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+          barrier.buffer = resource.buffer;
+          barrier.offset = 0;
+          barrier.size = VK_WHOLE_SIZE;
+          bufferBarriers.push_back(barrier);
+        }
+      }
+
+      if (use.writes) {
+        state = stateAfter(use.usage);
+        state.readStages = 0;
+      }
+      else {
+        // later uses wait for these stages too, which chains them after the transition
+        if (layoutChange) state.writeStages |= use.usage.stages;
+        if (waitStages != 0 || layoutChange) {
+          state.visibleStages |= use.usage.stages;
+          state.visibleAccess |= use.usage.access;
+        }
+        state.readStages |= use.usage.stages;
+        state.layout = use.usage.layout;
+      }
+    }
+
+    if (dstStages == 0) return;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        dstStages,
+        0,
+        0,
+        nullptr,
+        static_cast<uint32_t>(bufferBarriers.size()),
+        bufferBarriers.data(),
+        static_cast<uint32_t>(imageBarriers.size()),
+        imageBarriers.data());
+    barrierCount++;
+  }
+
+  // imported images are left in the layout they were promised in
+  void LhllRenderGraph::recordFinalBarriers(VkCommandBuffer commandBuffer) {
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    imageBarriers.clear();
+
+    for (const auto& resource : resources) {
+      if (!resource.imported || !resource.isImage) continue;
+      const auto& state = resource.state;
+      const auto& usage = resource.finalUsage;
+      if (usage.layout == VK_IMAGE_LAYOUT_UNDEFINED || usage.layout == state.layout) continue;
+
+      srcStages |= state.writeStages | state.readStages;
+      dstStages |= usage.stages;
+
+      VkImageMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      barrier.srcAccessMask = state.writeAccess;
+      barrier.dstAccessMask = usage.access;
+      barrier.oldLayout = state.layout;
+      barrier.newLayout = usage.layout;
+      barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.image = resource.image;
+      barrier.subresourceRange = {resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+      imageBarriers.push_back(barrier);
+    }
+
+    if (imageBarriers.empty()) return;
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        dstStages,
+        0,
+        0,
+        nullptr,
+        0,
+        nullptr,
+        static_cast<uint32_t>(imageBarriers.size()),
+        imageBarriers.data());
+    barrierCount++;
+  }
+
+  void LhllRenderGraph::execute(VkCommandBuffer commandBuffer) {
+    assert(frameIndex >= 0 && "beginFrame has to be called before execute");
+    cullPasses();
+    findLifetimes();
+    allocateTransients();
+
+    barrierCount = 0;
+    std::vector<ResourceState> blockStates(transientFrames[frameIndex].blocks.size());
+    for (int i = 0; i < static_cast<int>(passes.size()); i++) {
+      if (!passes[i].live) continue;
+      recordBarriers(commandBuffer, i, blockStates);
+      if (passes[i].execute) passes[i].execute(commandBuffer);
+
+      // the next image in the block waits for how this one was used last
+      for (const auto& use : passes[i].usages) {
+        const auto& resource = resources[use.resource];
+        if (resource.imported || resource.lastPass != i) continue;
+        blockStates[transientFrames[frameIndex].images[resource.transientIndex].block] = resource.state;
+      }
+    }
+    recordFinalBarriers(commandBuffer);
+  }
+}
@@ -0,0 +1,215 @@
+#ifndef LHLL_RENDER_GRAPH_HPP
+#define LHLL_RENDER_GRAPH_HPP
+
+#include "lhll_device.hpp"
+#include "lhll_renderer.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace lhll {
+  // Frame graph of the passes recorded into a frame's command buffer. Passes declare which images and
+  // buffers they read and write and how, and are recorded in the order they were added. On execute,
+  // passes nothing needed writes for are dropped, and a single pipeline barrier is placed before each
+  // pass with only the layout transitions and the dependencies on earlier writes (or on earlier reads,
+  // before a write) its usages need. Images created by the graph only live from their first to their
+  // last use, images whose uses do not overlap share memory. Render passes recorded by a pass have to
+  // keep their attachments in the layout declared for them, the graph does every transition
+  class LhllRenderGraph {
+  public:
+    using ResourceId = uint32_t;
+
+    // the pipeline stages and accesses of a pass's commands on a resource, the layout is ignored for buffers
+    struct Usage {
+      VkPipelineStageFlags stages;
+      VkAccessFlags access;
+      VkImageLayout layout;
+
+      static Usage colorAttachment();
+      static Usage depthAttachment();
+      // depth read in shaders while it stays bound read only, or not bound at all
+      static Usage depthReadOnly(VkPipelineStageFlags stages);
+      static Usage sampled(VkPipelineStageFlags stages);
+      static Usage storage(VkPipelineStageFlags stages);
+      static Usage indirectCommands();
+      static Usage transferSource();
+      static Usage transferDestination();
+      // left for vkQueuePresentKHR, as the final usage of an imported image
+      static Usage present();
+    };
+
+    // images owned by the graph, created with a single level and layer
+    struct ImageDesc {
+      VkFormat format;
+      VkExtent2D extent;
+      VkImageUsageFlags usage;
+      VkImageAspectFlags aspect;
+
+      bool operator==(const ImageDesc& other) const {
+        return format == other.format && extent.width == other.extent.width && extent.height == other.extent.height && usage == other.usage && aspect == other.aspect;
+      }
+    };
+
+    // the color and depth images of a renderer's render pass for the frame
+    struct RendererTargets {
+      ResourceId color;
+      ResourceId depth;
+    };
+
+    class PassBuilder {
+    public:
+      PassBuilder(LhllRenderGraph& graph, uint32_t passIndex) : graph{graph}, passIndex{passIndex} {}
+
+      // needs what earlier passes wrote
+      PassBuilder& read(ResourceId resource, const Usage& usage);
+      // overwrites the resource without looking at its contents, images are transitioned from
+      // VK_IMAGE_LAYOUT_UNDEFINED, as for cleared attachments
+      PassBuilder& write(ResourceId resource, const Usage& usage);
+      // writes on top of what earlier passes wrote, as for loaded attachments
+      PassBuilder& readWrite(ResourceId resource, const Usage& usage);
+      // never culled, for passes with results outside the graph
+      PassBuilder& setSideEffects();
+      PassBuilder& setExecute(std::function<void(VkCommandBuffer)> execute);
+
+    private:
+      PassBuilder& use(ResourceId resource, const Usage& usage, bool readsContents, bool writes);
+
+      LhllRenderGraph& graph;
+      uint32_t passIndex;
+    };
+
+    LhllRenderGraph(LhllDevice& device);
+    ~LhllRenderGraph();
+
+    LhllRenderGraph(const LhllRenderGraph&) = delete;
+    LhllRenderGraph& operator=(const LhllRenderGraph&) = delete;
+
+    // Drops the passes and resources of the last frame. The images created for frameIndex are reused,
+    // so the frame that used it last has to have finished
+    void beginFrame(int frameIndex);
+
+    // initialUsage is how the commands before the frame last used the image, it is left in finalUsage
+    ResourceId importImage(const std::string& name, VkImage image, VkImageAspectFlags aspect, const Usage& initialUsage, const Usage& finalUsage);
+    ResourceId importBuffer(const std::string& name, VkBuffer buffer, const Usage& initialUsage);
+    ResourceId createImage(const std::string& name, const ImageDesc& desc);
+    // used after the frame, the passes writing it are kept
+    void markOutput(ResourceId resource);
+    PassBuilder addPass(const std::string& name);
+
+    // Imports the renderer's current color and depth images, the color one as an output.
+    // colorFinalUsage is what the color image is left for, present() for a swap chain image or e.g.
+    // transferSource() for an offscreen one that is copied from
+    RendererTargets importRendererTargets(LhllRenderer& renderer, const Usage& colorFinalUsage);
+    // A pass that begins the renderer's render pass on targets with contents, clearing them, calls
+    // record inside it and ends it
+    PassBuilder addRendererPass(const std::string& name, LhllRenderer& renderer, const RendererTargets& targets, VkSubpassContents contents, std::function<void(VkCommandBuffer)> record);
+    // the same, but resumes the render pass on what earlier passes drew, with inline contents
+    PassBuilder addResumedRendererPass(const std::string& name, LhllRenderer& renderer, const RendererTargets& targets, std::function<void(VkCommandBuffer)> record);
+
+    // of an image created by the graph, valid while the passes execute
+    VkImageView getImageView(ResourceId resource) const;
+
+    // culls, places the barriers, binds the created images to memory and records the passes
+    void execute(VkCommandBuffer commandBuffer);
+
+    // of the last execute
+    uint32_t getCulledPassCount() const { return culledPassCount; }
+    uint32_t getBarrierCount() const { return barrierCount; }
+    VkDeviceSize getTransientMemorySize(int frameIndex) const;
+
+  private:
+    // the last write and the reads since, what a barrier before the next use has to wait for
+    struct ResourceState {
+      VkPipelineStageFlags writeStages = 0;
+      VkAccessFlags writeAccess = 0;
+      // stages and accesses the last write is already visible to
+      VkPipelineStageFlags visibleStages = 0;
+      VkAccessFlags visibleAccess = 0;
+      VkPipelineStageFlags readStages = 0;
+      VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    struct Resource {
+      std::string name;
+      bool isImage;
+      bool imported;
+      bool output = false;
+      VkImage image = VK_NULL_HANDLE;
+      VkBuffer buffer = VK_NULL_HANDLE;
+      VkImageAspectFlags aspect = 0;
+      ImageDesc desc{};
+      Usage finalUsage{0, 0, VK_IMAGE_LAYOUT_UNDEFINED};
+      ResourceState state{};
+      // live passes using it, -1 when none
+      int firstPass = -1;
+      int lastPass = -1;
+      // into the frame's transient images
+      uint32_t transientIndex = 0;
+    };
+
+    struct PassUsage {
+      ResourceId resource;
+      Usage usage;
+      bool readsContents;
+      bool writes;
+    };
+
+    struct Pass {
+      std::string name;
+      std::vector<PassUsage> usages;
+      bool sideEffects = false;
+      bool live = false;
+      std::function<void(VkCommandBuffer)> execute;
+    };
+
+    // what the created images of a frame were allocated for, they are kept while it stays the same
+    struct TransientEntry {
+      ImageDesc desc;
+      int firstPass;
+      int lastPass;
+
+      bool operator==(const TransientEntry& other) const {
+        return desc == other.desc && firstPass == other.firstPass && lastPass == other.lastPass;
+      }
+    };
+
+    struct TransientImage {
+      VkImage image = VK_NULL_HANDLE;
+      VkImageView view = VK_NULL_HANDLE;
+      uint32_t block = 0;
+    };
+
+    struct TransientFrame {
+      std::vector<TransientEntry> entries;
+      std::vector<TransientImage> images;
+      std::vector<VkDeviceMemory> blocks;
+      VkDeviceSize memorySize = 0;
+    };
+
+    static ResourceState stateAfter(const Usage& usage);
+    void cullPasses();
+    void findLifetimes();
+    void allocateTransients();
+    void destroyTransients(TransientFrame& frame);
+    void recordBarriers(VkCommandBuffer commandBuffer, int passIndex, std::vector<ResourceState>& blockStates);
+    void recordFinalBarriers(VkCommandBuffer commandBuffer);
+
+    LhllDevice& lhllDevice;
+
+    int frameIndex = -1;
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<TransientFrame> transientFrames;
+
+    uint32_t culledPassCount = 0;
+    uint32_t barrierCount = 0;
+
+    // rebuilt for every barrier, kept so their memory is reused
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+  };
+}
+
+#endif
@@ -0,0 +1,59 @@
+#include "lhll_render_state.hpp"
+
+namespace lhll {
+  LhllRenderStateTracker::LhllRenderStateTracker(LhllDevice& device) : lhllDevice{device} {}
+
+  uint32_t LhllRenderStateTracker::apply(VkCommandBuffer commandBuffer, const RenderState& state) {
+    if (!isSupported()) return 0;
+
+    const auto& functions = lhllDevice.extendedDynamicState();
+    uint32_t commandCount = 0;
+
+    if (!hasState || state.cullMode != current.cullMode) {
+      functions.setCullMode(commandBuffer, state.cullMode);
+      commandCount++;
+    }
+    if (!hasState || state.frontFace != current.frontFace) {
+      functions.setFrontFace(commandBuffer, state.frontFace);
+      commandCount++;
+    }
+    if (!hasState || state.topology != current.topology) {
+      functions.setPrimitiveTopology(commandBuffer, state.topology);
+      commandCount++;
+    }
+    if (!hasState || state.depthTestEnable != current.depthTestEnable) {
+      functions.setDepthTestEnable(commandBuffer, state.depthTestEnable ? VK_TRUE : VK_FALSE);
+      commandCount++;
+    }
+    if (!hasState || state.depthWriteEnable != current.depthWriteEnable) {
+      functions.setDepthWriteEnable(commandBuffer, state.depthWriteEnable ? VK_TRUE : VK_FALSE);
+      commandCount++;
+    }
+    if (!hasState || state.depthCompareOp != current.depthCompareOp) {
+      functions.setDepthCompareOp(commandBuffer, state.depthCompareOp);
+      commandCount++;
+    }
+
+    if (lhllDevice.optionalFeatures().extendedDynamicState2) {
+      if (!hasState || state.depthBiasEnable != current.depthBiasEnable) {
+        functions.setDepthBiasEnable(commandBuffer, state.depthBiasEnable ? VK_TRUE : VK_FALSE);
+        commandCount++;
+      }
+      // the bias factors are dynamic as well but only matter while the bias is enabled
+      if (state.depthBiasEnable && (!hasState || !current.depthBiasEnable ||
+          state.depthBiasConstantFactor != current.depthBiasConstantFactor ||
+          state.depthBiasSlopeFactor != current.depthBiasSlopeFactor)) {
+        vkCmdSetDepthBias(commandBuffer, state.depthBiasConstantFactor, 0.0f, state.depthBiasSlopeFactor);
+        commandCount++;
+      }
+      if (!hasState || state.primitiveRestartEnable != current.primitiveRestartEnable) {
+        functions.setPrimitiveRestartEnable(commandBuffer, state.primitiveRestartEnable ? VK_TRUE : VK_FALSE);
+        commandCount++;
+      }
+    }
+
+    current = state;
+    hasState = true;
+    return commandCount;
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef LHLL_RENDER_STATE_HPP
+#define LHLL_RENDER_STATE_HPP
+
+#include "lhll_device.hpp"
+
+#include <cstdint>
+
+namespace lhll {
+  // Per object fixed function state. Recorded as dynamic state when the device supports extended
+  // dynamic state, otherwise the static state of the bound pipeline is used and these are ignored
+  struct RenderState {
+    VkCullModeFlags cullMode = VK_CULL_MODE_NONE;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    bool depthTestEnable = true;
+    bool depthWriteEnable = true;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+    // extended dynamic state 2
+    bool depthBiasEnable = false;
+    float depthBiasConstantFactor = 0.0f;
+    float depthBiasSlopeFactor = 0.0f;
+    bool primitiveRestartEnable = false;
+
+    bool operator==(const RenderState& other) const {
+      return cullMode == other.cullMode && frontFace == other.frontFace && topology == other.topology &&
+             depthTestEnable == other.depthTestEnable && depthWriteEnable == other.depthWriteEnable &&
+             depthCompareOp == other.depthCompareOp && depthBiasEnable == other.depthBiasEnable &&
+             depthBiasConstantFactor == other.depthBiasConstantFactor && depthBiasSlopeFactor == other.depthBiasSlopeFactor &&
+             primitiveRestartEnable == other.primitiveRestartEnable;
+    }
+    bool operator!=(const RenderState& other) const { return !(*this == other); }
+
+    // Hidden by whatever is in front of it. Objects drawn regardless of the depth buffer are never
+    // occlusion culled
+    bool isOcclusionCullable() const {
+      return depthTestEnable && (depthCompareOp == VK_COMPARE_OP_LESS || depthCompareOp == VK_COMPARE_OP_LESS_OR_EQUAL);
+    }
+  };
+
+  // Records only the dynamic states that differ from what was last recorded into the command buffer
+  class LhllRenderStateTracker {
+  public:
+    LhllRenderStateTracker(LhllDevice& device);
+
+    LhllRenderStateTracker(const LhllRenderStateTracker&) = delete;
+    LhllRenderStateTracker& operator=(const LhllRenderStateTracker&) = delete;
+
+    // call when starting a new command buffer, or after binding a pipeline that has any of the
+    // states static since that leaves them undefined
+    void reset() { hasState = false; }
+
+    // returns the number of vkCmdSet* calls recorded
+    uint32_t apply(VkCommandBuffer commandBuffer, const RenderState& state);
+
+    bool isSupported() const { return lhllDevice.optionalFeatures().extendedDynamicState; }
+
+  private:
+    LhllDevice& lhllDevice;
+
+    RenderState current{};
+    bool hasState = false;
+  };
+}
+
+#endif
@@ -1,13 +1,24 @@
 #include "lhll_renderer.hpp"
 
+#include "lhll_deletion_queue.hpp"
+
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <stdexcept>
 
 namespace lhll {
+  static std::atomic<uint64_t> nextRenderPassGeneration{1};
+
+  LhllRenderer::LhllRenderer(LhllWindow& window, LhllDevice& device, const FramePacingConfig& framePacing) : lhllWindow{&window}, lhllDevice{device}, framePacing{framePacing} {
+    // there has to be a swap chain to make pipelines for, so a minimized window is waited for here
+    while (!recreateSwapChain()) {}
+    createCommandBuffers();
+  }
 
-  LhllRenderer::LhllRenderer(LhllWindow& window, LhllDevice& device) : lhllWindow{window}, lhllDevice{device} {
-    recreateSwapChain();
+  LhllRenderer::LhllRenderer(LhllDevice& device, VkExtent2D extent, const FramePacingConfig& framePacing) : lhllDevice{device}, framePacing{framePacing} {
+    lhllOffscreenTarget = std::make_unique<LhllOffscreenTarget>(lhllDevice, extent, framePacing);
+    renderPassGeneration = nextRenderPassGeneration++;
     createCommandBuffers();
   }
 
@@ -15,32 +26,75 @@ namespace lhll {
     freeCommandBuffers();
   }
 
-  void LhllRenderer::recreateSwapChain() {
-    auto extent = lhllWindow.getExtent();
-    while (extent.width == 0 || extent.height == 0) {
-      extent = lhllWindow.getExtent();
+  bool LhllRenderer::recreateSwapChain() {
+    swapChainOutdated = true;
+
+    auto extent = lhllWindow->getExtent();
+    if (extent.width == 0 || extent.height == 0) {
+      // minimized, sleeps until something happens to the window instead of spinning on frames
       glfwWaitEvents();
+      return false;
     }
 
-    vkDeviceWaitIdle(lhllDevice.device());
-
     if (lhllSwapChain == nullptr) {
-      lhllSwapChain = std::make_unique<LhllSwapChain>(lhllDevice, extent);
+      lhllSwapChain = std::make_unique<LhllSwapChain>(lhllDevice, extent, framePacing);
     }
     else {
+      // The frames in flight keep using the old images, framebuffers and depth resources. It is
+      // retired with the next frame, once that finished so did the present of the last one before
       std::shared_ptr<LhllSwapChain> oldSwapChain = std::move(lhllSwapChain);
-      lhllSwapChain = std::make_unique<LhllSwapChain>(lhllDevice, extent, oldSwapChain);
+      lhllSwapChain = std::make_unique<LhllSwapChain>(lhllDevice, extent, oldSwapChain, framePacing);
 
       if (!oldSwapChain->compareSwapFormats(*lhllSwapChain.get())) {
         throw std::runtime_error("Swap chain image or depth format has changed");
       }
+      lhllDevice.deletionQueue().retire([swapChain = std::move(oldSwapChain)]() mutable { swapChain.reset(); });
+    }
+
+    renderPassGeneration = nextRenderPassGeneration++;
+    swapChainOutdated = false;
+    return true;
+  }
+
+  void LhllRenderer::setFramePacing(const FramePacingConfig& config) {
+    assert(!isFrameStarted && "Can't change frame pacing while a frame is in progress");
+    assert(config.framesInFlight >= 1 && config.framesInFlight <= LhllSwapChain::MAX_FRAMES_IN_FLIGHT && "frames in flight out of range");
+
+    framePacing = config;
+    if (isHeadless()) {
+      VkExtent2D extent = lhllOffscreenTarget->getExtent();
+      vkDeviceWaitIdle(lhllDevice.device());
+      lhllOffscreenTarget = std::make_unique<LhllOffscreenTarget>(lhllDevice, extent, framePacing);
+      renderPassGeneration = nextRenderPassGeneration++;
     }
-    // we'll come back later
+    else {
+      // the frame slots start over, nothing may be in flight
+      vkDeviceWaitIdle(lhllDevice.device());
+      recreateSwapChain();
+    }
+    currentFrameIndex = 0;
+  }
+
+  void LhllRenderer::waitForLowLatency() {
+    if (!framePacing.lowLatency) return;
+
+    waitForFrame(getSubmittedFrameNumber());
+  }
+
+  bool LhllRenderer::isFrameComplete(uint64_t frameNumber) {
+    if (frameNumber > getSubmittedFrameNumber()) return false;
+    return lhllDevice.graphicsTimeline().isComplete(frameNumber);
+  }
+
+  void LhllRenderer::waitForFrame(uint64_t frameNumber) {
+    assert(frameNumber <= getSubmittedFrameNumber() && "Can't wait for a frame that was not submitted");
+    lhllDevice.graphicsTimeline().wait(frameNumber);
   }
 
 
   void LhllRenderer::createCommandBuffers() {
     commandBuffers.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    slotFrameNumbers.assign(LhllSwapChain::MAX_FRAMES_IN_FLIGHT, 0);
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -61,15 +115,28 @@ namespace lhll {
   VkCommandBuffer LhllRenderer::beginFrame() {
     assert(!isFrameStarted && "Can't call beginFrame while already in progress");
 
-    auto result = lhllSwapChain->acquireNextImage(&currentImageIndex);
+    // the commands, semaphores and per frame resources of the slot are free again
+    waitForFrame(slotFrameNumbers[currentFrameIndex]);
+    lhllDevice.deletionQueue().release();
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-      recreateSwapChain();
-      return nullptr;
+    if (isHeadless()) {
+      lhllOffscreenTarget->acquireNextImage(&currentImageIndex);
     }
+    else {
+      if (swapChainOutdated && !recreateSwapChain()) {
+        return nullptr;
+      }
+
+      auto result = lhllSwapChain->acquireNextImage(&currentImageIndex);
 
-    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-      throw std::runtime_error("failed to acquire swap chain image!");
+      if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        recreateSwapChain();
+        return nullptr;
+      }
+
+      if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+        throw std::runtime_error("failed to acquire swap chain image!");
+      }
     }
 
     isFrameStarted = true;
@@ -94,30 +161,40 @@ namespace lhll {
       throw std::runtime_error("failed to record command buffer!");
     }
 
-    auto result = lhllSwapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || lhllWindow.wasWindowResized()) {
-      lhllWindow.resetWindowResizedFlag();
-      recreateSwapChain();
+    uint64_t frameNumber = lhllDevice.graphicsTimeline().nextValue();
+    slotFrameNumbers[currentFrameIndex] = frameNumber;
+
+    if (isHeadless()) {
+      if (lhllOffscreenTarget->submitCommandBuffers(&commandBuffer, &currentImageIndex, frameNumber) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit draw command buffer!");
+      }
     }
-    else if(result != VK_SUCCESS) {
-      throw std::runtime_error("failed to present swap chain image!");
+    else {
+      auto result = lhllSwapChain->submitCommandBuffers(&commandBuffer, &currentImageIndex, frameNumber);
+      if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || lhllWindow->wasWindowResized()) {
+        lhllWindow->resetWindowResizedFlag();
+        recreateSwapChain();
+      }
+      else if(result != VK_SUCCESS) {
+        throw std::runtime_error("failed to present swap chain image!");
+      }
     }
 
     isFrameStarted = false;
-    currentFrameIndex = (currentFrameIndex + 1) % LhllSwapChain::MAX_FRAMES_IN_FLIGHT;
+    currentFrameIndex = (currentFrameIndex + 1) % framePacing.framesInFlight;
   }
 
-  void LhllRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+  void LhllRenderer::beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents) {
     assert(isFrameStarted && "Can't call beginSwapChainRenderPass when frame is not in progress");
     assert(commandBuffer == getCurrentCommandBuffer() && "Can't begin render pass on command buffer from a different frame");
 
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = lhllSwapChain->getRenderPass();
-    renderPassInfo.framebuffer = lhllSwapChain->getFrameBuffer(currentImageIndex);
+    renderPassInfo.renderPass = getSwapChainRenderPass();
+    renderPassInfo.framebuffer = getCurrentFramebuffer();
 
     renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = lhllSwapChain->getSwapChainExtent();
+    renderPassInfo.renderArea.extent = getSwapChainExtent();
 
     std::array<VkClearValue, 2> clearValues{};
     clearValues[0].color = {0.01f, 0.01f, 0.01f, 1.0f};
@@ -125,16 +202,40 @@ namespace lhll {
     renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassInfo.pClearValues = clearValues.data();
 
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+
+    // only vkCmdExecuteCommands may be recorded into the primary until the render pass ends
+    if (contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS) return;
+
+    setViewportAndScissor(commandBuffer);
+  }
+
+  void LhllRenderer::resumeSwapChainRenderPass(VkCommandBuffer commandBuffer) {
+    assert(isFrameStarted && "Can't call resumeSwapChainRenderPass when frame is not in progress");
+    assert(commandBuffer == getCurrentCommandBuffer() && "Can't resume render pass on command buffer from a different frame");
+
+    // the load ops need no clear values
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = getLoadRenderPass();
+    renderPassInfo.framebuffer = getCurrentFramebuffer();
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = getSwapChainExtent();
+
     vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    setViewportAndScissor(commandBuffer);
+  }
 
+  void LhllRenderer::setViewportAndScissor(VkCommandBuffer commandBuffer) {
     VkViewport viewport{};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
-    viewport.width = static_cast<float>(lhllSwapChain->getSwapChainExtent().width);
-    viewport.height = static_cast<float>(lhllSwapChain->getSwapChainExtent().height);
+    VkExtent2D extent = getSwapChainExtent();
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
-    VkRect2D scissor{{0, 0}, lhllSwapChain->getSwapChainExtent()};
+    VkRect2D scissor{{0, 0}, extent};
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
   }
@@ -2,53 +2,128 @@
 #define LHLL_RENDERER_HPP
 
 #include "lhll_device.hpp"
+#include "lhll_offscreen_target.hpp"
 #include "lhll_swap_chain.hpp"
+#include "lhll_timeline.hpp"
 #include "lhll_window.hpp"
 
 #include <cassert>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
 namespace lhll {
   class LhllRenderer {
   public:
-    LhllRenderer(LhllWindow& window, LhllDevice& device);
+    LhllRenderer(LhllWindow& window, LhllDevice& device, const FramePacingConfig& framePacing = {});
+    // Headless, renders into the images of an LhllOffscreenTarget of the given extent instead of a swap
+    // chain. The "swap chain" calls below then refer to the offscreen images
+    LhllRenderer(LhllDevice& device, VkExtent2D extent, const FramePacingConfig& framePacing = {});
     ~LhllRenderer();
 
     LhllRenderer(const LhllRenderer&) = delete;
     LhllRenderer& operator=(const LhllRenderer&) = delete;
 
-    VkRenderPass getSwapChainRenderPass() const { return lhllSwapChain->getRenderPass(); }
-    float getAspectRatio() const { return lhllSwapChain->extentAspectRatio(); }
+    VkRenderPass getSwapChainRenderPass() const { return lhllSwapChain ? lhllSwapChain->getRenderPass() : lhllOffscreenTarget->getRenderPass(); }
+    VkExtent2D getSwapChainExtent() const { return lhllSwapChain ? lhllSwapChain->getSwapChainExtent() : lhllOffscreenTarget->getExtent(); }
+    float getAspectRatio() const { return lhllSwapChain ? lhllSwapChain->extentAspectRatio() : lhllOffscreenTarget->extentAspectRatio(); }
+    // changes whenever the swap chain or offscreen images are recreated, and with them the render pass
+    // and extent, so what was recorded for the old ones is not reused
+    uint64_t getRenderPassGeneration() const { return renderPassGeneration; }
     bool isFrameInProgress() const { return isFrameStarted; }
+    bool isHeadless() const { return lhllWindow == nullptr; }
+
+    // Waits for the GPU to go idle and recreates the swap chain or offscreen images, frame indices
+    // start over at 0. Has to be called between frames. Resizes recreate the swap chain without waiting
+    void setFramePacing(const FramePacingConfig& config);
+    const FramePacingConfig& getFramePacing() const { return framePacing; }
+    // frame indices are below this, per frame resources can still be made for MAX_FRAMES_IN_FLIGHT
+    int getFramesInFlight() const { return framePacing.framesInFlight; }
+    // With lowLatency set, blocks until the GPU finished the frame submitted last, so input read
+    // after it is not queued behind other frames. Meant right before polling input, does nothing
+    // otherwise. The wait in beginFrame is then on a finished frame
+    void waitForLowLatency();
+
+    // Frames are numbered from 1 in submission order, by the value they signal on the device's
+    // graphics timeline. Anything used by the frame being recorded is free once its number completed
+    uint64_t getFrameNumber() const {
+      assert(isFrameStarted && "Cannot get frame number when frame not in progress");
+      return lhllDevice.graphicsTimeline().getSubmittedValue() + 1;
+    }
+    // of the last submitted frame, 0 before the first
+    uint64_t getSubmittedFrameNumber() const { return lhllDevice.graphicsTimeline().getSubmittedValue(); }
+    // a query of the timeline's counter at most, frames not submitted yet are not complete
+    bool isFrameComplete(uint64_t frameNumber);
+    void waitForFrame(uint64_t frameNumber);
 
     VkCommandBuffer getCurrentCommandBuffer() const {
       assert(isFrameStarted && "Cannot get command buffer when frame is not in progress");
       return commandBuffers[currentFrameIndex];
     }
 
+    VkFramebuffer getCurrentFramebuffer() const {
+      assert(isFrameStarted && "Cannot get framebuffer when frame is not in progress");
+      return lhllSwapChain ? lhllSwapChain->getFrameBuffer(currentImageIndex) : lhllOffscreenTarget->getFrameBuffer(currentImageIndex);
+    }
+
+    VkImageView getCurrentDepthImageView() const {
+      assert(isFrameStarted && "Cannot get depth image view when frame is not in progress");
+      return lhllSwapChain ? lhllSwapChain->getDepthImageView(currentImageIndex) : lhllOffscreenTarget->getDepthImageView(currentImageIndex);
+    }
+
+    // the attachments of the swap chain render passes, for the render graph
+    VkImage getCurrentImage() const {
+      assert(isFrameStarted && "Cannot get swap chain image when frame is not in progress");
+      return lhllSwapChain ? lhllSwapChain->getImage(currentImageIndex) : lhllOffscreenTarget->getImage(currentImageIndex);
+    }
+
+    VkImage getCurrentDepthImage() const {
+      assert(isFrameStarted && "Cannot get depth image when frame is not in progress");
+      return lhllSwapChain ? lhllSwapChain->getDepthImage(currentImageIndex) : lhllOffscreenTarget->getDepthImage(currentImageIndex);
+    }
+
+    VkImageAspectFlags getDepthAspectMask() const { return lhllSwapChain ? lhllSwapChain->getDepthAspectMask() : lhllOffscreenTarget->getDepthAspectMask(); }
+
     int getFrameIndex() const {
       assert(isFrameStarted && "Cannot get frame index when frame not in progress");
       return currentFrameIndex;
     }
 
+    // nullptr when there is nothing to render into, while the swap chain is out of date or the window
+    // is minimized, in which case it blocks until the next window event. Releases what the device's
+    // deletion queue holds for completed frames
     VkCommandBuffer beginFrame();
     void endFrame();
-    void beginSwapChainRenderPass(VkCommandBuffer commandBuffer);
+    // with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS the secondary buffers set the viewport and scissor
+    void beginSwapChainRenderPass(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
     void endSwapChainRenderPass(VkCommandBuffer commandBuffer);
+    // begins the render pass again after it was ended, keeping what was drawn, with inline contents
+    void resumeSwapChainRenderPass(VkCommandBuffer commandBuffer);
 
   private:
     void createCommandBuffers();
     void freeCommandBuffers();
-    void recreateSwapChain();
+    // false while the window is minimized, the swap chain is then left out of date
+    bool recreateSwapChain();
+    void setViewportAndScissor(VkCommandBuffer commandBuffer);
+
+    VkRenderPass getLoadRenderPass() const { return lhllSwapChain ? lhllSwapChain->getLoadRenderPass() : lhllOffscreenTarget->getLoadRenderPass(); }
 
-    LhllWindow& lhllWindow;
+    // nullptr when headless
+    LhllWindow* lhllWindow = nullptr;
     LhllDevice& lhllDevice;
+    // only one of them exists
     std::unique_ptr<LhllSwapChain> lhllSwapChain;
+    std::unique_ptr<LhllOffscreenTarget> lhllOffscreenTarget;
+    bool swapChainOutdated{false};
+    uint64_t renderPassGeneration{0};
+    FramePacingConfig framePacing;
     std::vector<VkCommandBuffer> commandBuffers;
 
     uint32_t currentImageIndex;
     int currentFrameIndex{0};
+    // the frame number last submitted from each frame slot, waited on before the slot is used again
+    std::vector<uint64_t> slotFrameNumbers;
     bool isFrameStarted{false};
   };
 }
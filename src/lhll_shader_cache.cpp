@@ -0,0 +1,138 @@
+#ifndef ENGINE_DIR
+#define ENGINE_DIR "../"
+#endif
+
+#include "lhll_shader_cache.hpp"
+
+#ifdef LHLL_EMBED_SHADERS
+#include "lhll_embedded_shaders.hpp"
+#endif
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace lhll {
+  LhllShaderCache::LhllShaderCache(LhllDevice& device) : lhllDevice{device} {}
+
+  LhllShaderCache::~LhllShaderCache() {
+    assert(modules.empty() && "Shader modules still acquired when destroying the shader cache");
+    for (auto& kv : modules) {
+      vkDestroyShaderModule(lhllDevice.device(), kv.second.module, nullptr);
+    }
+  }
+
+  std::shared_ptr<const LhllShaderCode> LhllShaderCache::loadCode(const std::string& filepath) {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      auto it = codeByPath.find(filepath);
+      if (it != codeByPath.end()) {
+        return it->second;
+      }
+    }
+
+    auto code = std::make_shared<LhllShaderCode>();
+#ifdef LHLL_EMBED_SHADERS
+    if (auto embedded = findEmbeddedShader(filepath)) {
+      code->words.resize(embedded->size / sizeof(uint32_t));
+      std::memcpy(code->words.data(), embedded->data, code->words.size() * sizeof(uint32_t));
+    }
+    else {
+      code->words = readFile(filepath);
+    }
+#else
+    code->words = readFile(filepath);
+#endif
+    code->hash = hashCode(code->words);
+
+    std::lock_guard<std::mutex> lock{mutex};
+    return codeByPath.emplace(filepath, std::move(code)).first->second;
+  }
+
+  std::shared_ptr<const LhllShaderCode> LhllShaderCache::reloadCode(const std::string& filepath) {
+    auto code = std::make_shared<LhllShaderCode>();
+    code->words = readFile(filepath);
+    code->hash = hashCode(code->words);
+
+    std::lock_guard<std::mutex> lock{mutex};
+    codeByPath[filepath] = code;
+    return code;
+  }
+
+  VkShaderModule LhllShaderCache::acquireModule(const LhllShaderCode& code) {
+    std::lock_guard<std::mutex> lock{mutex};
+
+    auto it = findModule(code);
+    if (it != modules.end()) {
+      it->second.refCount++;
+      return it->second.module;
+    }
+
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.words.size() * sizeof(uint32_t);
+    createInfo.pCode = code.words.data();
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(lhllDevice.device(), &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create shader module");
+    }
+
+    modules.emplace(code.hash, ModuleEntry{code.words, shaderModule, 1});
+    return shaderModule;
+  }
+
+  void LhllShaderCache::releaseModule(const LhllShaderCode& code) {
+    std::lock_guard<std::mutex> lock{mutex};
+
+    auto it = findModule(code);
+    assert(it != modules.end() && "Releasing a shader module that was never acquired");
+    if (--it->second.refCount == 0) {
+      vkDestroyShaderModule(lhllDevice.device(), it->second.module, nullptr);
+      modules.erase(it);
+    }
+  }
+
+  std::unordered_multimap<uint64_t, LhllShaderCache::ModuleEntry>::iterator LhllShaderCache::findModule(const LhllShaderCode& code) {
+    auto range = modules.equal_range(code.hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second.words == code.words) {
+        return it;
+      }
+    }
+    return modules.end();
+  }
+
+  // 64 bit FNV-1a over the SPIR-V words
+  uint64_t LhllShaderCache::hashCode(const std::vector<uint32_t>& words) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t word : words) {
+      for (int i = 0; i < 4; i++) {
+        hash ^= (word >> (i * 8)) & 0xff;
+        hash *= 1099511628211ull;
+      }
+    }
+    return hash;
+  }
+
+  std::vector<uint32_t> LhllShaderCache::readFile(const std::string& filepath) {
+    std::ifstream file{ENGINE_DIR + filepath, std::ios::ate | std::ios::binary};
+
+    if (!file.is_open()) {
+      throw std::runtime_error("Failed to open file: " + filepath);
+    }
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    if (fileSize % sizeof(uint32_t) != 0) {
+      throw std::runtime_error("Invalid SPIR-V file size: " + filepath);
+    }
+    std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
+
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
+    file.close();
+
+    return buffer;
+  }
+}
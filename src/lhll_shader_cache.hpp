@@ -0,0 +1,60 @@
+#ifndef LHLL_SHADER_CACHE_HPP
+#define LHLL_SHADER_CACHE_HPP
+
+#include "lhll_device.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lhll {
+  struct LhllShaderCode {
+    uint64_t hash;
+    std::vector<uint32_t> words;
+  };
+
+  // Shares VkShaderModules between pipelines by SPIR-V hash, the words are compared on a hash hit so
+  // colliding code gets its own module. Modules are reference counted and destroyed as soon as the
+  // last pipeline being built from them is done, a VkPipeline does not need its modules after creation.
+  class LhllShaderCache {
+  public:
+    LhllShaderCache(LhllDevice& device);
+    ~LhllShaderCache();
+
+    LhllShaderCache(const LhllShaderCache&) = delete;
+    LhllShaderCache& operator=(const LhllShaderCache&) = delete;
+
+    // Uses the SPIR-V embedded into the binary when available, the file otherwise
+    std::shared_ptr<const LhllShaderCode> loadCode(const std::string& filepath);
+    // Rereads the file after it changed on disk, later loadCode calls for filepath return the new
+    // code even when the shader is embedded. Code handed out before stays valid
+    std::shared_ptr<const LhllShaderCode> reloadCode(const std::string& filepath);
+
+    VkShaderModule acquireModule(const LhllShaderCode& code);
+    void releaseModule(const LhllShaderCode& code);
+
+    static uint64_t hashCode(const std::vector<uint32_t>& words);
+
+  private:
+    struct ModuleEntry {
+      std::vector<uint32_t> words;
+      VkShaderModule module;
+      uint32_t refCount;
+    };
+
+    std::unordered_multimap<uint64_t, ModuleEntry>::iterator findModule(const LhllShaderCode& code);
+
+    static std::vector<uint32_t> readFile(const std::string& filepath);
+
+    LhllDevice& lhllDevice;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<const LhllShaderCode>> codeByPath;
+    std::unordered_multimap<uint64_t, ModuleEntry> modules;
+  };
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef ENGINE_DIR
+#define ENGINE_DIR "../"
+#endif
+
+#include "lhll_shader_watcher.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <set>
+
+#if defined(__linux__) && defined(LHLL_GLSL_VALIDATOR)
+#define LHLL_SHADER_WATCHER_SUPPORTED
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace lhll {
+  static bool isShaderSource(const std::string& name) {
+    auto endsWith = [&name](const std::string& suffix) {
+      return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return endsWith(".vert") || endsWith(".frag") || endsWith(".comp");
+  }
+
+  LhllShaderWatcher::LhllShaderWatcher(const std::string& shaderDirectory) : shaderDirectory{shaderDirectory} {
+#ifdef LHLL_SHADER_WATCHER_SUPPORTED
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+      std::cerr << "Shader hot reload disabled: inotify_init1 failed" << std::endl;
+      return;
+    }
+
+    // editors either write in place or write a temporary and rename it over the source
+    std::string watchPath = ENGINE_DIR + shaderDirectory;
+    if (inotify_add_watch(inotifyFd, watchPath.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      std::cerr << "Shader hot reload disabled: cannot watch " << watchPath << std::endl;
+      close(inotifyFd);
+      inotifyFd = -1;
+      return;
+    }
+
+    thread = std::thread([this]() { watchLoop(); });
+    std::cout << "Watching " << watchPath << " for shader changes" << std::endl;
+#endif
+  }
+
+  LhllShaderWatcher::~LhllShaderWatcher() {
+    stopping = true;
+    if (thread.joinable()) {
+      thread.join();
+    }
+#ifdef LHLL_SHADER_WATCHER_SUPPORTED
+    if (inotifyFd >= 0) {
+      close(inotifyFd);
+    }
+#endif
+  }
+
+  std::vector<std::string> LhllShaderWatcher::takeRecompiledShaders() {
+    std::lock_guard<std::mutex> lock{mutex};
+    std::vector<std::string> result;
+    result.swap(recompiledShaders);
+    return result;
+  }
+
+  void LhllShaderWatcher::watchLoop() {
+#ifdef LHLL_SHADER_WATCHER_SUPPORTED
+    alignas(inotify_event) char buffer[4096];
+
+    while (!stopping) {
+      // woken up regularly to notice the destructor
+      pollfd pollFd{inotifyFd, POLLIN, 0};
+      if (poll(&pollFd, 1, 100) <= 0) {
+        continue;
+      }
+
+      // one save usually produces several events, compile each source once per batch
+      std::set<std::string> changedSources;
+      ssize_t length;
+      while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (char* ptr = buffer; ptr < buffer + length;) {
+          auto* event = reinterpret_cast<inotify_event*>(ptr);
+          if (event->len > 0 && isShaderSource(event->name)) {
+            changedSources.insert(event->name);
+          }
+          ptr += sizeof(inotify_event) + event->len;
+        }
+      }
+
+      for (const auto& sourceName : changedSources) {
+        if (compile(sourceName)) {
+          std::lock_guard<std::mutex> lock{mutex};
+          recompiledShaders.push_back(shaderDirectory + "/" + sourceName + ".spv");
+        }
+      }
+    }
+#endif
+  }
+
+  bool LhllShaderWatcher::compile(const std::string& sourceName) {
+#ifdef LHLL_SHADER_WATCHER_SUPPORTED
+    std::string sourcePath = ENGINE_DIR + shaderDirectory + "/" + sourceName;
+    std::string spirvPath = sourcePath + ".spv";
+    std::string tempPath = spirvPath + ".tmp";
+
+    std::string command = std::string{"\""} + LHLL_GLSL_VALIDATOR + "\" -V \"" + sourcePath + "\" -o \"" + tempPath + "\" 2>&1";
+    FILE* pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr) {
+      std::cerr << "Failed to run " << LHLL_GLSL_VALIDATOR << std::endl;
+      return false;
+    }
+
+    std::string output;
+    char line[256];
+    while (fgets(line, sizeof(line), pipe) != nullptr) {
+      output += line;
+    }
+
+    if (pclose(pipe) != 0) {
+      std::cerr << "Failed to compile " << sourceName << ", keeping the previous SPIR-V:\n" << output;
+      std::remove(tempPath.c_str());
+      return false;
+    }
+
+    // the renderer never sees a partially written file
+    if (std::rename(tempPath.c_str(), spirvPath.c_str()) != 0) {
+      std::cerr << "Failed to replace " << spirvPath << std::endl;
+      std::remove(tempPath.c_str());
+      return false;
+    }
+
+    std::cout << "Recompiled " << sourceName << std::endl;
+    return true;
+#else
+    return false;
+#endif
+  }
+}
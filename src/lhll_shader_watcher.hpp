@@ -0,0 +1,43 @@
+#ifndef LHLL_SHADER_WATCHER_HPP
+#define LHLL_SHADER_WATCHER_HPP
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace lhll {
+  // Watches the GLSL sources (inotify, Linux only) and recompiles changed ones to SPIR-V on its own
+  // thread with the glslangValidator the Shaders target uses. Sources that fail to compile leave the
+  // previous .spv untouched
+  class LhllShaderWatcher {
+  public:
+    // shaderDirectory is relative to ENGINE_DIR, like the paths pipelines are requested with
+    LhllShaderWatcher(const std::string& shaderDirectory = "shaders");
+    ~LhllShaderWatcher();
+
+    LhllShaderWatcher(const LhllShaderWatcher&) = delete;
+    LhllShaderWatcher& operator=(const LhllShaderWatcher&) = delete;
+
+    bool isWatching() const { return thread.joinable(); }
+
+    // SPIR-V paths ("shaders/x.frag.spv") that were successfully recompiled since the last call
+    std::vector<std::string> takeRecompiledShaders();
+
+  private:
+    void watchLoop();
+    bool compile(const std::string& sourceName);
+
+    std::string shaderDirectory;
+    int inotifyFd = -1;
+
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+
+    std::mutex mutex;
+    std::vector<std::string> recompiledShaders;
+  };
+}
+
+#endif
@@ -1,7 +1,11 @@
 #include "lhll_swap_chain.hpp"
 
+#include "lhll_timeline.hpp"
+
 // std
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -11,20 +15,25 @@
 
 namespace lhll {
 
-LhllSwapChain::LhllSwapChain(LhllDevice &deviceRef, VkExtent2D extent)
-    : device{deviceRef}, windowExtent{extent} {
+LhllSwapChain::LhllSwapChain(LhllDevice &deviceRef, VkExtent2D extent, const FramePacingConfig &config)
+    : device{deviceRef}, windowExtent{extent}, config{config} {
   init();
 }
 
-LhllSwapChain::LhllSwapChain(LhllDevice &deviceRef, VkExtent2D extent, std::shared_ptr<LhllSwapChain> previous)
-    : device{deviceRef}, windowExtent{extent}, oldSwapChain{previous} {
+LhllSwapChain::LhllSwapChain(
+    LhllDevice &deviceRef,
+    VkExtent2D extent,
+    std::shared_ptr<LhllSwapChain> previous,
+    const FramePacingConfig &config)
+    : device{deviceRef}, windowExtent{extent}, config{config}, oldSwapChain{previous} {
   init();
 
-  // clean up old swap chain
+  // the caller keeps it until its frames are done
   oldSwapChain = nullptr;
 }
 
 void LhllSwapChain::init() {
+  assert(config.framesInFlight >= 1 && config.framesInFlight <= MAX_FRAMES_IN_FLIGHT && "frames in flight out of range");
   createSwapChain();
   createImageViews();
   createRenderPass();
@@ -55,23 +64,16 @@ LhllSwapChain::~LhllSwapChain() {
   }
 
   vkDestroyRenderPass(device.device(), renderPass, nullptr);
+  vkDestroyRenderPass(device.device(), loadRenderPass, nullptr);
 
   // cleanup synchronization objects
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (size_t i = 0; i < renderFinishedSemaphores.size(); i++) {
     vkDestroySemaphore(device.device(), renderFinishedSemaphores[i], nullptr);
     vkDestroySemaphore(device.device(), imageAvailableSemaphores[i], nullptr);
-    vkDestroyFence(device.device(), inFlightFences[i], nullptr);
   }
 }
 
 VkResult LhllSwapChain::acquireNextImage(uint32_t *imageIndex) {
-  vkWaitForFences(
-      device.device(),
-      1,
-      &inFlightFences[currentFrame],
-      VK_TRUE,
-      std::numeric_limits<uint64_t>::max());
-
   VkResult result = vkAcquireNextImageKHR(
       device.device(),
       swapChain,
@@ -84,31 +86,44 @@ VkResult LhllSwapChain::acquireNextImage(uint32_t *imageIndex) {
 }
 
 VkResult LhllSwapChain::submitCommandBuffers(
-    const VkCommandBuffer *buffers, uint32_t *imageIndex) {
-  if (imagesInFlight[*imageIndex] != VK_NULL_HANDLE) {
-    vkWaitForFences(device.device(), 1, &imagesInFlight[*imageIndex], VK_TRUE, UINT64_MAX);
-  }
-  imagesInFlight[*imageIndex] = inFlightFences[currentFrame];
+    const VkCommandBuffer *buffers, uint32_t *imageIndex, uint64_t frameNumber) {
+  VkSemaphore timeline = device.graphicsTimeline().getSemaphore();
+
+  // The image can be handed out again before the frame that last rendered into it finished, when it
+  // was presented early. Instead of blocking here, the GPU waits for that frame before starting
+  VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], timeline};
+  VkPipelineStageFlags waitStages[] = {
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_PIPELINE_STAGE_ALL_COMMANDS_BIT};
+  uint64_t waitValues[] = {0, imageFrames[*imageIndex]};
+  imageFrames[*imageIndex] = frameNumber;
+
+  // binary semaphores ignore their value
+  VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame], timeline};
+  uint64_t signalValues[] = {0, frameNumber};
+
+  VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+  timelineInfo.waitSemaphoreValueCount = 2;
+  timelineInfo.pWaitSemaphoreValues = waitValues;
+  timelineInfo.signalSemaphoreValueCount = 2;
+  timelineInfo.pSignalSemaphoreValues = signalValues;
 
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = &timelineInfo;
 
-  VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.waitSemaphoreCount = 2;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
 
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = buffers;
 
-  VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.signalSemaphoreCount = 2;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  vkResetFences(device.device(), 1, &inFlightFences[currentFrame]);
-  if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, inFlightFences[currentFrame]) !=
-      VK_SUCCESS) {
+  if (vkQueueSubmit(device.graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
     throw std::runtime_error("failed to submit draw command buffer!");
   }
 
@@ -126,7 +141,7 @@ VkResult LhllSwapChain::submitCommandBuffers(
 
   auto result = vkQueuePresentKHR(device.presentQueue(), &presentInfo);
 
-  currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  currentFrame = (currentFrame + 1) % config.framesInFlight;
 
   return result;
 }
@@ -135,10 +150,11 @@ void LhllSwapChain::createSwapChain() {
   SwapChainSupportDetails swapChainSupport = device.getSwapChainSupport();
 
   VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-  VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+  presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
   VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+  uint32_t imageCount = config.imageCount > 0 ? config.imageCount : swapChainSupport.capabilities.minImageCount + 1;
+  imageCount = std::max(imageCount, swapChainSupport.capabilities.minImageCount);
   if (swapChainSupport.capabilities.maxImageCount > 0 &&
       imageCount > swapChainSupport.capabilities.maxImageCount) {
     imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -214,14 +230,26 @@ void LhllSwapChain::createImageViews() {
 }
 
 void LhllSwapChain::createRenderPass() {
+  createRenderPasses(device, getSwapChainImageFormat(), findDepthFormat(), renderPass, loadRenderPass);
+}
+
+// The attachments stay in their attachment layouts and the render passes have no external
+// dependencies, the render graph records the transitions and barriers around them
+void LhllSwapChain::createRenderPasses(
+    LhllDevice &device,
+    VkFormat colorFormat,
+    VkFormat depthFormat,
+    VkRenderPass &renderPass,
+    VkRenderPass &loadRenderPass) {
   VkAttachmentDescription depthAttachment{};
-  depthAttachment.format = findDepthFormat();
+  depthAttachment.format = depthFormat;
   depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
   depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  // kept, the occlusion culling builds its depth pyramid from it
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
   depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference depthAttachmentRef{};
@@ -229,14 +257,14 @@ void LhllSwapChain::createRenderPass() {
   depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
   VkAttachmentDescription colorAttachment = {};
-  colorAttachment.format = getSwapChainImageFormat();
+  colorAttachment.format = colorFormat;
   colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
   colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference colorAttachmentRef = {};
   colorAttachmentRef.attachment = 0;
@@ -248,14 +276,6 @@ void LhllSwapChain::createRenderPass() {
   subpass.pColorAttachments = &colorAttachmentRef;
   subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
-  VkSubpassDependency dependency = {};
-  dependency.dstSubpass = 0;
-  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.srcAccessMask = 0;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-
   std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
   VkRenderPassCreateInfo renderPassInfo = {};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -263,12 +283,23 @@ void LhllSwapChain::createRenderPass() {
   renderPassInfo.pAttachments = attachments.data();
   renderPassInfo.subpassCount = 1;
   renderPassInfo.pSubpasses = &subpass;
-  renderPassInfo.dependencyCount = 1;
-  renderPassInfo.pDependencies = &dependency;
+  renderPassInfo.dependencyCount = 0;
+  renderPassInfo.pDependencies = nullptr;
 
   if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
     throw std::runtime_error("failed to create render pass!");
   }
+
+  // Same attachments loaded instead of cleared, only the load/store ops differ so it is compatible
+  // with the framebuffers and pipelines of the first one
+  colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments = {colorAttachment, depthAttachment};
+
+  if (vkCreateRenderPass(device.device(), &renderPassInfo, nullptr, &loadRenderPass) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create load render pass!");
+  }
 }
 
 void LhllSwapChain::createFramebuffers() {
@@ -317,7 +348,7 @@ void LhllSwapChain::createDepthResources() {
     imageInfo.format = depthFormat;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     imageInfo.flags = 0;
@@ -346,24 +377,18 @@ void LhllSwapChain::createDepthResources() {
 }
 
 void LhllSwapChain::createSyncObjects() {
-  imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-  imagesInFlight.resize(imageCount(), VK_NULL_HANDLE);
+  imageAvailableSemaphores.resize(config.framesInFlight);
+  renderFinishedSemaphores.resize(config.framesInFlight);
+  imageFrames.resize(imageCount(), 0);
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (size_t i = 0; i < imageAvailableSemaphores.size(); i++) {
     if (vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) !=
             VK_SUCCESS ||
         vkCreateSemaphore(device.device(), &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) !=
-            VK_SUCCESS ||
-        vkCreateFence(device.device(), &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+            VK_SUCCESS) {
       throw std::runtime_error("failed to create synchronization objects for a frame!");
     }
   }
@@ -383,24 +408,34 @@ VkSurfaceFormatKHR LhllSwapChain::chooseSwapSurfaceFormat(
 
 VkPresentModeKHR LhllSwapChain::chooseSwapPresentMode(
     const std::vector<VkPresentModeKHR> &availablePresentModes) {
-  for (const auto &availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      std::cout << "Present mode: Mailbox" << std::endl;
-      return availablePresentMode;
+  for (VkPresentModeKHR preferred : config.presentModes) {
+    if (std::find(availablePresentModes.begin(), availablePresentModes.end(), preferred) !=
+        availablePresentModes.end()) {
+      std::cout << "Present mode: " << presentModeName(preferred) << std::endl;
+      return preferred;
     }
   }
 
-  //for (const auto &availablePresentMode : availablePresentModes) {
-  //  if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-  //    std::cout << "Present mode: Immediate" << std::endl;
-  //    return availablePresentMode;
-  //  }
-  //}
-
-  std::cout << "Present mode: V-Sync" << std::endl;
+  // the only mode every surface supports
+  std::cout << "Present mode: " << presentModeName(VK_PRESENT_MODE_FIFO_KHR) << std::endl;
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+const char *LhllSwapChain::presentModeName(VkPresentModeKHR presentMode) {
+  switch (presentMode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "Immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "Mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+      return "V-Sync";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "Relaxed V-Sync";
+    default:
+      return "Unknown";
+  }
+}
+
 VkExtent2D LhllSwapChain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
   if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
     return capabilities.currentExtent;
@@ -417,11 +452,24 @@ VkExtent2D LhllSwapChain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capab
   }
 }
 
-VkFormat LhllSwapChain::findDepthFormat() {
+VkImageAspectFlags LhllSwapChain::getDepthAspectMask() const {
+  return depthAspectMask(swapChainDepthFormat);
+}
+
+VkImageAspectFlags LhllSwapChain::depthAspectMask(VkFormat depthFormat) {
+  if (depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT) {
+    return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+  }
+  return VK_IMAGE_ASPECT_DEPTH_BIT;
+}
+
+VkFormat LhllSwapChain::findDepthFormat() { return findDepthFormat(device); }
+
+VkFormat LhllSwapChain::findDepthFormat(LhllDevice &device) {
   return device.findSupportedFormat(
       {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
       VK_IMAGE_TILING_OPTIMAL,
-      VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+      VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 }
 
 }  // namespace lhll
@@ -13,12 +13,31 @@
 
 namespace lhll {
 
+// How frames are queued up and presented, chosen per deployment to trade throughput for latency
+struct FramePacingConfig {
+  // frames recorded while the GPU still works on earlier ones, 1 to LhllSwapChain::MAX_FRAMES_IN_FLIGHT
+  int framesInFlight = 2;
+  // the first one the surface supports is used, FIFO when none is
+  std::vector<VkPresentModeKHR> presentModes{VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR};
+  // swap chain images, 0 for one more than the surface's minimum, clamped to the surface's limits
+  uint32_t imageCount = 0;
+  // LhllRenderer::waitForLowLatency waits for the last submitted frame, so input is read after it
+  bool lowLatency = false;
+};
+
 class LhllSwapChain {
  public:
-  static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-
-  LhllSwapChain(LhllDevice &deviceRef, VkExtent2D windowExtent);
-  LhllSwapChain(LhllDevice &deviceRef, VkExtent2D windowExtent, std::shared_ptr<LhllSwapChain> previous);
+  // upper bound of FramePacingConfig::framesInFlight, per frame resources are created for this many
+  static constexpr int MAX_FRAMES_IN_FLIGHT = 4;
+
+  LhllSwapChain(LhllDevice &deviceRef, VkExtent2D windowExtent, const FramePacingConfig &config = {});
+  // Replaces previous without waiting for its frames, previous has to be kept alive until the frames
+  // submitted to it finished
+  LhllSwapChain(
+      LhllDevice &deviceRef,
+      VkExtent2D windowExtent,
+      std::shared_ptr<LhllSwapChain> previous,
+      const FramePacingConfig &config = {});
   ~LhllSwapChain();
 
   LhllSwapChain(const LhllSwapChain &) = delete;
@@ -26,7 +45,17 @@ class LhllSwapChain {
 
   VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
   VkRenderPass getRenderPass() { return renderPass; }
+  // continues a frame after getRenderPass ended, keeping the color and depth it left
+  VkRenderPass getLoadRenderPass() { return loadRenderPass; }
+  // Both render passes expect the color attachment in VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL and the
+  // depth in VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL and leave them so, the transitions and
+  // the synchronization with other passes and presentation are up to the caller
+  VkImage getImage(int index) { return swapChainImages[index]; }
   VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+  VkImage getDepthImage(int index) { return depthImages[index]; }
+  VkImageView getDepthImageView(int index) { return depthImageViews[index]; }
+  // for barriers on the depth images, the views only have the depth aspect
+  VkImageAspectFlags getDepthAspectMask() const;
   size_t imageCount() { return swapChainImages.size(); }
   VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
   VkExtent2D getSwapChainExtent() { return swapChainExtent; }
@@ -38,8 +67,26 @@ class LhllSwapChain {
   }
   VkFormat findDepthFormat();
 
+  // shared with LhllOffscreenTarget, so pipelines made for either render pass work with both
+  static VkFormat findDepthFormat(LhllDevice &device);
+  static VkImageAspectFlags depthAspectMask(VkFormat depthFormat);
+  static void createRenderPasses(
+      LhllDevice &device,
+      VkFormat colorFormat,
+      VkFormat depthFormat,
+      VkRenderPass &renderPass,
+      VkRenderPass &loadRenderPass);
+
+  int getFramesInFlight() const { return config.framesInFlight; }
+  VkPresentModeKHR getPresentMode() const { return presentMode; }
+
+  // The caller waits for the frame that used the frame slot before, framesInFlight frames ago, so its
+  // semaphores are free again
   VkResult acquireNextImage(uint32_t *imageIndex);
-  VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
+  // signals frameNumber on the device's graphics timeline when the frame finished
+  VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex, uint64_t frameNumber);
+
+  static const char *presentModeName(VkPresentModeKHR presentMode);
 
   bool compareSwapFormats(const LhllSwapChain& swapChain) const {
     return  swapChain.swapChainDepthFormat == swapChainDepthFormat &&
@@ -68,6 +115,7 @@ class LhllSwapChain {
 
   std::vector<VkFramebuffer> swapChainFramebuffers;
   VkRenderPass renderPass;
+  VkRenderPass loadRenderPass;
 
   std::vector<VkImage> depthImages;
   std::vector<VkDeviceMemory> depthImageMemorys;
@@ -77,14 +125,16 @@ class LhllSwapChain {
 
   LhllDevice &device;
   VkExtent2D windowExtent;
+  FramePacingConfig config;
+  VkPresentModeKHR presentMode;
 
   VkSwapchainKHR swapChain;
   std::shared_ptr<LhllSwapChain> oldSwapChain;
 
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
-  std::vector<VkFence> imagesInFlight;
+  // the frame that last rendered into each image, 0 for none
+  std::vector<uint64_t> imageFrames;
   size_t currentFrame = 0;
 };
 
@@ -0,0 +1,62 @@
+#include "lhll_thread_pool.hpp"
+
+#include <algorithm>
+
+namespace lhll {
+  LhllThreadPool::LhllThreadPool(uint32_t threadCount) {
+    if (threadCount == 0) {
+      threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // one worker is kept free for frame work when there is more than one
+    maxBackgroundTasks = std::max(1u, threadCount - 1);
+
+    workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++) {
+      workers.emplace_back([this]() { workerLoop(); });
+    }
+  }
+
+  LhllThreadPool::~LhllThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      stopping = true;
+    }
+    condition.notify_all();
+
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  bool LhllThreadPool::canTakeTask() const {
+    return !frameTasks.empty() || (!backgroundTasks.empty() && runningBackgroundTasks < maxBackgroundTasks);
+  }
+
+  void LhllThreadPool::workerLoop() {
+    while (true) {
+      std::function<void()> task;
+      bool background = false;
+      {
+        std::unique_lock<std::mutex> lock{mutex};
+        condition.wait(lock, [this]() { return canTakeTask() || (stopping && frameTasks.empty() && backgroundTasks.empty()); });
+        if (!canTakeTask()) {
+          return;
+        }
+        background = frameTasks.empty();
+        auto& tasks = background ? backgroundTasks : frameTasks;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+        if (background) runningBackgroundTasks++;
+      }
+      task();
+      if (background) {
+        {
+          std::lock_guard<std::mutex> lock{mutex};
+          runningBackgroundTasks--;
+        }
+        condition.notify_all();
+      }
+    }
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef LHLL_THREAD_POOL_HPP
+#define LHLL_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lhll {
+  // Frame work (recording, software occlusion bands) is picked before background work (pipeline
+  // compiles), and background work never occupies every worker, so a frame never waits for a compile
+  // to finish before its tasks start
+  class LhllThreadPool {
+  public:
+    enum class Priority { Frame, Background };
+
+    // threadCount of 0 uses one worker per hardware thread
+    LhllThreadPool(uint32_t threadCount = 0);
+    ~LhllThreadPool();
+
+    LhllThreadPool(const LhllThreadPool&) = delete;
+    LhllThreadPool& operator=(const LhllThreadPool&) = delete;
+
+    template <typename F>
+    auto submit(F&& task, Priority priority = Priority::Frame) -> std::future<decltype(task())> {
+      auto packagedTask = std::make_shared<std::packaged_task<decltype(task())()>>(std::forward<F>(task));
+      auto future = packagedTask->get_future();
+      {
+        std::lock_guard<std::mutex> lock{mutex};
+        (priority == Priority::Frame ? frameTasks : backgroundTasks).emplace_back([packagedTask]() { (*packagedTask)(); });
+      }
+      // a woken worker may not be allowed to take a background task, wake all so one that can does
+      condition.notify_all();
+      return future;
+    }
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+  private:
+    void workerLoop();
+
+    bool canTakeTask() const;
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> frameTasks;
+    std::deque<std::function<void()>> backgroundTasks;
+    uint32_t maxBackgroundTasks;
+    uint32_t runningBackgroundTasks = 0;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+  };
+}
+
+#endif
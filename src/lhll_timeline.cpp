@@ -0,0 +1,52 @@
+#include "lhll_timeline.hpp"
+
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace lhll {
+  LhllTimeline::LhllTimeline(LhllDevice& device) : lhllDevice{device} {
+    VkSemaphoreTypeCreateInfoKHR typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    if (vkCreateSemaphore(lhllDevice.device(), &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create timeline semaphore!");
+    }
+  }
+
+  LhllTimeline::~LhllTimeline() {
+    vkDestroySemaphore(lhllDevice.device(), semaphore, nullptr);
+  }
+
+  bool LhllTimeline::isComplete(uint64_t value) {
+    assert(value <= submittedValue && "Timeline value was never submitted");
+    if (value <= completedValue) return true;
+
+    uint64_t counter;
+    if (lhllDevice.timelineSemaphore().getCounterValue(lhllDevice.device(), semaphore, &counter) != VK_SUCCESS) {
+      throw std::runtime_error("failed to read timeline semaphore!");
+    }
+    completedValue = counter;
+    return value <= completedValue;
+  }
+
+  void LhllTimeline::wait(uint64_t value) {
+    if (isComplete(value)) return;
+
+    VkSemaphoreWaitInfoKHR waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+    if (lhllDevice.timelineSemaphore().wait(lhllDevice.device(), &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+      throw std::runtime_error("failed to wait for timeline semaphore!");
+    }
+    completedValue = value;
+  }
+}
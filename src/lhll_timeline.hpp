@@ -0,0 +1,42 @@
+#ifndef LHLL_TIMELINE_HPP
+#define LHLL_TIMELINE_HPP
+
+#include "lhll_device.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+namespace lhll {
+  // A timeline semaphore counting the submissions to one queue. Every submission signaling it takes
+  // the next value right before it is submitted, so values are signaled in order and "has submission
+  // n finished" is a comparison with the semaphore's counter. Submissions to other queues can wait
+  // for a value in their VkTimelineSemaphoreSubmitInfo
+  class LhllTimeline {
+  public:
+    LhllTimeline(LhllDevice& device);
+    ~LhllTimeline();
+
+    LhllTimeline(const LhllTimeline&) = delete;
+    LhllTimeline& operator=(const LhllTimeline&) = delete;
+
+    VkSemaphore getSemaphore() const { return semaphore; }
+
+    // the value for the submission about to be made, which has to signal it
+    uint64_t nextValue() { return ++submittedValue; }
+    // of the last submission, values above it are never signaled. Safe to read from any thread
+    uint64_t getSubmittedValue() const { return submittedValue.load(); }
+
+    // queries the counter only when value is above what it was last seen at, 0 is always complete
+    bool isComplete(uint64_t value);
+    // blocks until the submission signaling value finished
+    void wait(uint64_t value);
+
+  private:
+    LhllDevice& lhllDevice;
+    VkSemaphore semaphore;
+    std::atomic<uint64_t> submittedValue{0};
+    uint64_t completedValue = 0;
+  };
+}
+
+#endif
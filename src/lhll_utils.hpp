@@ -1,6 +1,8 @@
 #ifndef LHLL_UTILS_HPP
 #define LHLL_UTILS_HPP
 
+#include <cerrno>
+#include <cstdlib>
 #include <functional>
 
 namespace lhll {
@@ -10,6 +12,19 @@ namespace lhll {
     seed ^= std::hash<T>{}(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
     (hashCombine(seed, rest), ...);
   };
+
+  // Parses all of text as a decimal integer in [min, max], value is left as it is when text is not
+  // one or out of range
+  template <typename T>
+  bool parseInteger(const char* text, T min, T max, T& value) {
+    char* end = nullptr;
+    errno = 0;
+    long long parsed = std::strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE) return false;
+    if (parsed < static_cast<long long>(min) || parsed > static_cast<long long>(max)) return false;
+    value = static_cast<T>(parsed);
+    return true;
+  }
 }
 
 #endif
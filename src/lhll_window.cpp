@@ -22,6 +22,11 @@ namespace lhll {
     glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
   }
 
+  void LhllWindow::setStatus(const std::string& status) {
+    std::string title = status.empty() ? windowName : windowName + " - " + status;
+    glfwSetWindowTitle(window, title.c_str());
+  }
+
   void LhllWindow::createWindowSurface(VkInstance instance, VkSurfaceKHR *surface) {
     if (glfwCreateWindowSurface(instance, window, nullptr, surface) != VK_SUCCESS) {
       throw std::runtime_error("failed to create window surface");
@@ -22,6 +22,8 @@ namespace lhll {
     GLFWwindow* getGLFWwindow() const { return window; }
 
     void createWindowSurface(VkInstance instance, VkSurfaceKHR *surface);
+    // shown in the title after the window's name
+    void setStatus(const std::string& status);
 
   private:
     static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
@@ -1,11 +1,56 @@
 #include "first_app.hpp"
+#include "lhll_utils.hpp"
 
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 
-int main() {
-  lhll::FirstApp app{};
+static void printUsage(const char* name) {
+  std::cerr << "usage: " << name << " [--frames-in-flight 1-" << lhll::LhllSwapChain::MAX_FRAMES_IN_FLIGHT << "]"
+            << " [--present-mode mailbox|immediate|fifo|fifo-relaxed] [--image-count N] [--low-latency]\n";
+}
+
+// the frame pacing of this deployment, the defaults are LhllRenderer's
+static bool parseFramePacing(int argc, char** argv, lhll::FramePacingConfig& config) {
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--frames-in-flight") == 0 && hasValue) {
+      if (!lhll::parseInteger(argv[++i], 1, lhll::LhllSwapChain::MAX_FRAMES_IN_FLIGHT, config.framesInFlight)) return false;
+    }
+    else if (std::strcmp(argv[i], "--present-mode") == 0 && hasValue) {
+      const char* mode = argv[++i];
+      VkPresentModeKHR presentMode;
+      if (std::strcmp(mode, "mailbox") == 0) presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+      else if (std::strcmp(mode, "immediate") == 0) presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+      else if (std::strcmp(mode, "fifo") == 0) presentMode = VK_PRESENT_MODE_FIFO_KHR;
+      else if (std::strcmp(mode, "fifo-relaxed") == 0) presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+      else return false;
+      // FIFO is the fallback when the surface does not have it
+      config.presentModes = {presentMode};
+    }
+    else if (std::strcmp(argv[i], "--image-count") == 0 && hasValue) {
+      if (!lhll::parseInteger<uint32_t>(argv[++i], 0, UINT32_MAX, config.imageCount)) return false;
+    }
+    else if (std::strcmp(argv[i], "--low-latency") == 0) {
+      config.lowLatency = true;
+    }
+    else {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  lhll::FramePacingConfig framePacing{};
+  if (!parseFramePacing(argc, argv, framePacing)) {
+    printUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  lhll::FirstApp app{framePacing};
 
   try {
     app.run();
@@ -1,78 +1,457 @@
 #include "simple_render_system.hpp"
 
-#define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#include <glm/glm.hpp>
-#include <glm/gtc/constants.hpp>
+#include "lhll_swap_chain.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <chrono>
+#include <iostream>
 #include <stdexcept>
 
 namespace lhll {
 
-  struct SimplePushConstantData {
-    glm::mat4 modelMatrix{1.f};
-    glm::mat4 normalMatrix{1.f};
-  };
+  static const std::string vertShaderPath = "shaders/simple_shader.vert.spv";
+  static const std::string fragShaderPath = "shaders/simple_shader.frag.spv";
+  static const std::string depthPrepassVertShaderPath = "shaders/depth_prepass.vert.spv";
+  static const std::string depthPrepassFragShaderPath = "shaders/depth_prepass.frag.spv";
 
-  SimpleRenderSystem::SimpleRenderSystem(LhllDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) : lhllDevice{device} {
-    createPipelineLayout(globalSetLayout);
-    createPipeline(renderPass);
-  }
+  // below this many groups per chunk the recording is cheaper than handing it to a worker
+  static constexpr uint32_t MIN_GROUPS_PER_CHUNK = 256;
 
-  SimpleRenderSystem::~SimpleRenderSystem() {
-    vkDestroyPipelineLayout(lhllDevice.device(), pipelineLayout, nullptr);
+  // Objects that write depth with an ordinary test. Their final depth is known after the pre-pass, so
+  // the main pass only has to shade where it is EQUAL
+  static bool isDepthPrepassed(const RenderState& renderState) {
+    return renderState.depthTestEnable && renderState.depthWriteEnable && renderState.depthCompareOp != VK_COMPARE_OP_ALWAYS && renderState.depthCompareOp != VK_COMPARE_OP_NEVER;
   }
 
-  void SimpleRenderSystem::createPipelineLayout(VkDescriptorSetLayout globalSetLayout) {
+  SimpleRenderSystem::SimpleRenderSystem(LhllDevice& device, LhllPipelineRegistry& pipelineRegistry, LhllThreadPool& threadPool, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout) : lhllDevice{device}, lhllPipelineRegistry{pipelineRegistry}, drawBatcher{device}, cpuCullSystem{threadPool}, gpuCullSystem{device, pipelineRegistry}, parallelRecorder{device, threadPool} {
+    for (uint32_t i = 0; i < parallelRecorder.getMaxChunkCount(); i++) {
+      recordingChunks.push_back({std::make_unique<LhllRenderStateTracker>(device), nullptr});
+    }
 
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(SimplePushConstantData);
+    createInstanceSets();
+    pipelineLayout = std::make_unique<LhllPipelineLayout>(lhllDevice, std::vector<VkDescriptorSetLayout>{globalSetLayout, instanceSetLayout->getDescriptorSetLayout()});
+    createPipeline(renderPass);
+  }
 
-    std::vector<VkDescriptorSetLayout> descriptorSetLayouts{globalSetLayout};
+  void SimpleRenderSystem::createInstanceSets() {
+    // binding 0 is the object table, binding 1 the object index of every instance
+    instanceSetLayout = LhllDescriptorSetLayout::Builder(lhllDevice)
+                            .addBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+                            .addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+                            .build();
+    // one set for the instances written by the CPU, one for the GPU culled ones and one for the late
+    // pass of the occlusion cull per frame
+    instancePool = LhllDescriptorPool::Builder(lhllDevice).setMaxSets(3 * LhllSwapChain::MAX_FRAMES_IN_FLIGHT).addPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6 * LhllSwapChain::MAX_FRAMES_IN_FLIGHT).build();
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-    pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    instanceSets.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    visibleInstanceSets.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    lateVisibleInstanceSets.resize(LhllSwapChain::MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < instanceSets.size(); i++) {
+      auto& objectTableBuffer = drawBatcher.getObjectTable().getBuffer(i);
+      updateInstanceSet(instanceSets[i], objectTableBuffer, drawBatcher.getInstanceBuffer(i));
+      updateInstanceSet(visibleInstanceSets[i], objectTableBuffer, gpuCullSystem.getVisibleInstanceBuffer(i));
+      updateInstanceSet(lateVisibleInstanceSets[i], objectTableBuffer, gpuCullSystem.getLateVisibleInstanceBuffer(i));
+    }
+  }
+
+  // The set's frame was waited on, so it is not in use. Recorded draws binding it are not reused
+  // once it was rewritten, its write generation is part of their key
+  void SimpleRenderSystem::updateInstanceSet(InstanceSet& instanceSet, LhllBuffer& objectTableBuffer, LhllBuffer& instanceBuffer) {
+    if (instanceSet.objectTableGeneration == objectTableBuffer.getGeneration() && instanceSet.instanceGeneration == instanceBuffer.getGeneration()) return;
 
-    if (vkCreatePipelineLayout(lhllDevice.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create pipeline layout!");
+    auto objectBufferInfo = objectTableBuffer.descriptorInfo();
+    auto bufferInfo = instanceBuffer.descriptorInfo();
+    LhllDescriptorWriter writer(*instanceSetLayout, *instancePool);
+    writer.writeBuffer(0, &objectBufferInfo).writeBuffer(1, &bufferInfo);
+    if (instanceSet.descriptorSet == VK_NULL_HANDLE) {
+      if (!writer.build(instanceSet.descriptorSet)) {
+        throw std::runtime_error("failed to allocate instance descriptor set!");
+      }
+    }
+    else {
+      writer.overwrite(instanceSet.descriptorSet);
     }
+    instanceSet.objectTableGeneration = objectTableBuffer.getGeneration();
+    instanceSet.instanceGeneration = instanceBuffer.getGeneration();
+    instanceSet.writeGeneration = writer.getGeneration();
+  }
+
+  // firstInstance has to be honoured by indirect draws since it selects the instance data
+  bool SimpleRenderSystem::isIndirectDrawSupported() const {
+    const auto& features = lhllDevice.optionalFeatures();
+    return features.multiDrawIndirect && features.drawIndirectFirstInstance;
   }
 
   void SimpleRenderSystem::createPipeline(VkRenderPass renderPass) {
     assert(pipelineLayout != nullptr && "Cannot create pipeline before pipeline layout");
 
+    litPipelineConfig = makePipelineConfig(renderPass, true);
+    unlitPipelineConfig = makePipelineConfig(renderPass, false);
+    depthPrepassPipelineConfig = makeDepthPrepassPipelineConfig(renderPass);
 
-    PipelineConfigInfo pipelineConfig{};
-    LhllPipeline::defaultPipelineConfigInfo(pipelineConfig);
-    pipelineConfig.renderPass = renderPass;
-    pipelineConfig.pipelineLayout = pipelineLayout;
-    lhllPipeline = std::make_unique<LhllPipeline>(lhllDevice, "shaders/simple_shader.vert.spv", "shaders/simple_shader.frag.spv", pipelineConfig);
+    // every pipeline this system needs is declared here, so they are compiled as one parallel batch
+    std::vector<PipelineRequest> requests{
+      {vertShaderPath, fragShaderPath, litPipelineConfig.get()},
+      {vertShaderPath, fragShaderPath, unlitPipelineConfig.get()},
+      {depthPrepassVertShaderPath, depthPrepassFragShaderPath, depthPrepassPipelineConfig.get()}};
+    auto pipelines = lhllPipelineRegistry.getPipelines(requests);
+    lhllPipeline = pipelines[0];
+    fallbackPipeline = lhllPipeline;
+    fallbackPipelineConfig = litPipelineConfig;
+    depthPrepassPipeline = pipelines[2];
   }
 
-  void SimpleRenderSystem::renderGameObjects(FrameInfo& frameInfo) {
-    lhllPipeline->bind(frameInfo.commandBuffer);
+  std::shared_ptr<PipelineConfigInfo> SimpleRenderSystem::makePipelineConfig(VkRenderPass renderPass, bool enablePointLight) {
+    auto pipelineConfig = std::make_shared<PipelineConfigInfo>();
+    LhllPipeline::defaultPipelineConfigInfo(*pipelineConfig);
+    pipelineConfig->renderPass = renderPass;
+    pipelineConfig->pipelineLayout = pipelineLayout->getHandle();
+    pipelineConfig->fragSpecialization.set<VkBool32>(0, enablePointLight ? VK_TRUE : VK_FALSE);
+    // per object cull/depth state is set while recording instead of needing a pipeline per combination
+    LhllPipeline::enableExtendedDynamicState(*pipelineConfig, lhllDevice.optionalFeatures());
+    return pipelineConfig;
+  }
+
+  // Same layout and dynamic state as the main pipeline, but only reads the position stream and writes
+  // no color
+  std::shared_ptr<PipelineConfigInfo> SimpleRenderSystem::makeDepthPrepassPipelineConfig(VkRenderPass renderPass) {
+    auto pipelineConfig = std::make_shared<PipelineConfigInfo>();
+    LhllPipeline::defaultPipelineConfigInfo(*pipelineConfig);
+    pipelineConfig->bindingDescriptions = LhllModel::Vertex::getPositionBindingDescriptions();
+    pipelineConfig->attributeDescriptions = LhllModel::Vertex::getPositionAttributeDescriptions();
+    pipelineConfig->colorBlendAttachment.colorWriteMask = 0;
+    pipelineConfig->renderPass = renderPass;
+    pipelineConfig->pipelineLayout = pipelineLayout->getHandle();
+    LhllPipeline::enableExtendedDynamicState(*pipelineConfig, lhllDevice.optionalFeatures());
+    return pipelineConfig;
+  }
+
+  void SimpleRenderSystem::setPointLightEnabled(bool enabled) {
+    if (enabled == pointLightEnabled) return;
+    pointLightEnabled = enabled;
+    setPipeline(lhllPipelineRegistry.getPipelineAsync(vertShaderPath, fragShaderPath, enabled ? litPipelineConfig : unlitPipelineConfig));
+  }
 
-    vkCmdBindDescriptorSets(frameInfo.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &frameInfo.globalDescriptorSet, 0, nullptr);
+  void SimpleRenderSystem::reloadShader(const std::string& filepath) {
+    gpuCullSystem.reloadShader(filepath);
+    if (filepath == depthPrepassVertShaderPath || filepath == depthPrepassFragShaderPath) {
+      pendingDepthPrepassPipeline = lhllPipelineRegistry.getPipelineAsync(depthPrepassVertShaderPath, depthPrepassFragShaderPath, depthPrepassPipelineConfig);
+      return;
+    }
+    if (filepath != vertShaderPath && filepath != fragShaderPath) return;
+    // the other variant picks up the new code through the registry the next time it is requested
+    setPipeline(lhllPipelineRegistry.getPipelineAsync(vertShaderPath, fragShaderPath, pointLightEnabled ? litPipelineConfig : unlitPipelineConfig), true);
+    // a fallback that is the current pipeline is replaced together with it in updatePendingPipeline,
+    // a separate one (the other variant after setPointLightEnabled) is rebuilt on its own
+    if (fallbackPipelineConfig != nullptr && fallbackPipeline != lhllPipeline) {
+      pendingFallbackPipeline = lhllPipelineRegistry.getPipelineAsync(vertShaderPath, fragShaderPath, fallbackPipelineConfig);
+    }
+  }
 
-    for (auto& kv : frameInfo.gameObjects) {
-      auto& obj = kv.second;
-      if (obj.model == nullptr) continue;
-      SimplePushConstantData push{};
-      push.modelMatrix = obj.transform.mat4();
-      push.normalMatrix = obj.transform.normalMatrix();
+  void SimpleRenderSystem::setFallbackPipeline(std::shared_ptr<LhllPipeline> pipeline) {
+    fallbackPipeline = std::move(pipeline);
+    // not built from this system's shaders, so it is not rebuilt by reloadShader
+    fallbackPipelineConfig = nullptr;
+    pendingFallbackPipeline = {};
+  }
 
-      vkCmdPushConstants(frameInfo.commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SimplePushConstantData), &push);
-      obj.model->bind(frameInfo.commandBuffer);
-      obj.model->draw(frameInfo.commandBuffer);
+  void SimpleRenderSystem::setPipeline(LhllAsyncPipeline pipeline, bool keepCurrentUntilReady) {
+    pendingPipeline = std::move(pipeline);
+    keepPipelineUntilReady = keepCurrentUntilReady;
+  }
+
+  void SimpleRenderSystem::updatePendingPipeline() {
+    if (pendingDepthPrepassPipeline.isReady()) {
+      try {
+        depthPrepassPipeline = pendingDepthPrepassPipeline.get();
+      }
+      catch (const std::exception& e) {
+        std::cerr << "Depth pre-pass pipeline compilation failed, keeping the previous one: " << e.what() << '\n';
+      }
+      pendingDepthPrepassPipeline = {};
+    }
+
+    if (pendingFallbackPipeline.isReady()) {
+      try {
+        fallbackPipeline = pendingFallbackPipeline.get();
+      }
+      catch (const std::exception& e) {
+        std::cerr << "Fallback pipeline compilation failed, keeping the previous one: " << e.what() << '\n';
+      }
+      pendingFallbackPipeline = {};
+    }
+
+    if (!pendingPipeline.isReady()) return;
+
+    try {
+      auto pipeline = pendingPipeline.get();
+      if (pipeline != lhllPipeline) {
+        if (keepPipelineUntilReady && fallbackPipeline == lhllPipeline) {
+          fallbackPipeline = pipeline;
+        }
+        // command buffers of frames still in flight may reference it, the device's deletion queue
+        // keeps the VkPipeline until they finished, so no vkDeviceWaitIdle is needed
+        lhllPipeline = std::move(pipeline);
+      }
+    }
+    catch (const std::exception& e) {
+      std::cerr << "Pipeline compilation failed, keeping the previous one: " << e.what() << '\n';
+    }
+    pendingPipeline = {};
+    keepPipelineUntilReady = false;
+  }
+
+  // Draws groups [groupBegin, groupEnd) of the batch, an indirect batch becomes one multi draw. The
+  // depth pre-pass skips batches it does not cover and binds only the position stream. The late pass
+  // draws from the commands the occlusion cull filled in, its objects were not in the pre-pass
+  void SimpleRenderSystem::recordDrawRange(VkCommandBuffer commandBuffer, RecordingChunk& chunk, int frameIndex, PassKind pass, uint32_t batchIndex, uint32_t groupBegin, uint32_t groupEnd, FrameStats& stats) {
+    const auto& batch = drawBatcher.getDrawBatches()[batchIndex];
+    const auto& instanceGroups = drawBatcher.getInstanceGroups();
+    bool depthPrepass = pass == PassKind::DepthPrepass;
+    bool prepassed = frameDepthPrepass && isDepthPrepassed(batch.renderState);
+    if (depthPrepass && !prepassed) return;
+
+    RenderState renderState = batch.renderState;
+    if (prepassed && pass == PassKind::Main) {
+      renderState.depthWriteEnable = false;
+      renderState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+    }
+    stats.renderStateChanges += chunk.renderStateTracker->apply(commandBuffer, renderState);
+
+    // the late pass draws some of the same groups again
+    if (pass == PassKind::Main) {
+      for (uint32_t i = groupBegin; i < groupEnd; i++) {
+        stats.instances += instanceGroups[batch.groups[i]].instanceCount;
+      }
+    }
+
+    if (batch.geometryPool == nullptr) {
+      for (uint32_t i = groupBegin; i < groupEnd; i++) {
+        auto& group = instanceGroups[batch.groups[i]];
+        if (chunk.boundGeometry != group.model) {
+          if (depthPrepass) {
+            group.model->bindPositions(commandBuffer);
+          }
+          else {
+            group.model->bind(commandBuffer);
+          }
+          chunk.boundGeometry = group.model;
+          stats.geometryBinds++;
+        }
+        group.model->draw(commandBuffer, group.instanceCount, group.firstInstance);
+        if (depthPrepass) {
+          stats.depthPrepassDraws++;
+          continue;
+        }
+        stats.drawCalls++;
+        if (frameWaitingForPipeline) stats.pipelineFallbackDraws++;
+      }
+      return;
+    }
+
+    // the number of commands recorded no longer depends on how many models or objects there are
+    uint32_t drawCount = groupEnd - groupBegin;
+    assert(drawCount <= lhllDevice.properties.limits.maxDrawIndirectCount && "Too many draws in one indirect batch");
+    VkBuffer indirectBuffer = (pass == PassKind::Late ? gpuCullSystem.getLateCommandBuffer(frameIndex) : drawBatcher.getIndirectBuffer(frameIndex)).getBuffer();
+    VkDeviceSize indirectOffset = (batch.firstCommand + groupBegin) * sizeof(VkDrawIndexedIndirectCommand);
+
+    if (chunk.boundGeometry != batch.geometryPool) {
+      if (depthPrepass) {
+        batch.geometryPool->bindPositions(commandBuffer);
+      }
+      else {
+        batch.geometryPool->bind(commandBuffer);
+      }
+      chunk.boundGeometry = batch.geometryPool;
+      stats.geometryBinds++;
+    }
+    // culled commands stay in place with an instanceCount of 0, compacting them would tie the draw
+    // count to whole batches while slices draw parts of one
+    vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer, indirectOffset, drawCount, sizeof(VkDrawIndexedIndirectCommand));
+    if (depthPrepass) {
+      stats.depthPrepassDraws += drawCount;
+      return;
     }
+    stats.drawCalls++;
+    stats.indirectDraws += drawCount;
+    if (frameWaitingForPipeline) stats.pipelineFallbackDraws += drawCount;
+  }
+
+  // Slices split the groups of all batches evenly, in batch order. Every pass starts from scratch
+  // since secondary command buffers do not inherit bound state, and the two passes bind different
+  // vertex streams
+  void SimpleRenderSystem::recordPass(VkCommandBuffer commandBuffer, const FrameInfo& frameInfo, RecordingChunk& chunk, PassKind pass, uint32_t sliceIndex, uint32_t sliceCount, FrameStats& stats) {
+    chunk.renderStateTracker->reset();
+    chunk.boundGeometry = nullptr;
+
+    LhllPipeline* pipeline = pass == PassKind::DepthPrepass ? depthPrepassPipeline.get() : framePipeline;
+    pipeline->bind(commandBuffer);
+    VkDescriptorSet instanceSet = pass == PassKind::Late ? lateVisibleInstanceSets[frameInfo.frameIndex].descriptorSet : frameInstanceSet->descriptorSet;
+    std::array<VkDescriptorSet, 2> descriptorSets{frameInfo.globalDescriptorSet, instanceSet};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout->getHandle(), 0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+
+    const auto& drawBatches = drawBatcher.getDrawBatches();
+    uint64_t groupCount = drawBatcher.getInstanceGroups().size();
+    uint32_t sliceBegin = static_cast<uint32_t>(groupCount * sliceIndex / sliceCount);
+    uint32_t sliceEnd = static_cast<uint32_t>(groupCount * (sliceIndex + 1) / sliceCount);
+
+    uint32_t batchBegin = 0;
+    for (uint32_t batchIndex = 0; batchIndex < drawBatches.size() && batchBegin < sliceEnd; batchIndex++) {
+      uint32_t batchEnd = batchBegin + static_cast<uint32_t>(drawBatches[batchIndex].groups.size());
+      if (batchEnd > sliceBegin) {
+        uint32_t groupBegin = std::max(sliceBegin, batchBegin) - batchBegin;
+        uint32_t groupEnd = std::min(sliceEnd, batchEnd) - batchBegin;
+        recordDrawRange(commandBuffer, chunk, frameInfo.frameIndex, pass, batchIndex, groupBegin, groupEnd, stats);
+      }
+      batchBegin = batchEnd;
+    }
+  }
+
+  // Chunks are executed in index order. With the depth pre-pass the first half of the chunks holds the
+  // pre-pass slices, so all of it is done before the first main pass draw
+  void SimpleRenderSystem::recordChunk(VkCommandBuffer commandBuffer, const FrameInfo& frameInfo, uint32_t chunkIndex, FrameStats& stats) {
+    auto& chunk = recordingChunks[chunkIndex];
+    if (!frameDepthPrepass) {
+      recordPass(commandBuffer, frameInfo, chunk, PassKind::Main, chunkIndex, frameChunkCount, stats);
+      return;
+    }
+    if (frameChunkCount == 1) {
+      recordPass(commandBuffer, frameInfo, chunk, PassKind::DepthPrepass, 0, 1, stats);
+      recordPass(commandBuffer, frameInfo, chunk, PassKind::Main, 0, 1, stats);
+      return;
+    }
+    uint32_t sliceCount = frameChunkCount / 2;
+    recordPass(commandBuffer, frameInfo, chunk, chunkIndex < sliceCount ? PassKind::DepthPrepass : PassKind::Main, chunkIndex % sliceCount, sliceCount, stats);
+  }
+
+  void SimpleRenderSystem::prepareFrame(FrameInfo& frameInfo) {
+    // the start of recording is the frame boundary where a finished pipeline gets swapped in
+    updatePendingPipeline();
+    gpuCullSystem.readBackResults(frameInfo, drawBatcher);
+
+    int frameIndex = frameInfo.frameIndex;
+    frameWaitingForPipeline = pendingPipeline.valid() && !keepPipelineUntilReady;
+    framePipeline = frameWaitingForPipeline ? fallbackPipeline.get() : lhllPipeline.get();
+    frameIndirect = false;
+    frameCpuCulled = false;
+    frameGpuCulled = false;
+    frameOcclusionCulled = false;
+    frameDepthPrepass = false;
+    frameChunkCount = 1;
+    frameUsesSecondaries = false;
+    preparedFrameIndex = frameIndex;
+
+    if (framePipeline == nullptr) return;
+
+    // the GPU cull needs every draw to go through the indirect path
+    frameIndirect = indirectDrawEnabled && isIndirectDrawSupported();
+    drawBatcher.collectObjects(frameInfo);
+    frameCpuCulled = cullingMode == CullingMode::Cpu || (cullingMode == CullingMode::Gpu && !frameIndirect);
+    if (frameCpuCulled) {
+      cpuCullSystem.cull(frameInfo, drawBatcher.getDrawObjects(), objectVisibility);
+      drawBatcher.keepVisible(objectVisibility);
+    }
+
+    drawBatcher.build(frameInfo, frameIndirect);
+    frameGpuCulled = cullingMode == CullingMode::Gpu && !drawBatcher.getDrawBatches().empty() && drawBatcher.isAllIndirect();
+    frameOcclusionCulled = frameGpuCulled && occlusionCullingEnabled && frameInfo.renderPassTarget.depthImageView != VK_NULL_HANDLE;
+    drawBatcher.writeIndirectCommands(frameIndex, frameGpuCulled);
+    if (frameGpuCulled) {
+      gpuCullSystem.cull(frameInfo, drawBatcher, frameOcclusionCulled);
+    }
+
+    frameInstanceSet = frameGpuCulled ? &visibleInstanceSets[frameIndex] : &instanceSets[frameIndex];
+    updateInstanceSet(*frameInstanceSet, drawBatcher.getObjectTable().getBuffer(frameIndex), frameGpuCulled ? gpuCullSystem.getVisibleInstanceBuffer(frameIndex) : drawBatcher.getInstanceBuffer(frameIndex));
+
+    frameDepthPrepass = depthPrepassEnabled && isDepthPrepassSupported() && depthPrepassPipeline != nullptr;
+
+    if (parallelRecordingEnabled) {
+      uint32_t sliceCount = static_cast<uint32_t>(drawBatcher.getInstanceGroups().size()) / MIN_GROUPS_PER_CHUNK;
+      if (frameDepthPrepass) {
+        // each slice is recorded once per pass
+        sliceCount = std::min(sliceCount, parallelRecorder.getMaxChunkCount() / 2);
+        frameChunkCount = sliceCount > 1 ? 2 * sliceCount : 1;
+      }
+      else {
+        frameChunkCount = std::max(1u, std::min(sliceCount, parallelRecorder.getMaxChunkCount()));
+      }
+    }
+    // a single chunk is still recorded into a secondary command buffer so it can be kept
+    frameUsesSecondaries = frameChunkCount > 1 || commandCachingEnabled;
+  }
+
+  // The generations of everything the draws reference, a handful of counters however many objects
+  // there are. The groups and batches follow from the scene version as long as the CPU does not cull,
+  // its instance counts change whenever the camera moves. Without the generations of the caller's
+  // render pass and global set there is nothing to tell their handles apart by, the key stays empty
+  void SimpleRenderSystem::buildCacheKey(const FrameInfo& frameInfo) {
+    cacheKey.clear();
+    if (!commandCachingEnabled || frameCpuCulled || frameInfo.renderPassTarget.generation == 0 || frameInfo.globalDescriptorSetGeneration == 0) return;
+
+    uint64_t flags = (frameWaitingForPipeline ? 1 : 0) | (frameDepthPrepass ? 2 : 0) | (frameGpuCulled ? 4 : 0) | (frameIndirect ? 8 : 0);
+    cacheKey.assign({
+        framePipeline->getGeneration(),
+        frameDepthPrepass ? depthPrepassPipeline->getGeneration() : 0,
+        frameInfo.renderPassTarget.generation,
+        frameInfo.globalDescriptorSetGeneration,
+        frameInstanceSet->writeGeneration,
+        drawBatcher.getIndirectBuffer(frameInfo.frameIndex).getGeneration(),
+        drawBatcher.getObjectTable().getSceneVersion(),
+        flags});
+  }
+
+  void SimpleRenderSystem::renderGameObjects(FrameInfo& frameInfo) {
+    assert(preparedFrameIndex == frameInfo.frameIndex && "prepareFrame has to be called before the render pass begins");
+    preparedFrameIndex = -1;
+
+    if (framePipeline == nullptr) {
+      for (auto& kv : frameInfo.gameObjects) {
+        if (kv.second.model != nullptr) frameInfo.stats.pipelineSkippedDraws++;
+      }
+      return;
+    }
+
+    auto recordStart = std::chrono::high_resolution_clock::now();
+    if (!frameUsesSecondaries) {
+      recordChunk(frameInfo.commandBuffer, frameInfo, 0, frameInfo.stats);
+    }
+    else {
+      buildCacheKey(frameInfo);
+      parallelRecorder.record(frameInfo.commandBuffer, frameInfo.frameIndex, frameInfo.renderPassTarget, frameChunkCount, [&](VkCommandBuffer commandBuffer, uint32_t chunkIndex, FrameStats& stats) {
+        recordChunk(commandBuffer, frameInfo, chunkIndex, stats);
+      }, cacheKey, frameInfo.stats);
+    }
+    auto recordEnd = std::chrono::high_resolution_clock::now();
+    frameInfo.stats.recordMicroseconds = std::chrono::duration<float, std::micro>(recordEnd - recordStart).count();
+  }
+
+  void SimpleRenderSystem::cullOccluded(FrameInfo& frameInfo) {
+    assert(frameOcclusionCulled && "cullOccluded needs a frame prepared with occlusion culling");
+    int frameIndex = frameInfo.frameIndex;
+    gpuCullSystem.cullOccluded(frameInfo, drawBatcher);
+    updateInstanceSet(lateVisibleInstanceSets[frameIndex], drawBatcher.getObjectTable().getBuffer(frameIndex), gpuCullSystem.getLateVisibleInstanceBuffer(frameIndex));
+  }
+
+  // a handful of multi draws, recorded inline every frame
+  void SimpleRenderSystem::renderLateObjects(FrameInfo& frameInfo) {
+    assert(frameOcclusionCulled && "renderLateObjects needs a frame prepared with occlusion culling");
+    recordPass(frameInfo.commandBuffer, frameInfo, recordingChunks[0], PassKind::Late, 0, 1, frameInfo.stats);
+  }
+
+  void SimpleRenderSystem::addPasses(LhllRenderGraph& renderGraph, LhllRenderer& renderer, FrameInfo& frameInfo, const LhllRenderGraph::Usage& colorFinalUsage) {
+    auto targets = renderGraph.importRendererTargets(renderer, colorFinalUsage);
+    renderGraph.addRendererPass("main", renderer, targets, getSubpassContents(), [this, &frameInfo](VkCommandBuffer) { renderGameObjects(frameInfo); });
+    if (!hasLatePass()) return;
+
+    // the occlusion cull reads the depth the main pass left and the late pass draws what it missed on
+    // top, its results are in the cull system's buffers, which it synchronizes itself
+    renderGraph.addPass("occlusion cull")
+        .read(targets.depth, LhllRenderGraph::Usage::depthReadOnly(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT))
+        .setSideEffects()
+        .setExecute([this, &frameInfo](VkCommandBuffer) { cullOccluded(frameInfo); });
+    renderGraph.addResumedRendererPass("late", renderer, targets, [this, &frameInfo](VkCommandBuffer) { renderLateObjects(frameInfo); });
   }
 
 }
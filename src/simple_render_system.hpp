@@ -1,34 +1,210 @@
 #ifndef SIMPLE_RENDER_SYSTEM_HPP
 #define SIMPLE_RENDER_SYSTEM_HPP
 
-#include "lhll_camera.hpp"
+#include "cpu_cull_system.hpp"
+#include "gpu_cull_system.hpp"
+#include "lhll_buffer.hpp"
+#include "lhll_descriptors.hpp"
 #include "lhll_device.hpp"
+#include "lhll_draw_batcher.hpp"
 #include "lhll_frame_info.hpp"
-#include "lhll_game_object.hpp"
+#include "lhll_parallel_recorder.hpp"
 #include "lhll_pipeline.hpp"
+#include "lhll_pipeline_layout.hpp"
+#include "lhll_pipeline_registry.hpp"
+#include "lhll_render_graph.hpp"
+#include "lhll_render_state.hpp"
+#include "lhll_renderer.hpp"
+#include "lhll_thread_pool.hpp"
 
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace lhll {
+  // Draws the instance groups and batches of an LhllDrawBatcher, the vertex shader finds the object
+  // table entry of gl_InstanceIndex in a per frame buffer of object indices. Indirect batches are one
+  // multi draw indirect call each. Objects are culled by the CpuCullSystem before they are batched or
+  // by the GpuCullSystem when every draw goes through the indirect path. The draws are recorded by an
+  // LhllParallelRecorder, which keeps them per frame in flight until a generation they were recorded
+  // from changed. With the depth pre-pass on, opaque objects are first drawn depth only from their
+  // position stream and then shaded where their depth is EQUAL, so every pixel is shaded once. With
+  // occlusion culling what the GPU cull found visible since the last frame is drawn in a second, late
+  // pass
   class SimpleRenderSystem {
   public:
-    SimpleRenderSystem(LhllDevice& device, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
-    ~SimpleRenderSystem();
+    enum class CullingMode {
+      None,
+      // SIMD bounding sphere test on the CPU
+      Cpu,
+      // compute pass filling in the indirect instance counts, the CPU test is used instead while
+      // indirect draws are off
+      Gpu,
+    };
+
+    SimpleRenderSystem(LhllDevice& device, LhllPipelineRegistry& pipelineRegistry, LhllThreadPool& threadPool, VkRenderPass renderPass, VkDescriptorSetLayout globalSetLayout);
 
     SimpleRenderSystem(const SimpleRenderSystem&) = delete;
     SimpleRenderSystem& operator=(const SimpleRenderSystem&) = delete;
 
+    // writes this frame's buffers and records the GPU cull, has to be called before the render pass
+    void prepareFrame(FrameInfo& frameInfo);
+    // how the render pass has to be begun for the frame prepared last
+    VkSubpassContents getSubpassContents() const { return frameUsesSecondaries ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE; }
     void renderGameObjects(FrameInfo& frameInfo);
 
+    // When the prepared frame is occlusion culled, cullOccluded has to be recorded after the render
+    // pass of renderGameObjects ended, with the depth in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+    // and its writes visible to compute, and renderLateObjects into the render pass resumed after it
+    bool hasLatePass() const { return frameOcclusionCulled; }
+    void cullOccluded(FrameInfo& frameInfo);
+    void renderLateObjects(FrameInfo& frameInfo);
+
+    // Adds the passes of the prepared frame on the renderer's current color and depth images to a
+    // graph begun for the frame: the main pass and, when it has one, the occlusion cull and late pass.
+    // colorFinalUsage is as for LhllRenderGraph::importRendererTargets. frameInfo has to outlive the
+    // execute
+    void addPasses(LhllRenderGraph& renderGraph, LhllRenderer& renderer, FrameInfo& frameInfo, const LhllRenderGraph::Usage& colorFinalUsage);
+
+    // Swapped in at the start of the first frame after it finished compiling, until then draws use
+    // the fallback pipeline, or are skipped when there is none. keepCurrentUntilReady keeps drawing
+    // with the current pipeline instead
+    void setPipeline(LhllAsyncPipeline pipeline, bool keepCurrentUntilReady = false);
+    void setFallbackPipeline(std::shared_ptr<LhllPipeline> pipeline);
+
+    // switches between the specialized shader variants, both are compiled at startup
+    void setPointLightEnabled(bool enabled);
+    bool isPointLightEnabled() const { return pointLightEnabled; }
+
+    // rebuilds the pipeline in the background when it uses the reloaded SPIR-V file
+    void reloadShader(const std::string& filepath);
+
+    // the direct path is still used for models outside a geometry pool or when this is off
+    void setIndirectDrawEnabled(bool enabled) { indirectDrawEnabled = enabled; }
+    bool isIndirectDrawEnabled() const { return indirectDrawEnabled; }
+    bool isIndirectDrawSupported() const;
+
+    // large scenes are split across the thread pool into secondary command buffers
+    void setParallelRecordingEnabled(bool enabled) { parallelRecordingEnabled = enabled; }
+    bool isParallelRecordingEnabled() const { return parallelRecordingEnabled; }
+
+    // Recorded draws are reused while nothing they contain changed. CPU culling changes the instance
+    // counts whenever the camera moves, frames it culled are always recorded again
+    void setCommandCachingEnabled(bool enabled) { commandCachingEnabled = enabled; }
+    bool isCommandCachingEnabled() const { return commandCachingEnabled; }
+
+    // needs extended dynamic state, the main pass switches the depth test per render state
+    void setDepthPrepassEnabled(bool enabled) { depthPrepassEnabled = enabled; }
+    bool isDepthPrepassEnabled() const { return depthPrepassEnabled; }
+    bool isDepthPrepassSupported() const { return lhllDevice.optionalFeatures().extendedDynamicState; }
+
+    // only used while the GPU culls and the frame's render pass target has a depth image view
+    void setOcclusionCullingEnabled(bool enabled) { occlusionCullingEnabled = enabled; }
+    bool isOcclusionCullingEnabled() const { return occlusionCullingEnabled; }
+
+    // the occluder flagged objects hide others in the CPU cull, when the CPU culls
+    void setSoftwareOcclusionEnabled(bool enabled) { cpuCullSystem.setSoftwareOcclusionEnabled(enabled); }
+    bool isSoftwareOcclusionEnabled() const { return cpuCullSystem.isSoftwareOcclusionEnabled(); }
+
+    void setCullingMode(CullingMode mode) { cullingMode = mode; }
+    CullingMode getCullingMode() const { return cullingMode; }
+
   private:
-    void createPipelineLayout(VkDescriptorSetLayout globalSetLayout);
+    enum class PassKind {
+      DepthPrepass,
+      Main,
+      // what the occlusion cull found after the main pass, drawn with the objects' own depth test
+      Late,
+    };
+
+    // A per frame set of the object table and an instance buffer, as the vertex shader reads them.
+    // Rewritten when either buffer was replaced
+    struct InstanceSet {
+      VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+      uint64_t objectTableGeneration = 0;
+      uint64_t instanceGeneration = 0;
+      // of the writer that last wrote it, recorded draws binding it are kept while it stays the same
+      uint64_t writeGeneration = 0;
+    };
+
+    // what a command buffer has bound while recording one chunk
+    struct RecordingChunk {
+      std::unique_ptr<LhllRenderStateTracker> renderStateTracker;
+      // model or geometry pool whose vertex and index buffers are bound
+      const void* boundGeometry;
+    };
+
+    void createInstanceSets();
+    void updateInstanceSet(InstanceSet& instanceSet, LhllBuffer& objectTableBuffer, LhllBuffer& instanceBuffer);
     void createPipeline(VkRenderPass renderPass);
+    std::shared_ptr<PipelineConfigInfo> makePipelineConfig(VkRenderPass renderPass, bool enablePointLight);
+    std::shared_ptr<PipelineConfigInfo> makeDepthPrepassPipelineConfig(VkRenderPass renderPass);
+    void updatePendingPipeline();
+    void buildCacheKey(const FrameInfo& frameInfo);
+    void recordDrawRange(VkCommandBuffer commandBuffer, RecordingChunk& chunk, int frameIndex, PassKind pass, uint32_t batchIndex, uint32_t groupBegin, uint32_t groupEnd, FrameStats& stats);
+    void recordPass(VkCommandBuffer commandBuffer, const FrameInfo& frameInfo, RecordingChunk& chunk, PassKind pass, uint32_t sliceIndex, uint32_t sliceCount, FrameStats& stats);
+    void recordChunk(VkCommandBuffer commandBuffer, const FrameInfo& frameInfo, uint32_t chunkIndex, FrameStats& stats);
 
     LhllDevice& lhllDevice;
+    LhllPipelineRegistry& lhllPipelineRegistry;
+
+    std::shared_ptr<LhllPipeline> lhllPipeline;
+    std::shared_ptr<LhllPipeline> fallbackPipeline;
+    // the variant the fallback was built from, null when it was set from outside
+    std::shared_ptr<PipelineConfigInfo> fallbackPipelineConfig;
+    // the fallback rebuilt after a shader reload, the current one is used until it is ready
+    LhllAsyncPipeline pendingFallbackPipeline;
+    LhllAsyncPipeline pendingPipeline;
+    bool keepPipelineUntilReady = false;
+
+    std::shared_ptr<PipelineConfigInfo> litPipelineConfig;
+    std::shared_ptr<PipelineConfigInfo> unlitPipelineConfig;
+    bool pointLightEnabled = true;
+
+    std::shared_ptr<PipelineConfigInfo> depthPrepassPipelineConfig;
+    std::shared_ptr<LhllPipeline> depthPrepassPipeline;
+    // a reloaded pre-pass shader, the current pipeline is used until it is ready
+    LhllAsyncPipeline pendingDepthPrepassPipeline;
+    bool depthPrepassEnabled = false;
+
+    LhllDrawBatcher drawBatcher;
+    CpuCullSystem cpuCullSystem;
+    GpuCullSystem gpuCullSystem;
+    LhllParallelRecorder parallelRecorder;
+
+    std::unique_ptr<LhllDescriptorSetLayout> instanceSetLayout;
+    std::unique_ptr<LhllDescriptorPool> instancePool;
+    std::unique_ptr<LhllPipelineLayout> pipelineLayout;
+    // the instances the CPU wrote, the ones the GPU cull kept and the ones the late pass draws
+    std::vector<InstanceSet> instanceSets;
+    std::vector<InstanceSet> visibleInstanceSets;
+    std::vector<InstanceSet> lateVisibleInstanceSets;
+
+    bool indirectDrawEnabled = true;
+    CullingMode cullingMode = CullingMode::Gpu;
+    bool occlusionCullingEnabled = false;
+    bool parallelRecordingEnabled = true;
+    bool commandCachingEnabled = true;
+
+    // decided in prepareFrame, used by renderGameObjects
+    int preparedFrameIndex = -1;
+    LhllPipeline* framePipeline = nullptr;
+    bool frameWaitingForPipeline = false;
+    bool frameIndirect = false;
+    bool frameCpuCulled = false;
+    bool frameGpuCulled = false;
+    bool frameOcclusionCulled = false;
+    bool frameDepthPrepass = false;
+    uint32_t frameChunkCount = 1;
+    bool frameUsesSecondaries = false;
+    // of the main pass and the pre-pass
+    InstanceSet* frameInstanceSet = nullptr;
 
-    std::unique_ptr<LhllPipeline> lhllPipeline;
-    VkPipelineLayout pipelineLayout;
+    // one per chunk the recorder supports
+    std::vector<RecordingChunk> recordingChunks;
+    // rebuilt every frame, kept as members so their memory is reused
+    std::vector<uint8_t> objectVisibility;
+    std::vector<uint64_t> cacheKey;
   };
 }
 